@@ -422,6 +422,9 @@ typedef struct {
 #define COMPLEX2VEC(n)	(((n)>0)?(((n)*sizeof(Rcomplex)-1)/sizeof(VECREC)+1):0)
 #define PTR2VEC(n)	(((n)>0)?(((n)*sizeof(SEXP)-1)/sizeof(VECREC)+1):0)
 
+/* Shorter results of rep() and vector() are not made compact */
+#define R_COMPACT_REP_MIN_LENGTH 4096
+
 /* Bindings */
 /* use the same bits (15 and 14) in symbols and bindings */
 #define ACTIVE_BINDING_MASK (1<<15)
@@ -807,6 +810,25 @@ extern0 int R_jit_enabled INI_as(0); /* has to be 0 during R startup */
 extern0 int R_compile_pkgs INI_as(0);
 extern0 int R_check_constants INI_as(0);
 extern0 int R_disable_bytecode INI_as(0);
+
+/* Function and S3 method lookup caches (GETFUN in eval.c, usemethod
+   in objects.c) are valid while R_LookupEpoch is unchanged. It is
+   advanced when a binding whose old or new value could be found by
+   findFun is created, changed or removed, when an enclosure or the
+   search path changes, and at every garbage collection, so cached
+   pointers are never used after the objects could have been reused.
+   Lookups reading active bindings or user databases advance
+   R_VolatileLookups and are not cached. */
+extern0 uint64_t R_LookupEpoch INI_as(1);
+extern0 unsigned int R_VolatileLookups INI_as(0);
+#define IS_LOOKUP_RELEVANT(v) \
+    (TYPEOF(v) == CLOSXP || TYPEOF(v) == BUILTINSXP || \
+     TYPEOF(v) == SPECIALSXP || TYPEOF(v) == PROMSXP || (v) == R_MissingArg)
+#define NOTE_BINDING_CHANGE(oldval, newval) do { \
+    if (IS_LOOKUP_RELEVANT(oldval) || IS_LOOKUP_RELEVANT(newval)) \
+	R_LookupEpoch++; \
+} while (0)
+
 extern SEXP R_cmpfun1(SEXP); /* unconditional fresh compilation */
 extern void R_init_jit_enabled(void);
 extern void R_initAssignSymbols(void);
@@ -1151,6 +1173,7 @@ SEXP R_possible_dispatch(SEXP, SEXP, SEXP, SEXP, Rboolean);
 Rboolean inherits2(SEXP, const char *);
 void InitGraphics(void);
 void InitMemory(void);
+void R_PinLargeVectors(void);
 void InitNames(void);
 void InitOptions(void);
 void InitStringHash(void);
@@ -1212,6 +1235,10 @@ SEXP R_data_class2(SEXP);
 char *R_LibraryFileName(const char *, char *, size_t);
 SEXP R_LoadFromFile(FILE*, int);
 SEXP R_NewHashedEnv(SEXP, SEXP);
+SEXP R_hash_indexed_data(SEXP);
+SEXP R_hash_index(SEXP);
+void R_set_hash_index(SEXP, SEXP);
+SEXP R_wrap_meta(SEXP, int, int);
 extern int R_Newhashpjw(const char *);
 FILE* R_OpenLibraryFile(const char *);
 SEXP R_Primitive(const char *);
@@ -76,6 +76,8 @@ SEXP do_basename(SEXP, SEXP, SEXP, SEXP);
 SEXP do_bcprofcounts(SEXP, SEXP, SEXP, SEXP);
 SEXP do_bcprofstart(SEXP, SEXP, SEXP, SEXP);
 SEXP do_bcprofstop(SEXP, SEXP, SEXP, SEXP);
+SEXP do_bccountstart(SEXP, SEXP, SEXP, SEXP);
+SEXP do_bccountstop(SEXP, SEXP, SEXP, SEXP);
 SEXP do_begin(SEXP, SEXP, SEXP, SEXP);
 SEXP do_bincode(SEXP, SEXP, SEXP, SEXP);
 SEXP do_bind(SEXP, SEXP, SEXP, SEXP);
@@ -179,8 +181,11 @@ SEXP do_formatPOSIXlt(SEXP, SEXP, SEXP, SEXP);
 SEXP do_formals(SEXP, SEXP, SEXP, SEXP);
 SEXP do_function(SEXP, SEXP, SEXP, SEXP);
 SEXP do_gc(SEXP, SEXP, SEXP, SEXP);
+SEXP do_gcevents(SEXP, SEXP, SEXP, SEXP);
 SEXP do_gcinfo(SEXP, SEXP, SEXP, SEXP);
+SEXP do_gcpolicy(SEXP, SEXP, SEXP, SEXP);
 SEXP do_gctime(SEXP, SEXP, SEXP, SEXP);
+SEXP do_gctrace(SEXP, SEXP, SEXP, SEXP);
 SEXP do_gctorture(SEXP, SEXP, SEXP, SEXP);
 SEXP do_gctorture2(SEXP, SEXP, SEXP, SEXP);
 SEXP do_get(SEXP, SEXP, SEXP, SEXP);
@@ -441,6 +446,7 @@ SEXP do_while(SEXP, SEXP, SEXP, SEXP);
 SEXP do_which(SEXP, SEXP, SEXP, SEXP);
 SEXP do_withVisible(SEXP, SEXP, SEXP, SEXP);
 SEXP do_wrap_meta(SEXP, SEXP, SEXP, SEXP);
+SEXP do_hashindex(SEXP, SEXP, SEXP, SEXP);
 SEXP do_xtfrm(SEXP, SEXP, SEXP, SEXP);
 
 SEXP do_getSnapshot(SEXP, SEXP, SEXP, SEXP);
@@ -52,6 +52,11 @@ long double *R_allocLD(R_SIZE_T nelem);
 char*	S_alloc(long, int);
 char*	S_realloc(char *, long, long, int);
 
+/* Scratch memory which can be used from any thread */
+void*	R_thread_alloc(R_SIZE_T, int);
+void*	R_thread_vmaxget(void);
+void	R_thread_vmaxset(const void *);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -705,7 +705,15 @@ int REAL_NO_NA(SEXP x);
 SEXP REAL_IS_NA(SEXP x);
 int STRING_IS_SORTED(SEXP x);
 int STRING_NO_NA(SEXP x);
+R_xlen_t LOGICAL_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, int *buf);
+int LOGICAL_IS_SORTED(SEXP x);
+int LOGICAL_NO_NA(SEXP x);
+R_xlen_t RAW_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, Rbyte *buf);
+R_xlen_t COMPLEX_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, Rcomplex *buf);
 SEXP R_compact_intrange(R_xlen_t n1, R_xlen_t n2);
+SEXP R_compact_rep(SEXP x, R_xlen_t n);
+SEXP R_compact_rep_each(SEXP x, R_xlen_t each);
+SEXP R_compact_rep_times(SEXP x, SEXP times);
 SEXP R_deferred_coerceToString(SEXP v, SEXP sp);
 SEXP R_virtrep_vec(SEXP, SEXP);
 
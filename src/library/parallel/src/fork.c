@@ -517,6 +517,8 @@ SEXP mc_fork(SEXP sEstranged)
     res_i[0] = (int) pid;
     if (pid == 0) { /* child */
 	R_isForkedChild = 1;
+	/* keep the collector off the pages of inherited large vectors */
+	R_PinLargeVectors();
 	/* free children entries inherited from parent */
 	while(children) {
 	    close_fds_child_ci(children);
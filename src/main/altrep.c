@@ -26,6 +26,7 @@
 #include <float.h> /* for DBL_DIG */
 #include <Print.h> /* for R_print */
 #include <R_ext/Itermacros.h>
+#include <Fileio.h> /* for R_fopen */
 
 
 /**
@@ -119,6 +120,9 @@ static void SET_ALTREP_CLASS(SEXP x, SEXP class)
 #define ALTINTEGER_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altinteger)
 #define ALTREAL_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altreal)
 #define ALTSTRING_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altstring)
+#define ALTLOGICAL_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altlogical)
+#define ALTRAW_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altraw)
+#define ALTCOMPLEX_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altcomplex)
 
 #define ALTREP_METHODS						\
     R_altrep_UnserializeEX_method_t UnserializeEX;		\
@@ -156,6 +160,23 @@ static void SET_ALTREP_CLASS(SEXP x, SEXP class)
     R_altreal_Min_method_t Min;			\
     R_altreal_Max_method_t Max
 
+#define ALTLOGICAL_METHODS			\
+    ALTVEC_METHODS;				\
+    R_altlogical_Elt_method_t Elt;		\
+    R_altlogical_Get_region_method_t Get_region;	\
+    R_altlogical_Is_sorted_method_t Is_sorted;	\
+    R_altlogical_No_NA_method_t No_NA
+
+#define ALTRAW_METHODS				\
+    ALTVEC_METHODS;				\
+    R_altraw_Elt_method_t Elt;			\
+    R_altraw_Get_region_method_t Get_region
+
+#define ALTCOMPLEX_METHODS			\
+    ALTVEC_METHODS;				\
+    R_altcomplex_Elt_method_t Elt;		\
+    R_altcomplex_Get_region_method_t Get_region
+
 #define ALTSTRING_METHODS			\
     ALTVEC_METHODS;				\
     R_altstring_Elt_method_t Elt;		\
@@ -168,6 +189,9 @@ typedef struct { ALTVEC_METHODS; } altvec_methods_t;
 typedef struct { ALTINTEGER_METHODS; } altinteger_methods_t;
 typedef struct { ALTREAL_METHODS; } altreal_methods_t;
 typedef struct { ALTSTRING_METHODS; } altstring_methods_t;
+typedef struct { ALTLOGICAL_METHODS; } altlogical_methods_t;
+typedef struct { ALTRAW_METHODS; } altraw_methods_t;
+typedef struct { ALTCOMPLEX_METHODS; } altcomplex_methods_t;
 
 /* Macro to extract first element from ... macro argument.
    From Richard Hansen's answer in
@@ -184,6 +208,9 @@ typedef struct { ALTSTRING_METHODS; } altstring_methods_t;
 #define ALTINTEGER_DISPATCH(fun, ...) DO_DISPATCH(ALTINTEGER, fun, __VA_ARGS__)
 #define ALTREAL_DISPATCH(fun, ...) DO_DISPATCH(ALTREAL, fun, __VA_ARGS__)
 #define ALTSTRING_DISPATCH(fun, ...) DO_DISPATCH(ALTSTRING, fun, __VA_ARGS__)
+#define ALTLOGICAL_DISPATCH(fun, ...) DO_DISPATCH(ALTLOGICAL, fun, __VA_ARGS__)
+#define ALTRAW_DISPATCH(fun, ...) DO_DISPATCH(ALTRAW, fun, __VA_ARGS__)
+#define ALTCOMPLEX_DISPATCH(fun, ...) DO_DISPATCH(ALTCOMPLEX, fun, __VA_ARGS__)
 
 
 /*
@@ -442,6 +469,73 @@ int STRING_NO_NA(SEXP x)
     return ALTREP(x) ? ALTSTRING_DISPATCH(No_NA, x) : 0;
 }
 
+int attribute_hidden ALTLOGICAL_ELT(SEXP x, R_xlen_t i)
+{
+    return ALTLOGICAL_DISPATCH(Elt, x, i);
+}
+
+R_xlen_t LOGICAL_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, int *buf)
+{
+    const int *x = LOGICAL_OR_NULL(sx);
+    if (x != NULL) {
+	R_xlen_t size = XLENGTH(sx);
+	R_xlen_t ncopy = size - i > n ? n : size - i;
+	for (R_xlen_t k = 0; k < ncopy; k++)
+	    buf[k] = x[k + i];
+	return ncopy;
+    }
+    else
+	return ALTLOGICAL_DISPATCH(Get_region, sx, i, n, buf);
+}
+
+int LOGICAL_IS_SORTED(SEXP x)
+{
+    return ALTREP(x) ? ALTLOGICAL_DISPATCH(Is_sorted, x) : UNKNOWN_SORTEDNESS;
+}
+
+int LOGICAL_NO_NA(SEXP x)
+{
+    return ALTREP(x) ? ALTLOGICAL_DISPATCH(No_NA, x) : 0;
+}
+
+Rbyte attribute_hidden ALTRAW_ELT(SEXP x, R_xlen_t i)
+{
+    return ALTRAW_DISPATCH(Elt, x, i);
+}
+
+R_xlen_t RAW_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, Rbyte *buf)
+{
+    const Rbyte *x = RAW_OR_NULL(sx);
+    if (x != NULL) {
+	R_xlen_t size = XLENGTH(sx);
+	R_xlen_t ncopy = size - i > n ? n : size - i;
+	for (R_xlen_t k = 0; k < ncopy; k++)
+	    buf[k] = x[k + i];
+	return ncopy;
+    }
+    else
+	return ALTRAW_DISPATCH(Get_region, sx, i, n, buf);
+}
+
+Rcomplex attribute_hidden ALTCOMPLEX_ELT(SEXP x, R_xlen_t i)
+{
+    return ALTCOMPLEX_DISPATCH(Elt, x, i);
+}
+
+R_xlen_t COMPLEX_GET_REGION(SEXP sx, R_xlen_t i, R_xlen_t n, Rcomplex *buf)
+{
+    const Rcomplex *x = COMPLEX_OR_NULL(sx);
+    if (x != NULL) {
+	R_xlen_t size = XLENGTH(sx);
+	R_xlen_t ncopy = size - i > n ? n : size - i;
+	for (R_xlen_t k = 0; k < ncopy; k++)
+	    buf[k] = x[k + i];
+	return ncopy;
+    }
+    else
+	return ALTCOMPLEX_DISPATCH(Get_region, sx, i, n, buf);
+}
+
 SEXP ALTINTEGER_SUM(SEXP x, Rboolean narm)
 {
     return ALTINTEGER_DISPATCH(Sum, x, narm);
@@ -479,21 +573,6 @@ SEXP ALTREAL_MAX(SEXP x, Rboolean narm)
  * Not yet implemented
  */
 
-int attribute_hidden ALTLOGICAL_ELT(SEXP x, R_xlen_t i)
-{
-    return LOGICAL(x)[i]; /* dispatch here */
-}
-
-Rcomplex attribute_hidden ALTCOMPLEX_ELT(SEXP x, R_xlen_t i)
-{
-    return COMPLEX(x)[i]; /* dispatch here */
-}
-
-Rbyte attribute_hidden ALTRAW_ELT(SEXP x, R_xlen_t i)
-{
-    return RAW(x)[i]; /* dispatch here */
-}
-
 void ALTINTEGER_SET_ELT(SEXP x, R_xlen_t i, int v)
 {
     INTEGER(x)[i] = v; /* dispatch here */
@@ -634,6 +713,48 @@ static SEXP altreal_Sum_default(SEXP x, Rboolean narm) { return NULL; }
 static SEXP altreal_Min_default(SEXP x, Rboolean narm) { return NULL; }
 static SEXP altreal_Max_default(SEXP x, Rboolean narm) { return NULL; }
 
+static int altlogical_Elt_default(SEXP x, R_xlen_t i) { return LOGICAL(x)[i]; }
+
+static R_xlen_t
+altlogical_Get_region_default(SEXP sx, R_xlen_t i, R_xlen_t n, int *buf)
+{
+    R_xlen_t size = XLENGTH(sx);
+    R_xlen_t ncopy = size - i > n ? n : size - i;
+    for (R_xlen_t k = 0; k < ncopy; k++)
+	buf[k] = LOGICAL_ELT(sx, k + i);
+    return ncopy;
+}
+
+static int altlogical_Is_sorted_default(SEXP x) { return UNKNOWN_SORTEDNESS; }
+static int altlogical_No_NA_default(SEXP x) { return 0; }
+
+static Rbyte altraw_Elt_default(SEXP x, R_xlen_t i) { return RAW(x)[i]; }
+
+static R_xlen_t
+altraw_Get_region_default(SEXP sx, R_xlen_t i, R_xlen_t n, Rbyte *buf)
+{
+    R_xlen_t size = XLENGTH(sx);
+    R_xlen_t ncopy = size - i > n ? n : size - i;
+    for (R_xlen_t k = 0; k < ncopy; k++)
+	buf[k] = RAW_ELT(sx, k + i);
+    return ncopy;
+}
+
+static Rcomplex altcomplex_Elt_default(SEXP x, R_xlen_t i)
+{
+    return COMPLEX(x)[i];
+}
+
+static R_xlen_t
+altcomplex_Get_region_default(SEXP sx, R_xlen_t i, R_xlen_t n, Rcomplex *buf)
+{
+    R_xlen_t size = XLENGTH(sx);
+    R_xlen_t ncopy = size - i > n ? n : size - i;
+    for (R_xlen_t k = 0; k < ncopy; k++)
+	buf[k] = COMPLEX_ELT(sx, k + i);
+    return ncopy;
+}
+
 static SEXP altstring_Elt_default(SEXP x, R_xlen_t i)
 {
     error("ALTSTRING classes must provide an Elt method");
@@ -694,6 +815,55 @@ static altreal_methods_t altreal_default_methods = {
     .Max = altreal_Max_default
 };
 
+static altlogical_methods_t altlogical_default_methods = {
+    .UnserializeEX = altrep_UnserializeEX_default,
+    .Unserialize = altrep_Unserialize_default,
+    .Serialized_state = altrep_Serialized_state_default,
+    .DuplicateEX = altrep_DuplicateEX_default,
+    .Duplicate = altrep_Duplicate_default,
+    .Coerce = altrep_Coerce_default,
+    .Inspect = altrep_Inspect_default,
+    .Length = altrep_Length_default,
+    .Dataptr = altvec_Dataptr_default,
+    .Dataptr_or_null = altvec_Dataptr_or_null_default,
+    .Extract_subset = altvec_Extract_subset_default,
+    .Elt = altlogical_Elt_default,
+    .Get_region = altlogical_Get_region_default,
+    .Is_sorted = altlogical_Is_sorted_default,
+    .No_NA = altlogical_No_NA_default
+};
+
+static altraw_methods_t altraw_default_methods = {
+    .UnserializeEX = altrep_UnserializeEX_default,
+    .Unserialize = altrep_Unserialize_default,
+    .Serialized_state = altrep_Serialized_state_default,
+    .DuplicateEX = altrep_DuplicateEX_default,
+    .Duplicate = altrep_Duplicate_default,
+    .Coerce = altrep_Coerce_default,
+    .Inspect = altrep_Inspect_default,
+    .Length = altrep_Length_default,
+    .Dataptr = altvec_Dataptr_default,
+    .Dataptr_or_null = altvec_Dataptr_or_null_default,
+    .Extract_subset = altvec_Extract_subset_default,
+    .Elt = altraw_Elt_default,
+    .Get_region = altraw_Get_region_default
+};
+
+static altcomplex_methods_t altcomplex_default_methods = {
+    .UnserializeEX = altrep_UnserializeEX_default,
+    .Unserialize = altrep_Unserialize_default,
+    .Serialized_state = altrep_Serialized_state_default,
+    .DuplicateEX = altrep_DuplicateEX_default,
+    .Duplicate = altrep_Duplicate_default,
+    .Coerce = altrep_Coerce_default,
+    .Inspect = altrep_Inspect_default,
+    .Length = altrep_Length_default,
+    .Dataptr = altvec_Dataptr_default,
+    .Dataptr_or_null = altvec_Dataptr_or_null_default,
+    .Extract_subset = altvec_Extract_subset_default,
+    .Elt = altcomplex_Elt_default,
+    .Get_region = altcomplex_Get_region_default
+};
 
 static altstring_methods_t altstring_default_methods = {
     .UnserializeEX = altrep_UnserializeEX_default,
@@ -744,6 +914,9 @@ make_altrep_class(int type, const char *cname, const char *pname, DllInfo *dll)
     case INTSXP:  MAKE_CLASS(class, altinteger); break;
     case REALSXP: MAKE_CLASS(class, altreal);    break;
     case STRSXP:  MAKE_CLASS(class, altstring);  break;
+    case LGLSXP:  MAKE_CLASS(class, altlogical); break;
+    case RAWSXP:  MAKE_CLASS(class, altraw);     break;
+    case CPLXSXP: MAKE_CLASS(class, altcomplex); break;
     default: error("unsupported ALTREP class");
     }
     RegisterClass(class, type, cname, pname, dll);
@@ -764,6 +937,9 @@ make_altrep_class(int type, const char *cname, const char *pname, DllInfo *dll)
 DEFINE_CLASS_CONSTRUCTOR(altstring, STRSXP)
 DEFINE_CLASS_CONSTRUCTOR(altinteger, INTSXP)
 DEFINE_CLASS_CONSTRUCTOR(altreal, REALSXP)
+DEFINE_CLASS_CONSTRUCTOR(altlogical, LGLSXP)
+DEFINE_CLASS_CONSTRUCTOR(altraw, RAWSXP)
+DEFINE_CLASS_CONSTRUCTOR(altcomplex, CPLXSXP)
 
 static void reinit_altrep_class(SEXP class)
 {
@@ -771,6 +947,9 @@ static void reinit_altrep_class(SEXP class)
     case INTSXP: INIT_CLASS(class, altinteger); break;
     case REALSXP: INIT_CLASS(class, altreal); break;
     case STRSXP: INIT_CLASS(class, altstring); break;
+    case LGLSXP: INIT_CLASS(class, altlogical); break;
+    case RAWSXP: INIT_CLASS(class, altraw); break;
+    case CPLXSXP: INIT_CLASS(class, altcomplex); break;
     default: error("unsupported ALTREP class");
     }
 }
@@ -817,6 +996,17 @@ DEFINE_METHOD_SETTER(altreal, Sum)
 DEFINE_METHOD_SETTER(altreal, Min)
 DEFINE_METHOD_SETTER(altreal, Max)
 
+DEFINE_METHOD_SETTER(altlogical, Elt)
+DEFINE_METHOD_SETTER(altlogical, Get_region)
+DEFINE_METHOD_SETTER(altlogical, Is_sorted)
+DEFINE_METHOD_SETTER(altlogical, No_NA)
+
+DEFINE_METHOD_SETTER(altraw, Elt)
+DEFINE_METHOD_SETTER(altraw, Get_region)
+
+DEFINE_METHOD_SETTER(altcomplex, Elt)
+DEFINE_METHOD_SETTER(altcomplex, Get_region)
+
 DEFINE_METHOD_SETTER(altstring, Elt)
 DEFINE_METHOD_SETTER(altstring, Set_elt)
 DEFINE_METHOD_SETTER(altstring, Is_sorted)
@@ -1387,135 +1577,805 @@ SEXP attribute_hidden R_compact_intrange(R_xlen_t n1, R_xlen_t n2)
 
 
 /**
- ** Deferred String Coercions
+ ** Compact Constant and Run Length Encoded Vectors
  **/
 
 /*
  * Methods
  */
 
-#define DEFERRED_STRING_STATE(x) R_altrep_data1(x)
-#define	CLEAR_DEFERRED_STRING_STATE(x) R_set_altrep_data1(x, R_NilValue)
-#define DEFERRED_STRING_EXPANDED(x) R_altrep_data2(x)
-#define SET_DEFERRED_STRING_EXPANDED(x, v) R_set_altrep_data2(x, v)
+/* The state is a pair of the run values and the run extents.  The
+   extents are either a single length shared by all runs, as for
+   constant vectors and rep(x, each = k), or the cumulative ends of
+   the runs.  Runs are never empty.  As for compact sequences the
+   vectors are marked as not mutable, but C code could write into the
+   expanded data, so the shortcuts are only used while the vector has
+   not been expanded. */
 
-#define MAKE_DEFERRED_STRING_STATE(v, sp) CONS(v, sp)
-#define DEFERRED_STRING_STATE_ARG(s) CAR(s)
-#define DEFERRED_STRING_STATE_SCIPEN(s) CDR(s)
+#define COMPACT_RLE_INFO(x) R_altrep_data1(x)
+#define COMPACT_RLE_EXPANDED(x) R_altrep_data2(x)
+#define SET_COMPACT_RLE_EXPANDED(x, v) R_set_altrep_data2(x, v)
 
-#define DEFERRED_STRING_ARG(x) \
-    DEFERRED_STRING_STATE_ARG(DEFERRED_STRING_STATE(x))
-#define DEFERRED_STRING_SCIPEN(x) \
-    DEFERRED_STRING_STATE_SCIPEN(DEFERRED_STRING_STATE(x))
+#define COMPACT_RLE_INFO_VALUES(info) CAR(info)
+#define COMPACT_RLE_INFO_ENDS(info) CDR(info)
 
-static SEXP deferred_string_Serialized_state(SEXP x)
+static R_INLINE R_xlen_t compact_rle_nruns(SEXP info)
 {
-    /* This drops through to standard serialization for fully expanded
-       deferred string conversions. Partial expansions are OK since
-       they still correspond to the original data. An assignment to
-       the object will access the DATAPTR and force a full expansion
-       and dropping the original data. */
-    SEXP state = DEFERRED_STRING_STATE(x);
-    return state != R_NilValue ? state : NULL;
+    return XLENGTH(COMPACT_RLE_INFO_VALUES(info));
 }
 
-static SEXP deferred_string_Unserialize(SEXP class, SEXP state)
+/* the index one past the end of run j */
+static R_INLINE R_xlen_t compact_rle_run_end(SEXP info, R_xlen_t j)
 {
-    SEXP arg = DEFERRED_STRING_STATE_ARG(state);
-    SEXP sp = DEFERRED_STRING_STATE_SCIPEN(state);
-    return R_deferred_coerceToString(arg, sp);
+    SEXP ends = COMPACT_RLE_INFO_ENDS(info);
+    if (XLENGTH(ends) == 1)
+	return (j + 1) * (R_xlen_t) REAL0(ends)[0];
+    else
+	return (R_xlen_t) REAL0(ends)[j];
 }
 
-static
-Rboolean deferred_string_Inspect(SEXP x, int pre, int deep, int pvec,
-				 void (*inspect_subtree)(SEXP, int, int, int))
+/* the run containing element i */
+static R_INLINE R_xlen_t compact_rle_find_run(SEXP info, R_xlen_t i)
 {
-    SEXP state = DEFERRED_STRING_STATE(x);
-    if (state != R_NilValue) {
-	SEXP arg = DEFERRED_STRING_STATE_ARG(state);
-	Rprintf("  <deferred string conversion>\n");
-	inspect_subtree(arg, pre, deep, pvec);
-    }
-    else {
-	Rprintf("  <expanded string conversion>\n");
-	inspect_subtree(DEFERRED_STRING_EXPANDED(x), pre, deep, pvec);
+    SEXP ends = COMPACT_RLE_INFO_ENDS(info);
+    if (XLENGTH(ends) == 1)
+	return i / (R_xlen_t) REAL0(ends)[0];
+
+    double *pe = REAL0(ends);
+    R_xlen_t lo = 0, hi = XLENGTH(ends) - 1;
+    while (lo < hi) {
+	R_xlen_t mid = lo + (hi - lo) / 2;
+	if (pe[mid] > i)
+	    hi = mid;
+	else
+	    lo = mid + 1;
     }
-    return TRUE;
+    return lo;
 }
 
-static R_INLINE R_xlen_t deferred_string_Length(SEXP x)
+static SEXP new_compact_rle(SEXP, SEXP);
+
+static SEXP compact_rle_Serialized_state(SEXP x)
 {
-    SEXP state = DEFERRED_STRING_STATE(x);
-    return state == R_NilValue ?
-	XLENGTH(DEFERRED_STRING_EXPANDED(x)) :
-	XLENGTH(DEFERRED_STRING_STATE_ARG(state));
+    /* This drops through to standard serialization once the data
+       might have been modified through the data pointer. */
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+    return COMPACT_RLE_INFO(x);
 }
 
-static R_INLINE SEXP ExpandDeferredStringElt(SEXP x, R_xlen_t i)
+static SEXP compact_rle_Unserialize(SEXP class, SEXP state)
 {
-    /* make sure the STRSXP for the expanded string is allocated */
-    /* not yet expanded strings are NULL in the STRSXP */
-    SEXP val = DEFERRED_STRING_EXPANDED(x);
-    if (val == R_NilValue) {
-	R_xlen_t n = XLENGTH(x);
-	val = allocVector(STRSXP, n);
-	memset(STDVEC_DATAPTR(val), 0, n * sizeof(SEXP));
-	SET_DEFERRED_STRING_EXPANDED(x, val);
-    }
+    return new_compact_rle(COMPACT_RLE_INFO_VALUES(state),
+			   COMPACT_RLE_INFO_ENDS(state));
+}
 
-    SEXP elt = STRING_ELT(val, i);
-    if (elt == NULL) {
-	int warn; /* not used by the coercion functions */
-	int savedigits, savescipen;
-	SEXP data = DEFERRED_STRING_ARG(x);
-	switch(TYPEOF(data)) {
-	case INTSXP:
-	    elt = StringFromInteger(INTEGER_ELT(data, i), &warn);
-	    break;
-	case REALSXP:
-	    savedigits = R_print.digits;
-	    savescipen = R_print.scipen;
-	    R_print.digits = DBL_DIG;/* MAX precision */
-	    R_print.scipen = INTEGER0(DEFERRED_STRING_SCIPEN(x))[0];
-	    elt = StringFromReal(REAL_ELT(data, i), &warn);
-	    R_print.digits = savedigits;
-	    R_print.scipen = savescipen;
-	    break;
-	default:
-	    error("unsupported type for deferred string coercion");
-	}
-	SET_STRING_ELT(val, i, elt);
+static SEXP compact_rle_Coerce(SEXP x, int type)
+{
+    /* Only the run values need to be converted. */
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue || ATTRIB(x) != R_NilValue)
+	return NULL;
+    switch(type) {
+    case INTSXP:
+    case REALSXP:
+    case LGLSXP:
+	break;
+    default:
+	return NULL;
     }
-    return elt;
+    SEXP info = COMPACT_RLE_INFO(x);
+    SEXP values = PROTECT(coerceVector(COMPACT_RLE_INFO_VALUES(info), type));
+    SEXP ans = new_compact_rle(values, COMPACT_RLE_INFO_ENDS(info));
+    UNPROTECT(1); /* values */
+    return ans;
 }
 
-static R_INLINE void expand_deferred_string(SEXP x)
+static void compact_rle_get_region(SEXP x, R_xlen_t i, R_xlen_t n, void *buf)
 {
-    SEXP state = DEFERRED_STRING_STATE(x);
-    if (state != R_NilValue) {
-	/* expanded data may be incomplete until original data is removed */
-	PROTECT(x);
-	R_xlen_t n = XLENGTH(x), i;
-	if (n == 0)
-	    SET_DEFERRED_STRING_EXPANDED(x, allocVector(STRSXP, 0));
-	else
-	    for (i = 0; i < n; i++)
-		ExpandDeferredStringElt(x, i);
-	CLEAR_DEFERRED_STRING_STATE(x); /* allow arg to be reclaimed */
-	UNPROTECT(1);
+    switch(TYPEOF(x)) {
+    case INTSXP: INTEGER_GET_REGION(x, i, n, buf); break;
+    case REALSXP: REAL_GET_REGION(x, i, n, buf); break;
+    case LGLSXP: LOGICAL_GET_REGION(x, i, n, buf); break;
+    default: error("unsupported type for run length encoding");
     }
 }
 
-static void *deferred_string_Dataptr(SEXP x, Rboolean writeable)
+static SEXP compact_rle_Duplicate(SEXP x, Rboolean deep)
 {
-    expand_deferred_string(x);
-    return DATAPTR(DEFERRED_STRING_EXPANDED(x));
+    R_xlen_t n = XLENGTH(x);
+    SEXP val = allocVector(TYPEOF(x), n);
+    compact_rle_get_region(x, 0, n, STDVEC_DATAPTR(val));
+    return val;
 }
 
-static const void *deferred_string_Dataptr_or_null(SEXP x)
-{
-    SEXP state = DEFERRED_STRING_STATE(x);
-    return state != R_NilValue ? NULL : DATAPTR(DEFERRED_STRING_EXPANDED(x));
+static
+Rboolean compact_rle_Inspect(SEXP x, int pre, int deep, int pvec,
+			     void (*inspect_subtree)(SEXP, int, int, int))
+{
+    SEXP info = COMPACT_RLE_INFO(x);
+    const char *state =
+	COMPACT_RLE_EXPANDED(x) == R_NilValue ? "compact" : "expanded";
+    R_xlen_t nruns = compact_rle_nruns(info);
+    if (nruns == 1)
+	Rprintf(" constant (%s)\n", state);
+    else
+	Rprintf(" %lld runs (%s)\n", (long long) nruns, state);
+    inspect_subtree(COMPACT_RLE_INFO_VALUES(info), pre, deep, pvec);
+    return TRUE;
+}
+
+static R_INLINE R_xlen_t compact_rle_Length(SEXP x)
+{
+    SEXP info = COMPACT_RLE_INFO(x);
+    return compact_rle_run_end(info, compact_rle_nruns(info) - 1);
+}
+
+static void *compact_rle_Dataptr(SEXP x, Rboolean writeable)
+{
+    if (COMPACT_RLE_EXPANDED(x) == R_NilValue) {
+	PROTECT(x);
+	SEXP val = compact_rle_Duplicate(x, FALSE);
+	SET_COMPACT_RLE_EXPANDED(x, val);
+	UNPROTECT(1);
+    }
+    return DATAPTR(COMPACT_RLE_EXPANDED(x));
+}
+
+static const void *compact_rle_Dataptr_or_null(SEXP x)
+{
+    SEXP val = COMPACT_RLE_EXPANDED(x);
+    return val == R_NilValue ? NULL : DATAPTR(val);
+}
+
+#define DEFINE_COMPACT_RLE_ELT_METHODS(NAME, ctype, TYPE)		\
+    static ctype compact_##NAME##_Elt(SEXP x, R_xlen_t i)		\
+    {									\
+	SEXP ex = COMPACT_RLE_EXPANDED(x);				\
+	if (ex != R_NilValue)						\
+	    return TYPE##0(ex)[i];					\
+	SEXP info = COMPACT_RLE_INFO(x);				\
+	return TYPE##_ELT(COMPACT_RLE_INFO_VALUES(info),		\
+			  compact_rle_find_run(info, i));		\
+    }									\
+									\
+    static R_xlen_t							\
+    compact_##NAME##_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n,	\
+				ctype *buf)				\
+    {									\
+	/* should not get here if x is already expanded */		\
+	CHECK_NOT_EXPANDED(sx);						\
+									\
+	SEXP info = COMPACT_RLE_INFO(sx);				\
+	SEXP values = COMPACT_RLE_INFO_VALUES(info);			\
+	R_xlen_t size = compact_rle_Length(sx);				\
+	R_xlen_t ncopy = size - i > n ? n : size - i;			\
+	R_xlen_t k = 0;							\
+	for (R_xlen_t j = compact_rle_find_run(info, i); k < ncopy; j++) { \
+	    R_xlen_t end = compact_rle_run_end(info, j) - i;		\
+	    ctype v = TYPE##_ELT(values, j);				\
+	    if (end > ncopy) end = ncopy;				\
+	    while (k < end)						\
+		buf[k++] = v;						\
+	}								\
+	return ncopy;							\
+    }
+
+DEFINE_COMPACT_RLE_ELT_METHODS(intrle, int, INTEGER)
+DEFINE_COMPACT_RLE_ELT_METHODS(realrle, double, REAL)
+DEFINE_COMPACT_RLE_ELT_METHODS(lglrle, int, LOGICAL)
+
+static int compact_rle_No_NA(SEXP x)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return FALSE;
+
+    SEXP values = COMPACT_RLE_INFO_VALUES(COMPACT_RLE_INFO(x));
+    R_xlen_t nruns = XLENGTH(values);
+    switch(TYPEOF(values)) {
+    case INTSXP:
+	if (INTEGER_NO_NA(values)) return TRUE;
+	for (R_xlen_t j = 0; j < nruns; j++)
+	    if (INTEGER_ELT(values, j) == NA_INTEGER) return FALSE;
+	return TRUE;
+    case LGLSXP:
+	if (LOGICAL_NO_NA(values)) return TRUE;
+	for (R_xlen_t j = 0; j < nruns; j++)
+	    if (LOGICAL_ELT(values, j) == NA_LOGICAL) return FALSE;
+	return TRUE;
+    case REALSXP:
+	if (REAL_NO_NA(values)) return TRUE;
+	for (R_xlen_t j = 0; j < nruns; j++)
+	    if (ISNAN(REAL_ELT(values, j))) return FALSE;
+	return TRUE;
+    default:
+	return FALSE;
+    }
+}
+
+static int compact_rle_Is_sorted(SEXP x)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return UNKNOWN_SORTEDNESS;
+
+    /* Repeating the values keeps their order. */
+    SEXP values = COMPACT_RLE_INFO_VALUES(COMPACT_RLE_INFO(x));
+    if (XLENGTH(values) == 1)
+	return compact_rle_No_NA(x) ? SORTED_INCR : UNKNOWN_SORTEDNESS;
+    switch(TYPEOF(values)) {
+    case INTSXP: return INTEGER_IS_SORTED(values);
+    case REALSXP: return REAL_IS_SORTED(values);
+    case LGLSXP: return LOGICAL_IS_SORTED(values);
+    default: return UNKNOWN_SORTEDNESS;
+    }
+}
+
+static SEXP compact_intrle_Sum(SEXP x, Rboolean narm)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+
+    SEXP info = COMPACT_RLE_INFO(x);
+    SEXP values = COMPACT_RLE_INFO_VALUES(info);
+    R_xlen_t nruns = XLENGTH(values), start = 0;
+    LDOUBLE s = 0.0;
+    for (R_xlen_t j = 0; j < nruns; j++) {
+	R_xlen_t end = compact_rle_run_end(info, j);
+	int v = INTEGER_ELT(values, j);
+	if (v != NA_INTEGER)
+	    s += (LDOUBLE) v * (end - start);
+	else if (!narm)
+	    return ScalarInteger(NA_INTEGER);
+	start = end;
+    }
+    /* as in the default code sums outside the integer range are double */
+    if (s > INT_MAX || s < R_INT_MIN)
+	return ScalarReal((double) s);
+    return ScalarInteger((int) s);
+}
+
+static SEXP compact_realrle_Sum(SEXP x, Rboolean narm)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+
+    SEXP info = COMPACT_RLE_INFO(x);
+    SEXP values = COMPACT_RLE_INFO_VALUES(info);
+    R_xlen_t nruns = XLENGTH(values), start = 0;
+    LDOUBLE s = 0.0;
+    for (R_xlen_t j = 0; j < nruns; j++) {
+	R_xlen_t end = compact_rle_run_end(info, j);
+	double v = REAL_ELT(values, j);
+	if (!narm || !ISNAN(v))
+	    s += (LDOUBLE) v * (end - start);
+	start = end;
+    }
+    if (s > DBL_MAX) return ScalarReal(R_PosInf);
+    else if (s < -DBL_MAX) return ScalarReal(R_NegInf);
+    else return ScalarReal((double) s);
+}
+
+/* The extremes only depend on the run values.  The cases that signal
+   a warning, all values missing with na.rm = TRUE, are left to the
+   default code. */
+static SEXP compact_intrle_range(SEXP x, Rboolean narm, Rboolean min)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+
+    SEXP values = COMPACT_RLE_INFO_VALUES(COMPACT_RLE_INFO(x));
+    R_xlen_t nruns = XLENGTH(values);
+    Rboolean updated = FALSE;
+    int s = 0;
+    for (R_xlen_t j = 0; j < nruns; j++) {
+	int v = INTEGER_ELT(values, j);
+	if (v != NA_INTEGER) {
+	    if (!updated || (min ? v < s : v > s)) {
+		s = v;
+		updated = TRUE;
+	    }
+	}
+	else if (!narm)
+	    return ScalarInteger(NA_INTEGER);
+    }
+    return updated ? ScalarInteger(s) : NULL;
+}
+
+static SEXP compact_realrle_range(SEXP x, Rboolean narm, Rboolean min)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+
+    SEXP values = COMPACT_RLE_INFO_VALUES(COMPACT_RLE_INFO(x));
+    R_xlen_t nruns = XLENGTH(values);
+    Rboolean updated = FALSE;
+    double s = 0.0;
+    for (R_xlen_t j = 0; j < nruns; j++) {
+	double v = REAL_ELT(values, j);
+	if (ISNAN(v)) {
+	    if (!narm) {
+		if (!ISNA(s)) s = v; /* so any NA trumps all NaNs */
+		updated = TRUE;
+	    }
+	}
+	else if (!updated || (min ? v < s : v > s)) {
+	    s = v;
+	    updated = TRUE;
+	}
+    }
+    return updated ? ScalarReal(s) : NULL;
+}
+
+static SEXP compact_intrle_Min(SEXP x, Rboolean narm)
+{
+    return compact_intrle_range(x, narm, TRUE);
+}
+
+static SEXP compact_intrle_Max(SEXP x, Rboolean narm)
+{
+    return compact_intrle_range(x, narm, FALSE);
+}
+
+static SEXP compact_realrle_Min(SEXP x, Rboolean narm)
+{
+    return compact_realrle_range(x, narm, TRUE);
+}
+
+static SEXP compact_realrle_Max(SEXP x, Rboolean narm)
+{
+    return compact_realrle_range(x, narm, FALSE);
+}
+
+/* Returns the zero-based first index if all indices are in range and,
+   if 'contiguous' is true, consecutive; otherwise -1. */
+static R_xlen_t compact_rle_index_start(SEXP indx, R_xlen_t nx,
+					Rboolean contiguous)
+{
+    R_xlen_t first = -1;
+    switch(TYPEOF(indx)) {
+    case INTSXP:
+	ITERATE_BY_REGION(indx, px, i, nbatch, int, INTEGER, {
+		for (R_xlen_t k = 0; k < nbatch; k++) {
+		    int ii = px[k];
+		    if (ii == NA_INTEGER || ii < 1 || ii > nx)
+			return -1;
+		    if (i + k == 0)
+			first = ii - 1;
+		    else if (contiguous && ii - 1 != first + i + k)
+			return -1;
+		}
+	    });
+	return first;
+    case REALSXP:
+	ITERATE_BY_REGION(indx, px, i, nbatch, double, REAL, {
+		for (R_xlen_t k = 0; k < nbatch; k++) {
+		    double di = px[k];
+		    if (!R_FINITE(di) || di < 1 || di >= nx + 1.0)
+			return -1;
+		    R_xlen_t ii = (R_xlen_t) (di - 1);
+		    if (i + k == 0)
+			first = ii;
+		    else if (contiguous && ii != first + i + k)
+			return -1;
+		}
+	    });
+	return first;
+    default:
+	return -1;
+    }
+}
+
+static SEXP compact_rle_Extract_subset(SEXP x, SEXP indx, SEXP call)
+{
+    if (COMPACT_RLE_EXPANDED(x) != R_NilValue)
+	return NULL;
+
+    R_xlen_t n = XLENGTH(indx);
+    if (n < R_COMPACT_REP_MIN_LENGTH)
+	return NULL;
+
+    SEXP info = COMPACT_RLE_INFO(x);
+    SEXP values = COMPACT_RLE_INFO_VALUES(info);
+    R_xlen_t nruns = XLENGTH(values);
+
+    /* Any selection from a constant vector is constant; otherwise
+       only contiguous ranges are kept compact. */
+    R_xlen_t start = compact_rle_index_start(indx, XLENGTH(x), nruns > 1);
+    if (start < 0)
+	return NULL;
+    if (nruns == 1) {
+	SEXP ends = PROTECT(ScalarReal((double) n));
+	SEXP ans = new_compact_rle(values, ends);
+	UNPROTECT(1); /* ends */
+	return ans;
+    }
+
+    R_xlen_t end = start + n;
+    R_xlen_t j0 = compact_rle_find_run(info, start);
+    R_xlen_t j1 = compact_rle_find_run(info, end - 1);
+    R_xlen_t nr = j1 - j0 + 1;
+    SEXP ends = COMPACT_RLE_INFO_ENDS(info);
+    Rboolean uniform = XLENGTH(ends) == 1;
+    R_xlen_t each = (R_xlen_t) REAL0(ends)[0];
+
+    if (uniform && start % each == 0 && end % each == 0)
+	PROTECT(ends = ScalarReal((double) each));
+    else {
+	if (nr > n / 4)
+	    return NULL; /* runs are too short to be worth it */
+	PROTECT(ends = allocVector(REALSXP, nr));
+	for (R_xlen_t k = 0; k < nr; k++) {
+	    R_xlen_t e = compact_rle_run_end(info, j0 + k);
+	    REAL0(ends)[k] = (double) ((e < end ? e : end) - start);
+	}
+    }
+    if (nr < nruns) {
+	PROTECT(values = allocVector(TYPEOF(values), nr));
+	compact_rle_get_region(COMPACT_RLE_INFO_VALUES(info), j0, nr,
+			       STDVEC_DATAPTR(values));
+    }
+    else PROTECT(values);
+
+    SEXP ans = new_compact_rle(values, ends);
+    UNPROTECT(2); /* values, ends */
+    return ans;
+}
+
+
+/*
+ * Class Objects and Method Tables
+ */
+
+static R_altrep_class_t R_compact_intrep_class;
+static R_altrep_class_t R_compact_realrep_class;
+static R_altrep_class_t R_compact_lglrep_class;
+static R_altrep_class_t R_compact_intrle_class;
+static R_altrep_class_t R_compact_realrle_class;
+static R_altrep_class_t R_compact_lglrle_class;
+
+#define SET_COMPACT_RLE_COMMON_METHODS(cls) do {			\
+	R_set_altrep_Unserialize_method(cls, compact_rle_Unserialize); \
+	R_set_altrep_Serialized_state_method(cls,			\
+					     compact_rle_Serialized_state); \
+	R_set_altrep_Duplicate_method(cls, compact_rle_Duplicate);	\
+	R_set_altrep_Coerce_method(cls, compact_rle_Coerce);		\
+	R_set_altrep_Inspect_method(cls, compact_rle_Inspect);		\
+	R_set_altrep_Length_method(cls, compact_rle_Length);		\
+	R_set_altvec_Dataptr_method(cls, compact_rle_Dataptr);		\
+	R_set_altvec_Dataptr_or_null_method(cls,			\
+					    compact_rle_Dataptr_or_null); \
+	R_set_altvec_Extract_subset_method(cls,				\
+					   compact_rle_Extract_subset); \
+    } while (0)
+
+static R_altrep_class_t make_compact_intrle_class(const char *cname)
+{
+    R_altrep_class_t cls = R_make_altinteger_class(cname, "base", NULL);
+    SET_COMPACT_RLE_COMMON_METHODS(cls);
+    R_set_altinteger_Elt_method(cls, compact_intrle_Elt);
+    R_set_altinteger_Get_region_method(cls, compact_intrle_Get_region);
+    R_set_altinteger_Is_sorted_method(cls, compact_rle_Is_sorted);
+    R_set_altinteger_No_NA_method(cls, compact_rle_No_NA);
+    R_set_altinteger_Sum_method(cls, compact_intrle_Sum);
+    R_set_altinteger_Min_method(cls, compact_intrle_Min);
+    R_set_altinteger_Max_method(cls, compact_intrle_Max);
+    return cls;
+}
+
+static R_altrep_class_t make_compact_realrle_class(const char *cname)
+{
+    R_altrep_class_t cls = R_make_altreal_class(cname, "base", NULL);
+    SET_COMPACT_RLE_COMMON_METHODS(cls);
+    R_set_altreal_Elt_method(cls, compact_realrle_Elt);
+    R_set_altreal_Get_region_method(cls, compact_realrle_Get_region);
+    R_set_altreal_Is_sorted_method(cls, compact_rle_Is_sorted);
+    R_set_altreal_No_NA_method(cls, compact_rle_No_NA);
+    R_set_altreal_Sum_method(cls, compact_realrle_Sum);
+    R_set_altreal_Min_method(cls, compact_realrle_Min);
+    R_set_altreal_Max_method(cls, compact_realrle_Max);
+    return cls;
+}
+
+static R_altrep_class_t make_compact_lglrle_class(const char *cname)
+{
+    R_altrep_class_t cls = R_make_altlogical_class(cname, "base", NULL);
+    SET_COMPACT_RLE_COMMON_METHODS(cls);
+    R_set_altlogical_Elt_method(cls, compact_lglrle_Elt);
+    R_set_altlogical_Get_region_method(cls, compact_lglrle_Get_region);
+    R_set_altlogical_Is_sorted_method(cls, compact_rle_Is_sorted);
+    R_set_altlogical_No_NA_method(cls, compact_rle_No_NA);
+    return cls;
+}
+
+/* The constant and the run length encoded classes share their
+   methods; keeping them apart makes constant vectors easy to
+   recognize. */
+static void InitCompactRleClasses()
+{
+    R_compact_intrep_class = make_compact_intrle_class("compact_intrep");
+    R_compact_realrep_class = make_compact_realrle_class("compact_realrep");
+    R_compact_lglrep_class = make_compact_lglrle_class("compact_lglrep");
+    R_compact_intrle_class = make_compact_intrle_class("compact_intrle");
+    R_compact_realrle_class = make_compact_realrle_class("compact_realrle");
+    R_compact_lglrle_class = make_compact_lglrle_class("compact_lglrle");
+}
+
+
+/*
+ * Constructors
+ */
+
+/* 'ends' is either a single run length or the cumulative run ends;
+   both must be protected by the caller. */
+static SEXP new_compact_rle(SEXP values, SEXP ends)
+{
+    R_altrep_class_t cls;
+    Rboolean constant = XLENGTH(values) == 1;
+    switch(TYPEOF(values)) {
+    case INTSXP:
+	cls = constant ? R_compact_intrep_class : R_compact_intrle_class;
+	break;
+    case REALSXP:
+	cls = constant ? R_compact_realrep_class : R_compact_realrle_class;
+	break;
+    case LGLSXP:
+	cls = constant ? R_compact_lglrep_class : R_compact_lglrle_class;
+	break;
+    default:
+	error("run length encoding of type '%s' not supported",
+	      type2char(TYPEOF(values)));
+    }
+
+    /* the values may be shared with other compact vectors */
+    MARK_NOT_MUTABLE(values);
+    SEXP info = PROTECT(CONS(values, ends));
+    SEXP ans = R_new_altrep(cls, info, R_NilValue);
+    MARK_NOT_MUTABLE(ans); /* force duplicate on modify */
+    UNPROTECT(1);
+    return ans;
+}
+
+static R_INLINE Rboolean compact_rep_type_ok(SEXP x)
+{
+    switch(TYPEOF(x)) {
+    case INTSXP:
+    case REALSXP:
+    case LGLSXP:
+	return TRUE;
+    default:
+	return FALSE;
+    }
+}
+
+/* The constructors below return NULL if 'x' is not of a supported
+   type or the result would be too short or too fragmented to be worth
+   representing compactly. */
+
+/* n copies of x[1] */
+SEXP attribute_hidden R_compact_rep(SEXP x, R_xlen_t n)
+{
+    if (! compact_rep_type_ok(x) || n < R_COMPACT_REP_MIN_LENGTH)
+	return NULL;
+
+    PROTECT(x);
+    SEXP val = PROTECT(allocVector(TYPEOF(x), 1));
+    compact_rle_get_region(x, 0, 1, STDVEC_DATAPTR(val));
+    SEXP ends = PROTECT(ScalarReal((double) n));
+    SEXP ans = new_compact_rle(val, ends);
+    UNPROTECT(3); /* x, val, ends */
+    return ans;
+}
+
+/* rep(x, each = each) */
+SEXP attribute_hidden R_compact_rep_each(SEXP x, R_xlen_t each)
+{
+    if (! compact_rep_type_ok(x) || each < 2 ||
+	XLENGTH(x) * (double) each < R_COMPACT_REP_MIN_LENGTH)
+	return NULL;
+    if (XLENGTH(x) == 1)
+	return R_compact_rep(x, each);
+
+    /* the runs get their own copy of the values, without attributes;
+       an unexpanded integer sequence is copied as a new compact one */
+    SEXP values;
+    if (R_altrep_inherits(x, R_compact_intseq_class) &&
+	COMPACT_SEQ_EXPANDED(x) == R_NilValue) {
+	SEXP info = COMPACT_SEQ_INFO(x);
+	values = new_compact_intseq(COMPACT_INTSEQ_INFO_LENGTH(info),
+				    COMPACT_INTSEQ_INFO_FIRST(info),
+				    COMPACT_INTSEQ_INFO_INCR(info));
+    }
+    else {
+	values = shallow_duplicate(x);
+	if (ATTRIB(values) != R_NilValue) {
+	    SET_ATTRIB(values, R_NilValue);
+	    SET_OBJECT(values, 0);
+	}
+    }
+    PROTECT(values);
+    SEXP ends = PROTECT(ScalarReal((double) each));
+    SEXP ans = new_compact_rle(values, ends);
+    UNPROTECT(2); /* values, ends */
+    return ans;
+}
+
+/* rep(x, times = times) for a vector 'times' of the length of 'x'
+   with valid counts, of type integer or double */
+SEXP attribute_hidden R_compact_rep_times(SEXP x, SEXP times)
+{
+    if (! compact_rep_type_ok(x))
+	return NULL;
+
+    R_xlen_t n = XLENGTH(x), nruns = 0;
+    double len = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+	R_xlen_t t = TYPEOF(times) == REALSXP ?
+	    (R_xlen_t) REAL_ELT(times, i) : INTEGER_ELT(times, i);
+	if (t > 0) {
+	    nruns++;
+	    len += t;
+	}
+    }
+    if (len < R_COMPACT_REP_MIN_LENGTH || nruns > len / 4)
+	return NULL;
+
+    /* the runs get their own copy of the values, without attributes */
+    SEXP values, ends;
+    PROTECT(values = allocVector(TYPEOF(x), nruns));
+    PROTECT(ends = allocVector(REALSXP, nruns));
+    double *pe = REAL0(ends);
+    R_xlen_t end = 0;
+    for (R_xlen_t i = 0, j = 0; i < n; i++) {
+	R_xlen_t t = TYPEOF(times) == REALSXP ?
+	    (R_xlen_t) REAL_ELT(times, i) : INTEGER_ELT(times, i);
+	if (t > 0) {
+	    switch(TYPEOF(x)) {
+	    case INTSXP:
+		INTEGER0(values)[j] = INTEGER_ELT(x, i); break;
+	    case REALSXP:
+		REAL0(values)[j] = REAL_ELT(x, i); break;
+	    case LGLSXP:
+		LOGICAL0(values)[j] = LOGICAL_ELT(x, i); break;
+	    }
+	    end += t;
+	    pe[j++] = (double) end;
+	}
+    }
+    SEXP ans = new_compact_rle(values, ends);
+    UNPROTECT(2); /* values, ends */
+    return ans;
+}
+
+
+/**
+ ** Deferred String Coercions
+ **/
+
+/*
+ * Methods
+ */
+
+#define DEFERRED_STRING_STATE(x) R_altrep_data1(x)
+#define	CLEAR_DEFERRED_STRING_STATE(x) R_set_altrep_data1(x, R_NilValue)
+#define DEFERRED_STRING_EXPANDED(x) R_altrep_data2(x)
+#define SET_DEFERRED_STRING_EXPANDED(x, v) R_set_altrep_data2(x, v)
+
+#define MAKE_DEFERRED_STRING_STATE(v, sp) CONS(v, sp)
+#define DEFERRED_STRING_STATE_ARG(s) CAR(s)
+#define DEFERRED_STRING_STATE_SCIPEN(s) CDR(s)
+
+#define DEFERRED_STRING_ARG(x) \
+    DEFERRED_STRING_STATE_ARG(DEFERRED_STRING_STATE(x))
+#define DEFERRED_STRING_SCIPEN(x) \
+    DEFERRED_STRING_STATE_SCIPEN(DEFERRED_STRING_STATE(x))
+
+static SEXP deferred_string_Serialized_state(SEXP x)
+{
+    /* This drops through to standard serialization for fully expanded
+       deferred string conversions. Partial expansions are OK since
+       they still correspond to the original data. An assignment to
+       the object will access the DATAPTR and force a full expansion
+       and dropping the original data. */
+    SEXP state = DEFERRED_STRING_STATE(x);
+    return state != R_NilValue ? state : NULL;
+}
+
+static SEXP deferred_string_Unserialize(SEXP class, SEXP state)
+{
+    SEXP arg = DEFERRED_STRING_STATE_ARG(state);
+    SEXP sp = DEFERRED_STRING_STATE_SCIPEN(state);
+    return R_deferred_coerceToString(arg, sp);
+}
+
+static
+Rboolean deferred_string_Inspect(SEXP x, int pre, int deep, int pvec,
+				 void (*inspect_subtree)(SEXP, int, int, int))
+{
+    SEXP state = DEFERRED_STRING_STATE(x);
+    if (state != R_NilValue) {
+	SEXP arg = DEFERRED_STRING_STATE_ARG(state);
+	Rprintf("  <deferred string conversion>\n");
+	inspect_subtree(arg, pre, deep, pvec);
+    }
+    else {
+	Rprintf("  <expanded string conversion>\n");
+	inspect_subtree(DEFERRED_STRING_EXPANDED(x), pre, deep, pvec);
+    }
+    return TRUE;
+}
+
+static R_INLINE R_xlen_t deferred_string_Length(SEXP x)
+{
+    SEXP state = DEFERRED_STRING_STATE(x);
+    return state == R_NilValue ?
+	XLENGTH(DEFERRED_STRING_EXPANDED(x)) :
+	XLENGTH(DEFERRED_STRING_STATE_ARG(state));
+}
+
+static R_INLINE SEXP ExpandDeferredStringElt(SEXP x, R_xlen_t i)
+{
+    /* make sure the STRSXP for the expanded string is allocated */
+    /* not yet expanded strings are NULL in the STRSXP */
+    SEXP val = DEFERRED_STRING_EXPANDED(x);
+    if (val == R_NilValue) {
+	R_xlen_t n = XLENGTH(x);
+	val = allocVector(STRSXP, n);
+	memset(STDVEC_DATAPTR(val), 0, n * sizeof(SEXP));
+	SET_DEFERRED_STRING_EXPANDED(x, val);
+    }
+
+    SEXP elt = STRING_ELT(val, i);
+    if (elt == NULL) {
+	int warn; /* not used by the coercion functions */
+	int savedigits, savescipen;
+	SEXP data = DEFERRED_STRING_ARG(x);
+	switch(TYPEOF(data)) {
+	case INTSXP:
+	    elt = StringFromInteger(INTEGER_ELT(data, i), &warn);
+	    break;
+	case REALSXP:
+	    savedigits = R_print.digits;
+	    savescipen = R_print.scipen;
+	    R_print.digits = DBL_DIG;/* MAX precision */
+	    R_print.scipen = INTEGER0(DEFERRED_STRING_SCIPEN(x))[0];
+	    elt = StringFromReal(REAL_ELT(data, i), &warn);
+	    R_print.digits = savedigits;
+	    R_print.scipen = savescipen;
+	    break;
+	default:
+	    error("unsupported type for deferred string coercion");
+	}
+	SET_STRING_ELT(val, i, elt);
+    }
+    return elt;
+}
+
+static R_INLINE void expand_deferred_string(SEXP x)
+{
+    SEXP state = DEFERRED_STRING_STATE(x);
+    if (state != R_NilValue) {
+	/* expanded data may be incomplete until original data is removed */
+	PROTECT(x);
+	R_xlen_t n = XLENGTH(x), i;
+	if (n == 0)
+	    SET_DEFERRED_STRING_EXPANDED(x, allocVector(STRSXP, 0));
+	else
+	    for (i = 0; i < n; i++)
+		ExpandDeferredStringElt(x, i);
+	CLEAR_DEFERRED_STRING_STATE(x); /* allow arg to be reclaimed */
+	UNPROTECT(1);
+    }
+}
+
+static void *deferred_string_Dataptr(SEXP x, Rboolean writeable)
+{
+    expand_deferred_string(x);
+    return DATAPTR(DEFERRED_STRING_EXPANDED(x));
+}
+
+static const void *deferred_string_Dataptr_or_null(SEXP x)
+{
+    SEXP state = DEFERRED_STRING_STATE(x);
+    return state != R_NilValue ? NULL : DATAPTR(DEFERRED_STRING_EXPANDED(x));
 }
 
 static SEXP deferred_string_Elt(SEXP x, R_xlen_t i)
@@ -1668,29 +2528,49 @@ SEXP attribute_hidden R_deferred_coerceToString(SEXP v, SEXP sp)
    
        file
        size and length in a REALSXP
-       type, ptrOK, wrtOK, serOK in an INTSXP
+       type, ptrOK, wrtOK, serOK, prvOK, sorted, no_na, mod in an INTSXP
 
    These are used by the methods, and also represent the serialized
-   state object.
+   state object.  The sortedness and NA information is read from a
+   side file when the file is mapped; it is cleared when a writable
+   data pointer is handed out for a writable mapping.  mod records
+   that such a pointer was handed out for a private mapping, which may
+   then no longer match its file.  States serialized before prvOK and
+   the meta data were added have only the first four integers.
  */
 
+#define MMAP_NINFO 8
+
+static size_t mmap_eltsize(int type)
+{
+    switch(type) {
+    case LGLSXP: return sizeof(int);
+    case INTSXP: return sizeof(int);
+    case REALSXP: return sizeof(double);
+    case CPLXSXP: return sizeof(Rcomplex);
+    case RAWSXP: return sizeof(Rbyte);
+    default: error("mmap for %s not supported yet", type2char(type));
+    }
+}
+
 static SEXP make_mmap_state(SEXP file, size_t size, int type,
-			    Rboolean ptrOK, Rboolean wrtOK, Rboolean serOK)
+			    Rboolean ptrOK, Rboolean wrtOK, Rboolean serOK,
+			    Rboolean prvOK, int sorted, int no_na)
 {
     SEXP sizes = PROTECT(allocVector(REALSXP, 2));
     double *dsizes = REAL(sizes);
     dsizes[0] = size;
-    switch(type) {
-    case INTSXP: dsizes[1] = size / sizeof(int); break;
-    case REALSXP: dsizes[1] = size / sizeof(double); break;
-    default: error("mmap for %s not supported yet", type2char(type));
-    }
+    dsizes[1] = size / mmap_eltsize(type);
 
-    SEXP info = PROTECT(allocVector(INTSXP, 4));
+    SEXP info = PROTECT(allocVector(INTSXP, MMAP_NINFO));
     INTEGER(info)[0] = type;
     INTEGER(info)[1] = ptrOK;
     INTEGER(info)[2] = wrtOK;
     INTEGER(info)[3] = serOK;
+    INTEGER(info)[4] = prvOK;
+    INTEGER(info)[5] = sorted;
+    INTEGER(info)[6] = no_na;
+    INTEGER(info)[7] = FALSE;
 
     SEXP state = list3(file, sizes, info);
 
@@ -1705,6 +2585,11 @@ static SEXP make_mmap_state(SEXP file, size_t size, int type,
 #define MMAP_STATE_PTROK(x) INTEGER(CADDR(x))[1]
 #define MMAP_STATE_WRTOK(x) INTEGER(CADDR(x))[2]
 #define MMAP_STATE_SEROK(x) INTEGER(CADDR(x))[3]
+#define MMAP_STATE_PRVOK(x) \
+    (LENGTH(CADDR(x)) < 5 ? FALSE : INTEGER(CADDR(x))[4])
+#define MMAP_STATE_SORTED(x) INTEGER(CADDR(x))[5]
+#define MMAP_STATE_NO_NA(x) INTEGER(CADDR(x))[6]
+#define MMAP_STATE_MOD(x) INTEGER(CADDR(x))[7]
 
 
 /*
@@ -1713,6 +2598,9 @@ static SEXP make_mmap_state(SEXP file, size_t size, int type,
 
 static R_altrep_class_t mmap_integer_class;
 static R_altrep_class_t mmap_real_class;
+static R_altrep_class_t mmap_logical_class;
+static R_altrep_class_t mmap_raw_class;
+static R_altrep_class_t mmap_complex_class;
 
 /* MMAP objects are ALTREP objects with data fields
 
@@ -1725,10 +2613,11 @@ static R_altrep_class_t mmap_real_class;
 
 static void register_mmap_eptr(SEXP eptr);
 static SEXP make_mmap(void *p, SEXP file, size_t size, int type,
-		      Rboolean ptrOK, Rboolean wrtOK, Rboolean serOK)
+		      Rboolean ptrOK, Rboolean wrtOK, Rboolean serOK,
+		      Rboolean prvOK, int sorted, int no_na)
 {
-    SEXP state = PROTECT(make_mmap_state(file, size,
-					 type, ptrOK, wrtOK, serOK));
+    SEXP state = PROTECT(make_mmap_state(file, size, type, ptrOK, wrtOK,
+					 serOK, prvOK, sorted, no_na));
     SEXP eptr = PROTECT(R_MakeExternalPtr(p, R_NilValue, state));
     register_mmap_eptr(eptr);
 
@@ -1740,6 +2629,15 @@ static SEXP make_mmap(void *p, SEXP file, size_t size, int type,
     case REALSXP:
 	class = mmap_real_class;
 	break;
+    case LGLSXP:
+	class = mmap_logical_class;
+	break;
+    case RAWSXP:
+	class = mmap_raw_class;
+	break;
+    case CPLXSXP:
+	class = mmap_complex_class;
+	break;
     default: error("mmap for %s not supported yet", type2char(type));
     }
 
@@ -1751,12 +2649,25 @@ static SEXP make_mmap(void *p, SEXP file, size_t size, int type,
     return ans;
 }
 
+static Rboolean is_mmap(SEXP x)
+{
+    return R_altrep_inherits(x, mmap_integer_class) ||
+	R_altrep_inherits(x, mmap_real_class) ||
+	R_altrep_inherits(x, mmap_logical_class) ||
+	R_altrep_inherits(x, mmap_raw_class) ||
+	R_altrep_inherits(x, mmap_complex_class);
+}
+
 #define MMAP_EPTR(x) R_altrep_data1(x)
 #define MMAP_STATE(x) R_altrep_data2(x)
 #define MMAP_LENGTH(x) MMAP_STATE_LENGTH(MMAP_STATE(x))
 #define MMAP_PTROK(x) MMAP_STATE_PTROK(MMAP_STATE(x))
 #define MMAP_WRTOK(x) MMAP_STATE_WRTOK(MMAP_STATE(x))
 #define MMAP_SEROK(x) MMAP_STATE_SEROK(MMAP_STATE(x))
+#define MMAP_PRVOK(x) MMAP_STATE_PRVOK(MMAP_STATE(x))
+#define MMAP_SORTED(x) MMAP_STATE_SORTED(MMAP_STATE(x))
+#define MMAP_NO_NA(x) MMAP_STATE_NO_NA(MMAP_STATE(x))
+#define MMAP_MOD(x) MMAP_STATE_MOD(MMAP_STATE(x))
 
 #define MMAP_EPTR_STATE(x) R_ExternalPtrProtected(x)
 
@@ -1828,20 +2739,49 @@ static void finalize_mmap_objects()
  * ALTREP Methods
  */
 
+/* Does the memory of a mapping still hold the contents of its file?
+   Used for private mappings, which may have been written to. */
+static Rboolean mmap_matches_file(SEXP x)
+{
+    const void *vmax = vmaxget();
+    SEXP file = MMAP_STATE_FILE(MMAP_STATE(x));
+    const char *efn = R_ExpandFileName(translateChar(STRING_ELT(file, 0)));
+    FILE *fp = R_fopen(efn, "rb");
+    vmaxset(vmax);
+    if (fp == NULL)
+	return FALSE;
+
+    const char *p = MMAP_ADDR(x);
+    size_t size = MMAP_STATE_SIZE(MMAP_STATE(x)), pos = 0, n;
+    char buf[65536];
+    while (pos < size &&
+	   (n = fread(buf, 1, sizeof(buf), fp)) > 0 &&
+	   n <= size - pos && memcmp(buf, p + pos, n) == 0)
+	pos += n;
+    Rboolean same = pos == size && fread(buf, 1, 1, fp) == 0;
+    fclose(fp);
+    return same;
+}
+
 static SEXP mmap_Serialized_state(SEXP x)
 {
     /* If serOK is FALSE then serialize as a regular typed vector. If
        serOK is true, then serialize information to allow the mmap to
        be reconstructed. The original file name is serialized; it will
        be expanded again when unserializing, in a context where the
-       result may be different. */
-    if (MMAP_SEROK(x))
+       result may be different.  A private mapping that has been
+       written to no longer matches its file, so it is serialized by
+       value; this is checked against the file only if a writable
+       pointer to it has been handed out. */
+    if (MMAP_SEROK(x) &&
+	(! MMAP_PRVOK(x) || ! MMAP_MOD(x) || mmap_matches_file(x)))
 	return MMAP_STATE(x);
     else
 	return NULL;
 }
 
-static SEXP mmap_file(SEXP, int, Rboolean, Rboolean, Rboolean, Rboolean);
+static SEXP mmap_file(SEXP, int, Rboolean, Rboolean, Rboolean, Rboolean,
+		      Rboolean);
 
 static SEXP mmap_Unserialize(SEXP class, SEXP state)
 {
@@ -1850,8 +2790,9 @@ static SEXP mmap_Unserialize(SEXP class, SEXP state)
     Rboolean ptrOK = MMAP_STATE_PTROK(state);
     Rboolean wrtOK = MMAP_STATE_WRTOK(state);
     Rboolean serOK = MMAP_STATE_SEROK(state);
+    Rboolean prvOK = MMAP_STATE_PRVOK(state);
 
-    SEXP val = mmap_file(file, type, ptrOK, wrtOK, serOK, TRUE);
+    SEXP val = mmap_file(file, type, ptrOK, wrtOK, serOK, prvOK, TRUE);
     if (val == NULL) {
 	/**** The attempt to memory map failed. Eventually it would be
 	      good to have a mechanism to allow the user to try to
@@ -1869,8 +2810,9 @@ Rboolean mmap_Inspect(SEXP x, int pre, int deep, int pvec,
     Rboolean ptrOK = MMAP_PTROK(x);
     Rboolean wrtOK = MMAP_WRTOK(x);
     Rboolean serOK = MMAP_SEROK(x);
+    Rboolean prvOK = MMAP_PRVOK(x);
     Rprintf(" mmaped %s", type2char(TYPEOF(x)));
-    Rprintf(" [ptr=%d,wrt=%d,ser=%d]\n", ptrOK, wrtOK, serOK);
+    Rprintf(" [ptr=%d,wrt=%d,ser=%d,prv=%d]\n", ptrOK, wrtOK, serOK, prvOK);
     return TRUE;
 }
 
@@ -1884,13 +2826,22 @@ static R_xlen_t mmap_Length(SEXP x)
     return MMAP_LENGTH(x);
 }
 
+static void mmap_clear_meta(SEXP x);
+
 static void *mmap_Dataptr(SEXP x, Rboolean writeable)
 {
     /* get addr first to get error if the object has been unmapped */
     void *addr = MMAP_ADDR(x);
 
-    if (MMAP_PTROK(x))
+    if (MMAP_PTROK(x)) {
+	if (writeable && MMAP_WRTOK(x)) {
+	    /* the data may change from now on */
+	    mmap_clear_meta(x);
+	    if (MMAP_PRVOK(x))
+		MMAP_MOD(x) = TRUE;
+	}
 	return addr;
+    }
     else
 	error("cannot access data pointer for this mmaped vector");
 }
@@ -1900,6 +2851,25 @@ static const void *mmap_Dataptr_or_null(SEXP x)
     return MMAP_PTROK(x) ? MMAP_ADDR(x) : NULL;
 }
 
+static int mmap_Is_sorted(SEXP x)
+{
+    return MMAP_SORTED(x);
+}
+
+static int mmap_No_NA(SEXP x)
+{
+    return MMAP_NO_NA(x);
+}
+
+#define MMAP_GET_REGION(sx, i, n, buf, type) do {		\
+	type *x = MMAP_ADDR(sx);				\
+	R_xlen_t size = XLENGTH(sx);				\
+	R_xlen_t ncopy = size - i > n ? n : size - i;		\
+	if (ncopy > 0)						\
+	    memcpy(buf, x + i, ncopy * sizeof(type));		\
+	return ncopy;						\
+    } while (0)
+
 
 /*
  * ALTINTEGER Methods
@@ -1914,13 +2884,7 @@ static int mmap_integer_Elt(SEXP x, R_xlen_t i)
 static
 R_xlen_t mmap_integer_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, int *buf)
 {
-    int *x = MMAP_ADDR(sx);
-    R_xlen_t size = XLENGTH(sx);
-    R_xlen_t ncopy = size - i > n ? n : size - i;
-    for (R_xlen_t k = 0; k < ncopy; k++)
-	buf[k] = x[k + i];
-    //memcpy(buf, x + i, ncopy * sizeof(int));
-    return ncopy;
+    MMAP_GET_REGION(sx, i, n, buf, int);
 }
 
 
@@ -1937,13 +2901,48 @@ static double mmap_real_Elt(SEXP x, R_xlen_t i)
 static
 R_xlen_t mmap_real_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, double *buf)
 {
-    double *x = MMAP_ADDR(sx);
-    R_xlen_t size = XLENGTH(sx);
-    R_xlen_t ncopy = size - i > n ? n : size - i;
-    for (R_xlen_t k = 0; k < ncopy; k++)
-	buf[k] = x[k + i];
-    //memcpy(buf, x + i, ncopy * sizeof(double));
-    return ncopy;
+    MMAP_GET_REGION(sx, i, n, buf, double);
+}
+
+
+/*
+ * ALTLOGICAL, ALTRAW and ALTCOMPLEX Methods
+ */
+
+static int mmap_logical_Elt(SEXP x, R_xlen_t i)
+{
+    int *p = MMAP_ADDR(x);
+    return p[i];
+}
+
+static
+R_xlen_t mmap_logical_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, int *buf)
+{
+    MMAP_GET_REGION(sx, i, n, buf, int);
+}
+
+static Rbyte mmap_raw_Elt(SEXP x, R_xlen_t i)
+{
+    Rbyte *p = MMAP_ADDR(x);
+    return p[i];
+}
+
+static
+R_xlen_t mmap_raw_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, Rbyte *buf)
+{
+    MMAP_GET_REGION(sx, i, n, buf, Rbyte);
+}
+
+static Rcomplex mmap_complex_Elt(SEXP x, R_xlen_t i)
+{
+    Rcomplex *p = MMAP_ADDR(x);
+    return p[i];
+}
+
+static R_xlen_t
+mmap_complex_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, Rcomplex *buf)
+{
+    MMAP_GET_REGION(sx, i, n, buf, Rcomplex);
 }
 
 
@@ -1957,25 +2956,31 @@ R_xlen_t mmap_real_Get_region(SEXP sx, R_xlen_t i, R_xlen_t n, double *buf)
 # define MMAPPKG "base"
 #endif
 
+#define SET_MMAP_COMMON_METHODS(cls) do {				\
+	/* override ALTREP methods */					\
+	R_set_altrep_Unserialize_method(cls, mmap_Unserialize);		\
+	R_set_altrep_Serialized_state_method(cls, mmap_Serialized_state); \
+	R_set_altrep_Inspect_method(cls, mmap_Inspect);			\
+	R_set_altrep_Length_method(cls, mmap_Length);			\
+									\
+	/* override ALTVEC methods */					\
+	R_set_altvec_Dataptr_method(cls, mmap_Dataptr);			\
+	R_set_altvec_Dataptr_or_null_method(cls, mmap_Dataptr_or_null); \
+    } while (0)
+
 static void InitMmapIntegerClass(DllInfo *dll)
 {
     R_altrep_class_t cls =
 	R_make_altinteger_class("mmap_integer", MMAPPKG, dll);
     mmap_integer_class = cls;
  
-    /* override ALTREP methods */
-    R_set_altrep_Unserialize_method(cls, mmap_Unserialize);
-    R_set_altrep_Serialized_state_method(cls, mmap_Serialized_state);
-    R_set_altrep_Inspect_method(cls, mmap_Inspect);
-    R_set_altrep_Length_method(cls, mmap_Length);
-
-    /* override ALTVEC methods */
-    R_set_altvec_Dataptr_method(cls, mmap_Dataptr);
-    R_set_altvec_Dataptr_or_null_method(cls, mmap_Dataptr_or_null);
+    SET_MMAP_COMMON_METHODS(cls);
 
     /* override ALTINTEGER methods */
     R_set_altinteger_Elt_method(cls, mmap_integer_Elt);
     R_set_altinteger_Get_region_method(cls, mmap_integer_Get_region);
+    R_set_altinteger_Is_sorted_method(cls, mmap_Is_sorted);
+    R_set_altinteger_No_NA_method(cls, mmap_No_NA);
 }
 
 static void InitMmapRealClass(DllInfo *dll)
@@ -1984,19 +2989,119 @@ static void InitMmapRealClass(DllInfo *dll)
 	R_make_altreal_class("mmap_real", MMAPPKG, dll);
     mmap_real_class = cls;
 
-    /* override ALTREP methods */
-    R_set_altrep_Unserialize_method(cls, mmap_Unserialize);
-    R_set_altrep_Serialized_state_method(cls, mmap_Serialized_state);
-    R_set_altrep_Inspect_method(cls, mmap_Inspect);
-    R_set_altrep_Length_method(cls, mmap_Length);
-
-    /* override ALTVEC methods */
-    R_set_altvec_Dataptr_method(cls, mmap_Dataptr);
-    R_set_altvec_Dataptr_or_null_method(cls, mmap_Dataptr_or_null);
+    SET_MMAP_COMMON_METHODS(cls);
 
     /* override ALTREAL methods */
     R_set_altreal_Elt_method(cls, mmap_real_Elt);
     R_set_altreal_Get_region_method(cls, mmap_real_Get_region);
+    R_set_altreal_Is_sorted_method(cls, mmap_Is_sorted);
+    R_set_altreal_No_NA_method(cls, mmap_No_NA);
+}
+
+static void InitMmapLogicalClass(DllInfo *dll)
+{
+    R_altrep_class_t cls =
+	R_make_altlogical_class("mmap_logical", MMAPPKG, dll);
+    mmap_logical_class = cls;
+
+    SET_MMAP_COMMON_METHODS(cls);
+
+    /* override ALTLOGICAL methods */
+    R_set_altlogical_Elt_method(cls, mmap_logical_Elt);
+    R_set_altlogical_Get_region_method(cls, mmap_logical_Get_region);
+    R_set_altlogical_Is_sorted_method(cls, mmap_Is_sorted);
+    R_set_altlogical_No_NA_method(cls, mmap_No_NA);
+}
+
+static void InitMmapRawClass(DllInfo *dll)
+{
+    R_altrep_class_t cls =
+	R_make_altraw_class("mmap_raw", MMAPPKG, dll);
+    mmap_raw_class = cls;
+
+    SET_MMAP_COMMON_METHODS(cls);
+
+    /* override ALTRAW methods */
+    R_set_altraw_Elt_method(cls, mmap_raw_Elt);
+    R_set_altraw_Get_region_method(cls, mmap_raw_Get_region);
+}
+
+static void InitMmapComplexClass(DllInfo *dll)
+{
+    R_altrep_class_t cls =
+	R_make_altcomplex_class("mmap_complex", MMAPPKG, dll);
+    mmap_complex_class = cls;
+
+    SET_MMAP_COMMON_METHODS(cls);
+
+    /* override ALTCOMPLEX methods */
+    R_set_altcomplex_Elt_method(cls, mmap_complex_Elt);
+    R_set_altcomplex_Get_region_method(cls, mmap_complex_Get_region);
+}
+
+
+/*
+ * Meta Data Files
+ */
+
+/* Sortedness and NA information for a mapped file can be kept in a
+   side file with the same name and ".Rmeta" appended, in DCF format
+   with fields Sorted (an integer code as used by Is_sorted methods,
+   or NA) and NoNA (TRUE or FALSE).  The information is not checked
+   against the data, but the fields Size and MTime record the size and
+   modification time of the file when the side file was written, and
+   the side file is ignored unless they still match.  When a writable
+   pointer to a writable mapping is requested the data may change, so
+   the information is dropped from the vector; the side file belongs to
+   the user and is left alone. */
+
+#define MMAP_META_SUFFIX ".Rmeta"
+
+static char *mmap_meta_file(SEXP file)
+{
+    const char *efn = R_ExpandFileName(translateChar(STRING_ELT(file, 0)));
+    size_t len = strlen(efn) + strlen(MMAP_META_SUFFIX) + 1;
+    char *mfn = R_alloc(len, sizeof(char));
+    snprintf(mfn, len, "%s%s", efn, MMAP_META_SUFFIX);
+    return mfn;
+}
+
+static void read_mmap_meta(SEXP file, double size, double mtime,
+			   int *sorted, int *no_na)
+{
+    *sorted = UNKNOWN_SORTEDNESS;
+    *no_na = 0;
+
+    const void *vmax = vmaxget();
+    FILE *fp = R_fopen(mmap_meta_file(file), "r");
+    vmaxset(vmax);
+    if (fp == NULL)
+	return;
+
+    char buf[128], val[8];
+    int srt = UNKNOWN_SORTEDNESS, nona = 0;
+    double fsize = -1, ftime = -1;
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+	if (sscanf(buf, "Sorted: %d", &srt) == 1) continue;
+	else if (sscanf(buf, "NoNA: %7s", val) == 1)
+	    nona = strcmp(val, "TRUE") == 0;
+	else if (sscanf(buf, "Size: %lf", &fsize) == 1) continue;
+	else if (sscanf(buf, "MTime: %lf", &ftime) == 1) continue;
+    }
+    fclose(fp);
+
+    /* the file has changed since the side file was written */
+    if (fsize != size || fabs(ftime - mtime) > 1e-6)
+	return;
+    if (KNOWN_SORTED(srt) || srt == KNOWN_UNSORTED)
+	*sorted = srt;
+    *no_na = nona;
+}
+
+static void mmap_clear_meta(SEXP x)
+{
+    MMAP_SORTED(x) = UNKNOWN_SORTEDNESS;
+    MMAP_NO_NA(x) = 0;
 }
 
 
@@ -2011,7 +3116,7 @@ static void mmap_finalize(SEXP eptr)
 }
 
 static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
-		      Rboolean serOK, Rboolean warn)
+		      Rboolean serOK, Rboolean prvOK, Rboolean warn)
 {
     error("mmop objects not supported on Windows yet");
 }
@@ -2025,6 +3130,18 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
 #include <unistd.h>
 #include <sys/mman.h>
 
+/* modification time as reported by file.info() */
+#if defined HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
+# define MMAP_MTIME(sb) \
+    ((double) (sb).st_mtim.tv_sec + 1e-9 * (double) (sb).st_mtim.tv_nsec)
+#elif defined HAVE_STRUCT_STAT_ST_ATIMESPEC_TV_NSEC
+# define MMAP_MTIME(sb) \
+    ((double) (sb).st_mtimespec.tv_sec + \
+     1e-9 * (double) (sb).st_mtimespec.tv_nsec)
+#else
+# define MMAP_MTIME(sb) ((double) (sb).st_mtime)
+#endif
+
 //#define DEBUG_PRINT(x) REprintf(x);
 #define DEBUG_PRINT(x) do { } while (0)
 
@@ -2050,8 +3167,11 @@ static void mmap_finalize(SEXP eptr)
 	else error(str, __VA_ARGS__);			\
     } while (0)
 	    
+/* A private mapping (prvOK) is opened read-only but mapped writable
+   with MAP_PRIVATE: changes are copied on write into memory of this
+   process and never reach the file. */
 static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
-		      Rboolean serOK, Rboolean warn)
+		      Rboolean serOK, Rboolean prvOK, Rboolean warn)
 {
     const char *efn = R_ExpandFileName(translateChar(STRING_ELT(file, 0)));
     struct stat sb;
@@ -2063,18 +3183,27 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
     if (! S_ISREG(sb.st_mode))
 	MMAP_FILE_WARNING_OR_ERROR("%s is not a regular file", efn);
 
-    int oflags = wrtOK ? O_RDWR : O_RDONLY;
+    if (sb.st_size == 0)
+	MMAP_FILE_WARNING_OR_ERROR("%s is empty", efn);
+
+    int oflags = wrtOK && ! prvOK ? O_RDWR : O_RDONLY;
     int fd = open(efn, oflags);
     if (fd == -1)
 	MMAP_FILE_WARNING_OR_ERROR("open: %s", strerror(errno));
 
     int pflags = wrtOK ? PROT_READ | PROT_WRITE : PROT_READ;
-    void *p = mmap(0, sb.st_size, pflags, MAP_SHARED, fd, 0);
+    int mflags = prvOK ? MAP_PRIVATE : MAP_SHARED;
+    void *p = mmap(0, sb.st_size, pflags, mflags, fd, 0);
     close(fd); /* don't care if this fails */
     if (p == MAP_FAILED)
 	MMAP_FILE_WARNING_OR_ERROR("mmap: %s", strerror(errno));
 
-    return make_mmap(p, file, sb.st_size, type, ptrOK, wrtOK, serOK);
+    int sorted, no_na;
+    read_mmap_meta(file, (double) sb.st_size, MMAP_MTIME(sb),
+		   &sorted, &no_na);
+
+    return make_mmap(p, file, sb.st_size, type, ptrOK, wrtOK, serOK, prvOK,
+		     sorted, no_na);
 }
 #endif
 
@@ -2097,6 +3226,7 @@ SEXP attribute_hidden do_mmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
     SEXP sptrOK = CADDR(args);
     SEXP swrtOK = CADDDR(args);
     SEXP sserOK = CADDDR(CDR(args));
+    SEXP sprvOK = length(args) > 5 ? CADDDR(CDDR(args)) : R_NilValue;
 
     int type = REALSXP;
     if (stype != R_NilValue) {
@@ -2106,6 +3236,12 @@ SEXP attribute_hidden do_mmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
 	else if (strcmp(typestr, "integer") == 0 ||
 		 strcmp(typestr, "int") == 0)
 	    type = INTSXP;
+	else if (strcmp(typestr, "logical") == 0)
+	    type = LGLSXP;
+	else if (strcmp(typestr, "raw") == 0)
+	    type = RAWSXP;
+	else if (strcmp(typestr, "complex") == 0)
+	    type = CPLXSXP;
 	else
 	    error("type '%s' is not supported", typestr);
     }    
@@ -2113,11 +3249,16 @@ SEXP attribute_hidden do_mmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
     Rboolean ptrOK = sptrOK == R_NilValue ? TRUE : asLogicalNA(sptrOK, FALSE);
     Rboolean wrtOK = swrtOK == R_NilValue ? FALSE : asLogicalNA(swrtOK, FALSE);
     Rboolean serOK = sserOK == R_NilValue ? FALSE : asLogicalNA(sserOK, FALSE);
+    Rboolean prvOK = sprvOK == R_NilValue ? FALSE : asLogicalNA(sprvOK, FALSE);
 
-    if (TYPEOF(file) != STRSXP || LENGTH(file) != 1 || file == NA_STRING)
-	error("invalud 'file' argument");
+    if (TYPEOF(file) != STRSXP || LENGTH(file) != 1 ||
+	STRING_ELT(file, 0) == NA_STRING)
+	error("invalid 'file' argument");
 
-    return mmap_file(file, type, ptrOK, wrtOK, serOK, FALSE);
+    if (prvOK)
+	wrtOK = TRUE;
+
+    return mmap_file(file, type, ptrOK, wrtOK, serOK, prvOK, FALSE);
 }
 
 #ifdef SIMPLEMMAP
@@ -2131,8 +3272,7 @@ SEXP attribute_hidden do_munmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
     SEXP x = CAR(args);
 
     /**** would be useful to have R_mmap_class virtual class as parent here */
-    if (! (R_altrep_inherits(x, mmap_integer_class) ||
-	   R_altrep_inherits(x, mmap_real_class)))
+    if (! is_mmap(x))
 	error("not a memory-mapped object");
 
     /* using the finalizer is a cheat to avoid yet another #ifdef Windows */
@@ -2153,7 +3293,7 @@ SEXP attribute_hidden do_munmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
  * Wrapper Classes and Objects
  */
 
-#define NMETA 2
+#define NMETA 3
 
 static R_altrep_class_t wrap_integer_class;
 static R_altrep_class_t wrap_real_class;
@@ -2162,13 +3302,21 @@ static R_altrep_class_t wrap_string_class;
 /* Wrapper objects are ALTREP objects designed to hold the attributes
    of a potentially large object and/or meta data for the object. */
 
+/* Wrappers made by hashIndex() also keep the hash table of the data
+   built by match() or duplicated() in unique.c. The meta data and
+   the index are held as CONS(meta, index) in the data2 field; the
+   index is not serialized or duplicated. */
+
 #define WRAPPER_WRAPPED(x) R_altrep_data1(x)
 #define WRAPPER_SET_WRAPPED(x, v) R_set_altrep_data1(x, v)
-#define WRAPPER_METADATA(x) R_altrep_data2(x)
-#define WRAPPER_SET_METADATA(x, v) R_set_altrep_data2(x, v)
+#define WRAPPER_METADATA(x) CAR(R_altrep_data2(x))
+#define WRAPPER_SET_METADATA(x, v) SETCAR(R_altrep_data2(x), v)
+#define WRAPPER_INDEX(x) CDR(R_altrep_data2(x))
+#define WRAPPER_SET_INDEX(x, v) SETCDR(R_altrep_data2(x), v)
 
 #define WRAPPER_SORTED(x) INTEGER(WRAPPER_METADATA(x))[0]
 #define WRAPPER_NO_NA(x) INTEGER(WRAPPER_METADATA(x))[1]
+#define WRAPPER_HASHED(x) INTEGER(WRAPPER_METADATA(x))[2]
 
 
 /*
@@ -2218,7 +3366,11 @@ Rboolean wrapper_Inspect(SEXP x, int pre, int deep, int pvec,
 {
     Rboolean srt = WRAPPER_SORTED(x);
     Rboolean no_na = WRAPPER_NO_NA(x);
-    Rprintf(" wrapper [srt=%d,no_na=%d]\n", srt, no_na);
+    if (WRAPPER_HASHED(x))
+	Rprintf(" wrapper [srt=%d,no_na=%d,index=%d]\n", srt, no_na,
+		WRAPPER_INDEX(x) != R_NilValue);
+    else
+	Rprintf(" wrapper [srt=%d,no_na=%d]\n", srt, no_na);
     inspect_subtree(WRAPPER_WRAPPED(x), pre, deep, pvec);
     return TRUE;
 }
@@ -2235,10 +3387,11 @@ static R_xlen_t wrapper_Length(SEXP x)
 
 static void clear_meta_data(SEXP x)
 {
-    SEXP meta = WRAPPER_METADATA(x);
-    INTEGER(meta)[0] = UNKNOWN_SORTEDNESS;
-    for (int i = 1; i < NMETA; i++)
-	INTEGER(meta)[i] = 0;
+    /* The request for a hash index stays, the index itself is dropped
+       and rebuilt on its next use. */
+    WRAPPER_SORTED(x) = UNKNOWN_SORTEDNESS;
+    WRAPPER_NO_NA(x) = 0;
+    WRAPPER_SET_INDEX(x, R_NilValue);
 }
 
 static void *wrapper_Dataptr(SEXP x, Rboolean writeable)
@@ -2303,6 +3456,28 @@ static int wrapper_integer_no_NA(SEXP x)
 	return INTEGER_NO_NA(WRAPPER_WRAPPED(x));
 }
 
+/* The minimum and maximum of a sorted vector without NAs are at its
+   ends. */
+static SEXP wrapper_integer_range(SEXP x, Rboolean min)
+{
+    R_xlen_t n = XLENGTH(x);
+    int srt = wrapper_integer_Is_sorted(x);
+    if (n == 0 || !KNOWN_SORTED(srt) || !wrapper_integer_no_NA(x))
+	return NULL;
+    R_xlen_t i = KNOWN_INCR(srt) == min ? 0 : n - 1;
+    return ScalarInteger(INTEGER_ELT(WRAPPER_WRAPPED(x), i));
+}
+
+static SEXP wrapper_integer_Min(SEXP x, Rboolean narm)
+{
+    return wrapper_integer_range(x, TRUE);
+}
+
+static SEXP wrapper_integer_Max(SEXP x, Rboolean narm)
+{
+    return wrapper_integer_range(x, FALSE);
+}
+
 
 /*
  * ALTREAL Methods
@@ -2337,6 +3512,31 @@ static int wrapper_real_no_NA(SEXP x)
 	return REAL_NO_NA(WRAPPER_WRAPPED(x));
 }
 
+static SEXP wrapper_real_range(SEXP x, Rboolean min)
+{
+    R_xlen_t n = XLENGTH(x);
+    int srt = wrapper_real_Is_sorted(x);
+    if (n == 0 || !KNOWN_SORTED(srt) || !wrapper_real_no_NA(x))
+	return NULL;
+    R_xlen_t i = KNOWN_INCR(srt) == min ? 0 : n - 1;
+    double val = REAL_ELT(WRAPPER_WRAPPED(x), i);
+    /* min() and max() give the first of equal extremes, which can
+       differ in the sign of a zero at the end */
+    if (i > 0 && val == 0)
+	return NULL;
+    return ScalarReal(val);
+}
+
+static SEXP wrapper_real_Min(SEXP x, Rboolean narm)
+{
+    return wrapper_real_range(x, TRUE);
+}
+
+static SEXP wrapper_real_Max(SEXP x, Rboolean narm)
+{
+    return wrapper_real_range(x, FALSE);
+}
+
 
 /*
  * ALTSTRING Methods
@@ -2347,6 +3547,20 @@ static SEXP wrapper_string_Elt(SEXP x, R_xlen_t i)
     return STRING_ELT(WRAPPER_WRAPPED(x), i);
 }
 
+static void wrapper_string_Set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+    SEXP data = WRAPPER_WRAPPED(x);
+
+    if (MAYBE_SHARED(data)) {
+	PROTECT(x);
+	WRAPPER_SET_WRAPPED(x, shallow_duplicate(data));
+	UNPROTECT(1);
+    }
+
+    clear_meta_data(x);
+    SET_STRING_ELT(WRAPPER_WRAPPED(x), i, v);
+}
+
 static int wrapper_string_Is_sorted(SEXP x)
 {
     if (WRAPPER_SORTED(x) != UNKNOWN_SORTEDNESS)
@@ -2394,6 +3608,8 @@ static void InitWrapIntegerClass(DllInfo *dll)
     R_set_altinteger_Get_region_method(cls, wrapper_integer_Get_region);
     R_set_altinteger_Is_sorted_method(cls, wrapper_integer_Is_sorted);
     R_set_altinteger_No_NA_method(cls, wrapper_integer_no_NA);
+    R_set_altinteger_Min_method(cls, wrapper_integer_Min);
+    R_set_altinteger_Max_method(cls, wrapper_integer_Max);
 }
 
 static void InitWrapRealClass(DllInfo *dll)
@@ -2418,6 +3634,8 @@ static void InitWrapRealClass(DllInfo *dll)
     R_set_altreal_Get_region_method(cls, wrapper_real_Get_region);
     R_set_altreal_Is_sorted_method(cls, wrapper_real_Is_sorted);
     R_set_altreal_No_NA_method(cls, wrapper_real_no_NA);
+    R_set_altreal_Min_method(cls, wrapper_real_Min);
+    R_set_altreal_Max_method(cls, wrapper_real_Max);
 }
 
 static void InitWrapStringClass(DllInfo *dll)
@@ -2439,6 +3657,7 @@ static void InitWrapStringClass(DllInfo *dll)
 
     /* override ALTSTRING methods */
     R_set_altstring_Elt_method(cls, wrapper_string_Elt);
+    R_set_altstring_Set_elt_method(cls, wrapper_string_Set_elt);
     R_set_altstring_Is_sorted_method(cls, wrapper_string_Is_sorted);
     R_set_altstring_No_NA_method(cls, wrapper_string_no_NA);
 }
@@ -2459,7 +3678,17 @@ static SEXP make_wrapper(SEXP x, SEXP meta)
     default: error("unsupported type");
     }
 
-    SEXP ans = R_new_altrep(cls, x, meta);
+    PROTECT(x);
+    if (LENGTH(meta) < NMETA) {
+	/* serialized before the hash index was added */
+	SEXP old = meta;
+	meta = allocVector(INTSXP, NMETA);
+	for (int i = 0; i < NMETA; i++)
+	    INTEGER(meta)[i] = i < LENGTH(old) ? INTEGER(old)[i] : 0;
+    }
+    PROTECT(meta);
+    SEXP ans = R_new_altrep(cls, x, CONS(meta, R_NilValue));
+    UNPROTECT(2); /* x, meta */
 
 #ifndef SWITCH_TO_REFCNT
     if (MAYBE_REFERENCED(x))
@@ -2497,13 +3726,88 @@ SEXP attribute_hidden do_wrap_meta(SEXP call, SEXP op, SEXP args, SEXP env)
     if (no_na < 0 || no_na > 1)
 	error("no_na must be 0 or +1");
 
+    return R_wrap_meta(x, srt, no_na);
+}
+
+/* Wrap x, with no attributes, with the sortedness srt and no_na as
+   meta data; used for subsets of sorted vectors in subset.c. */
+SEXP attribute_hidden R_wrap_meta(SEXP x, int srt, int no_na)
+{
     SEXP meta = allocVector(INTSXP, NMETA);
     INTEGER(meta)[0] = srt;
     INTEGER(meta)[1] = no_na;
+    INTEGER(meta)[2] = 0;
 
     return make_wrapper(x, meta);
 }
 
+static R_INLINE Rboolean is_wrapper(SEXP x)
+{
+    if (ALTREP(x))
+	switch(TYPEOF(x)) {
+	case INTSXP: return R_altrep_inherits(x, wrap_integer_class);
+	case REALSXP: return R_altrep_inherits(x, wrap_real_class);
+	case STRSXP: return R_altrep_inherits(x, wrap_string_class);
+	default: return FALSE;
+	}
+    else return FALSE;
+}
+
+SEXP attribute_hidden do_hashindex(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    SEXP x = CAR(args);
+    switch(TYPEOF(x)) {
+    case INTSXP:
+    case REALSXP:
+    case STRSXP: break;
+    default: return x;
+    }
+
+    /* as for wrap_meta, objects with attributes are left alone */
+    if (ATTRIB(x) != R_NilValue)
+	return x;
+
+    SEXP meta;
+    if (is_wrapper(x)) {
+	if (WRAPPER_HASHED(x))
+	    return x;
+	/* keep the meta data and share the data of the wrapper */
+	meta = duplicate(WRAPPER_METADATA(x));
+	x = WRAPPER_WRAPPED(x);
+#ifndef SWITCH_TO_REFCNT
+	MARK_NOT_MUTABLE(x);
+#endif
+    }
+    else {
+	meta = allocVector(INTSXP, NMETA);
+	INTEGER(meta)[0] = UNKNOWN_SORTEDNESS;
+	INTEGER(meta)[1] = 0;
+    }
+    INTEGER(meta)[2] = 1;
+
+    return make_wrapper(x, meta);
+}
+
+/* The data of x if it was made by hashIndex(), NULL otherwise. */
+SEXP attribute_hidden R_hash_indexed_data(SEXP x)
+{
+    if (is_wrapper(x) && WRAPPER_HASHED(x))
+	return WRAPPER_WRAPPED(x);
+    else
+	return NULL;
+}
+
+SEXP attribute_hidden R_hash_index(SEXP x)
+{
+    return WRAPPER_INDEX(x);
+}
+
+void attribute_hidden R_set_hash_index(SEXP x, SEXP index)
+{
+    WRAPPER_SET_INDEX(x, index);
+}
+
 
 /**
  ** Initialize ALTREP Classes
@@ -2513,9 +3817,13 @@ void attribute_hidden R_init_altrep()
 {
     InitCompactIntegerClass();
     InitCompactRealClass();
+    InitCompactRleClasses();
     InitDefferredStringClass();
     InitMmapIntegerClass(NULL);
     InitMmapRealClass(NULL);
+    InitMmapLogicalClass(NULL);
+    InitMmapRawClass(NULL);
+    InitMmapComplexClass(NULL);
     InitWrapIntegerClass(NULL);
     InitWrapRealClass(NULL);
     InitWrapStringClass(NULL);
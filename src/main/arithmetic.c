@@ -1190,6 +1190,133 @@ static SEXP real_binary(ARITHOP_TYPE code, SEXP s1, SEXP s2)
     return ans;
 }
 
+/* Element-wise kernels for the VECLOOP byte code instruction, which
+   runs simple element-wise for() loops a vector at a time.  Operands
+   are logical, integer or double vectors of length one, which are
+   recycled, or of length at least n; attributes are ignored and the
+   result has length n.  The loop being replaced would warn in the
+   offending iterations, so these kernels do not warn; instead they
+   return NULL on integer overflow or if NaNs are produced, and the
+   caller then runs the loop. */
+
+#define VL_STEP(s, n) (XLENGTH(s) == 1 && (n) > 1 ? 0 : 1)
+
+/* unary minus if s2 is NULL */
+SEXP attribute_hidden
+R_VecLoopArith(ARITHOP_TYPE code, SEXP s1, SEXP s2, R_xlen_t n)
+{
+    R_xlen_t i, d1 = VL_STEP(s1, n), d2 = s2 ? VL_STEP(s2, n) : 0;
+    SEXP ans;
+
+    if (TYPEOF(s1) != REALSXP &&
+	(s2 == NULL || (TYPEOF(s2) != REALSXP &&
+			(code == PLUSOP || code == MINUSOP ||
+			 code == TIMESOP)))) {
+	Rboolean naflag = FALSE;
+	const int *px1 = INTEGER_RO(s1);
+	ans = allocVector(INTSXP, n);
+	int *pa = INTEGER(ans);
+	if (s2 == NULL) {
+	    for (i = 0; i < n; i++) {
+		int x = px1[i * d1];
+		pa[i] = x == NA_INTEGER ? NA_INTEGER : -x;
+	    }
+	    return ans;
+	}
+	const int *px2 = INTEGER_RO(s2);
+	switch (code) {
+	case PLUSOP:
+	    for (i = 0; i < n; i++)
+		pa[i] = R_integer_plus(px1[i * d1], px2[i * d2], &naflag);
+	    break;
+	case MINUSOP:
+	    for (i = 0; i < n; i++)
+		pa[i] = R_integer_minus(px1[i * d1], px2[i * d2], &naflag);
+	    break;
+	default:
+	    for (i = 0; i < n; i++)
+		pa[i] = R_integer_times(px1[i * d1], px2[i * d2], &naflag);
+	}
+	return naflag ? NULL : ans;
+    }
+
+    if (s2 == NULL) {
+	const double *px1 = REAL_RO(s1);
+	ans = allocVector(REALSXP, n);
+	double *pa = REAL(ans);
+	for (i = 0; i < n; i++)
+	    pa[i] = -px1[i * d1];
+	return ans;
+    }
+
+    if (code == POWOP && TYPEOF(s1) != REALSXP && TYPEOF(s2) != REALSXP) {
+	const int *px1 = INTEGER_RO(s1), *px2 = INTEGER_RO(s2);
+	ans = allocVector(REALSXP, n);
+	double *pa = REAL(ans);
+	for (i = 0; i < n; i++) {
+	    int x1 = px1[i * d1], x2 = px2[i * d2];
+	    if (x1 == 1 || x2 == 0)
+		pa[i] = 1.;
+	    else if (x1 == NA_INTEGER || x2 == NA_INTEGER)
+		pa[i] = NA_REAL;
+	    else
+		pa[i] = R_POW((double) x1, (double) x2);
+	}
+	return ans;
+    }
+
+    PROTECT(s1 = coerceVector(s1, REALSXP));
+    PROTECT(s2 = coerceVector(s2, REALSXP));
+    const double *px1 = REAL_RO(s1), *px2 = REAL_RO(s2);
+    ans = allocVector(REALSXP, n);
+    double *pa = REAL(ans);
+    switch (code) {
+    case PLUSOP:
+	for (i = 0; i < n; i++) pa[i] = px1[i * d1] + px2[i * d2];
+	break;
+    case MINUSOP:
+	for (i = 0; i < n; i++) pa[i] = px1[i * d1] - px2[i * d2];
+	break;
+    case TIMESOP:
+	for (i = 0; i < n; i++) pa[i] = px1[i * d1] * px2[i * d2];
+	break;
+    case DIVOP:
+	for (i = 0; i < n; i++) pa[i] = px1[i * d1] / px2[i * d2];
+	break;
+    case POWOP:
+	for (i = 0; i < n; i++) pa[i] = R_POW(px1[i * d1], px2[i * d2]);
+	break;
+    default:
+	UNPROTECT(2);
+	return NULL;
+    }
+    UNPROTECT(2);
+    return ans;
+}
+
+SEXP attribute_hidden
+R_VecLoopMath1(double (*f)(double), SEXP sa, R_xlen_t n)
+{
+    R_xlen_t i, d = VL_STEP(sa, n);
+
+    PROTECT(sa = coerceVector(sa, REALSXP));
+    const double *a = REAL_RO(sa);
+    SEXP sy = allocVector(REALSXP, n);
+    double *y = REAL(sy);
+    UNPROTECT(1);
+    for (i = 0; i < n; i++) {
+	double x = a[i * d]; /* sa is not needed after the last allocation */
+	y[i] = f(x);
+	if (ISNAN(y[i])) {
+	    if (ISNAN(x))
+		y[i] = x;
+	    else
+		return NULL;
+	}
+    }
+    return sy;
+}
+
 
 /* Mathematical Functions of One Argument */
 
@@ -424,6 +424,7 @@ SEXP attribute_hidden do_parentenvgets(SEXP call, SEXP op, SEXP args, SEXP rho)
 	error(_("'parent' is not an environment"));
 
     SET_ENCLOS(env, parent);
+    R_LookupEpoch++; /* invalidates function lookup caches */
 
     return( CAR(args) );
 }
@@ -788,6 +789,15 @@ SEXP attribute_hidden do_makevector(SEXP call, SEXP op, SEXP args, SEXP rho)
     mode = str2type(CHAR(STRING_ELT(s, 0))); /* ASCII */
     if (mode == -1 && streql(CHAR(STRING_ELT(s, 0)), "double"))
 	mode = REALSXP;
+    /* long zero vectors are created as compact constant vectors */
+    if (len >= R_COMPACT_REP_MIN_LENGTH) {
+	switch (mode) {
+	case LGLSXP: return R_compact_rep(ScalarLogical(FALSE), len);
+	case INTSXP: return R_compact_rep(ScalarInteger(0), len);
+	case REALSXP: return R_compact_rep(ScalarReal(0.0), len);
+	default: break;
+	}
+    }
     switch (mode) {
     case LGLSXP:
     case INTSXP:
@@ -2193,6 +2193,8 @@ static Rboolean anyNA(SEXP call, SEXP op, SEXP args, SEXP env)
     }
     case LGLSXP:
     {
+	if(LOGICAL_NO_NA(x))
+	    return FALSE;
 	for (i = 0; i < n; i++)
 	    if (LOGICAL_ELT(x, i) == NA_LOGICAL) return TRUE;
 	break;
@@ -24,128 +24,145 @@
 
 #include <Defn.h>
 #include <Internal.h>
+#include <R_ext/Itermacros.h>
+
+/* The inputs are read in blocks through ITERATE_BY_REGION, so that
+   ALTREP vectors need not be expanded. */
 
 static SEXP cumsum(SEXP x, SEXP s)
 {
     LDOUBLE sum = 0.;
-    double *rx = REAL(x), *rs = REAL(s);
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	sum += rx[i]; /* NA and NaN propagated */
-	rs[i] = (double) sum;
-    }
+    double *rs = REAL(s);
+    ITERATE_BY_REGION(x, rx, i, nbatch, double, REAL, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		sum += rx[k]; /* NA and NaN propagated */
+		rs[i + k] = (double) sum;
+	    }
+	});
     return s;
 }
 
 /* We need to ensure that overflow gives NA here */
 static SEXP icumsum(SEXP x, SEXP s)
 {
-    int *ix = INTEGER(x), *is = INTEGER(s);
+    int *is = INTEGER(s);
     double sum = 0.0;
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	if (ix[i] == NA_INTEGER) break;
-	sum += ix[i];
-	if(sum > INT_MAX || sum < 1 + INT_MIN) { /* INT_MIN is NA_INTEGER */
-	    warning(_("integer overflow in 'cumsum'; use 'cumsum(as.numeric(.))'"));
-	    break;
-	}
-	is[i] = (int) sum;
-    }
+    ITERATE_BY_REGION(x, ix, i, nbatch, int, INTEGER, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if (ix[k] == NA_INTEGER) return s;
+		sum += ix[k];
+		if(sum > INT_MAX || sum < 1 + INT_MIN) { /* INT_MIN is NA_INTEGER */
+		    warning(_("integer overflow in 'cumsum'; use 'cumsum(as.numeric(.))'"));
+		    return s;
+		}
+		is[i + k] = (int) sum;
+	    }
+	});
     return s;
 }
 
 static SEXP ccumsum(SEXP x, SEXP s)
 {
-    Rcomplex sum;
+    Rcomplex sum, *cs = COMPLEX(s);
     sum.r = 0;
     sum.i = 0;
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	sum.r += COMPLEX(x)[i].r;
-	sum.i += COMPLEX(x)[i].i;
-	COMPLEX(s)[i].r = sum.r;
-	COMPLEX(s)[i].i = sum.i;
-    }
+    ITERATE_BY_REGION(x, cx, i, nbatch, Rcomplex, COMPLEX, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		sum.r += cx[k].r;
+		sum.i += cx[k].i;
+		cs[i + k].r = sum.r;
+		cs[i + k].i = sum.i;
+	    }
+	});
     return s;
 }
 
 static SEXP cumprod(SEXP x, SEXP s)
 {
     LDOUBLE prod;
-    double *rx = REAL(x), *rs = REAL(s);
+    double *rs = REAL(s);
     prod = 1.0;
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	prod *= rx[i]; /* NA and NaN propagated */
-	rs[i] = (double) prod;
-    }
+    ITERATE_BY_REGION(x, rx, i, nbatch, double, REAL, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		prod *= rx[k]; /* NA and NaN propagated */
+		rs[i + k] = (double) prod;
+	    }
+	});
     return s;
 }
 
 static SEXP ccumprod(SEXP x, SEXP s)
 {
-    Rcomplex prod, tmp;
+    Rcomplex prod, tmp, *cs = COMPLEX(s);
     prod.r = 1;
     prod.i = 0;
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	tmp.r = prod.r;
-	tmp.i = prod.i;
-	prod.r = COMPLEX(x)[i].r * tmp.r - COMPLEX(x)[i].i * tmp.i;
-	prod.i = COMPLEX(x)[i].r * tmp.i + COMPLEX(x)[i].i * tmp.r;
-	COMPLEX(s)[i].r = prod.r;
-	COMPLEX(s)[i].i = prod.i;
-    }
+    ITERATE_BY_REGION(x, cx, i, nbatch, Rcomplex, COMPLEX, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		tmp.r = prod.r;
+		tmp.i = prod.i;
+		prod.r = cx[k].r * tmp.r - cx[k].i * tmp.i;
+		prod.i = cx[k].r * tmp.i + cx[k].i * tmp.r;
+		cs[i + k].r = prod.r;
+		cs[i + k].i = prod.i;
+	    }
+	});
     return s;
 }
 
 static SEXP cummax(SEXP x, SEXP s)
 {
-    double max, *rx = REAL(x), *rs = REAL(s);
+    double max, *rs = REAL(s);
     max = R_NegInf;
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++) {
-	if(ISNAN(rx[i]) || ISNAN(max))
-	    max = max + rx[i];  /* propagate NA and NaN */
-	else
-	    max = (max > rx[i]) ? max : rx[i];
-	rs[i] = max;
-    }
+    ITERATE_BY_REGION(x, rx, i, nbatch, double, REAL, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if(ISNAN(rx[k]) || ISNAN(max))
+		    max = max + rx[k];  /* propagate NA and NaN */
+		else
+		    max = (max > rx[k]) ? max : rx[k];
+		rs[i + k] = max;
+	    }
+	});
     return s;
 }
 
 static SEXP cummin(SEXP x, SEXP s)
 {
-    double min, *rx = REAL(x), *rs = REAL(s);
+    double min, *rs = REAL(s);
     min = R_PosInf; /* always positive, not NA */
-    for (R_xlen_t i = 0 ; i < XLENGTH(x) ; i++ ) {
-	if (ISNAN(rx[i]) || ISNAN(min))
-	    min = min + rx[i];  /* propagate NA and NaN */
-	else
-	    min = (min < rx[i]) ? min : rx[i];
-	rs[i] = min;
-    }
+    ITERATE_BY_REGION(x, rx, i, nbatch, double, REAL, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if (ISNAN(rx[k]) || ISNAN(min))
+		    min = min + rx[k];  /* propagate NA and NaN */
+		else
+		    min = (min < rx[k]) ? min : rx[k];
+		rs[i + k] = min;
+	    }
+	});
     return s;
 }
 
+/* s is initialized to NA, which is kept from the first NA on */
 static SEXP icummax(SEXP x, SEXP s)
 {
-    int *ix = INTEGER(x);
-    if(ix[0] == NA_INTEGER)
-	return s; // all NA
-    int *is = INTEGER(s), max = ix[0];
-    is[0] = max;
-    for (R_xlen_t i = 1 ; i < XLENGTH(x) ; i++) {
-	if(ix[i] == NA_INTEGER) break;
-	is[i] = max = (max > ix[i]) ? max : ix[i];
-    }
+    int *is = INTEGER(s), max = INT_MIN;
+    ITERATE_BY_REGION(x, ix, i, nbatch, int, INTEGER, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if(ix[k] == NA_INTEGER) return s;
+		is[i + k] = max = (max > ix[k]) ? max : ix[k];
+	    }
+	});
     return s;
 }
 
 static SEXP icummin(SEXP x, SEXP s)
 {
-    int *ix = INTEGER(x), *is = INTEGER(s);
-    int min = ix[0];
-    is[0] = min;
-    for (R_xlen_t i = 1 ; i < XLENGTH(x) ; i++ ) {
-	if(ix[i] == NA_INTEGER) break;
-	is[i] = min = (min < ix[i]) ? min : ix[i];
-    }
+    int *is = INTEGER(s), min = INT_MAX;
+    ITERATE_BY_REGION(x, ix, i, nbatch, int, INTEGER, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if(ix[k] == NA_INTEGER) return s;
+		is[i + k] = min = (min < ix[k]) ? min : ix[k];
+	    }
+	});
     return s;
 }
 
@@ -120,6 +120,7 @@
   if (BINDING_IS_LOCKED(__b__)) \
     error(_("cannot change value of locked binding for '%s'"), \
 	  CHAR(PRINTNAME(TAG(__b__)))); \
+  NOTE_BINDING_CHANGE(CAR(__b__), __val__); \
   if (IS_ACTIVE_BINDING(__b__)) \
     setActiveValue(CAR(__b__), __val__); \
   else \
@@ -132,6 +133,7 @@
   if (BINDING_IS_LOCKED(__sym__)) \
     error(_("cannot change value of locked binding for '%s'"), \
 	  CHAR(PRINTNAME(__sym__))); \
+  NOTE_BINDING_CHANGE(SYMVALUE(__sym__), __val__); \
   if (IS_ACTIVE_BINDING(__sym__)) \
     setActiveValue(SYMVALUE(__sym__), __val__); \
   else \
@@ -149,6 +151,7 @@ static void setActiveValue(SEXP fun, SEXP val)
 
 static SEXP getActiveValue(SEXP fun)
 {
+    R_VolatileLookups++;
     SEXP expr = LCONS(fun, R_NilValue);
     PROTECT(expr);
     expr = eval(expr, R_GlobalEnv);
@@ -253,6 +256,7 @@ static void R_HashSet(int hashcode, SEXP symbol, SEXP table, SEXP value,
 	error(_("cannot add bindings to a locked environment"));
     if (ISNULL(chain))
 	SET_HASHPRI(table, HASHPRI(table) + 1);
+    NOTE_BINDING_CHANGE(R_UnboundValue, value);
     /* Add the value into the chain */
     SET_VECTOR_ELT(table, hashcode, CONS(value, VECTOR_ELT(table, hashcode)));
     SET_TAG(VECTOR_ELT(table, hashcode), symbol);
@@ -381,6 +385,7 @@ static SEXP DeleteItem(SEXP symbol, SEXP lst)
     if (lst != R_NilValue) {
 	SETCDR(lst, DeleteItem(symbol, CDR(lst)));
 	if (TAG(lst) == symbol) {
+	    R_LookupEpoch++;
 	    SETCAR(lst, R_UnboundValue); /* in case binding is cached */
 	    LOCK_BINDING(lst);           /* in case binding is cached */
 	    lst = CDR(lst);
@@ -801,6 +806,7 @@ static SEXP RemoveFromList(SEXP thing, SEXP list, int *found)
     }
     else if (TAG(list) == thing) {
 	*found = 1;
+	R_LookupEpoch++;
 	SETCAR(list, R_UnboundValue); /* in case binding is cached */
 	LOCK_BINDING(list);           /* in case binding is cached */
 	SEXP rest = CDR(list);
@@ -813,6 +819,7 @@ static SEXP RemoveFromList(SEXP thing, SEXP list, int *found)
 	while (next != R_NilValue) {
 	    if (TAG(next) == thing) {
 		*found = 1;
+		R_LookupEpoch++;
 		SETCAR(next, R_UnboundValue); /* in case binding is cached */
 		LOCK_BINDING(next);           /* in case binding is cached */
 		SETCDR(last, CDR(next));
@@ -901,6 +908,7 @@ static SEXP findVarLocInFrame(SEXP rho, SEXP symbol, Rboolean *canCache)
     if(IS_USER_DATABASE(rho)) {
 	R_ObjectTable *table;
 	SEXP val, tmp = R_NilValue;
+	R_VolatileLookups++;
 	table = (R_ObjectTable *) R_ExternalPtrAddr(HASHTAB(rho));
 	/* Better to use exists() here if we don't actually need the value! */
 	val = table->get(CHAR(PRINTNAME(symbol)), canCache, table);
@@ -1012,6 +1020,7 @@ SEXP findVarInFrame3(SEXP rho, SEXP symbol, Rboolean doGet)
 	/* Use the objects function pointer for this symbol. */
 	R_ObjectTable *table;
 	SEXP val = R_UnboundValue;
+	R_VolatileLookups++;
 	table = (R_ObjectTable *) R_ExternalPtrAddr(HASHTAB(rho));
 	if(table->active) {
 	    if(doGet)
@@ -1564,6 +1573,7 @@ void defineVar(SEXP symbol, SEXP value, SEXP rho)
 	    }
 	    if (FRAME_IS_LOCKED(rho))
 		error(_("cannot add bindings to a locked environment"));
+	    NOTE_BINDING_CHANGE(R_UnboundValue, value);
 	    SET_FRAME(rho, CONS(value, FRAME(rho)));
 	    SET_TAG(FRAME(rho), symbol);
 	}
@@ -2445,6 +2455,7 @@ SEXP attribute_hidden do_attach(SEXP call, SEXP op, SEXP args, SEXP env)
 	SET_ENCLOS(t, s);
 	SET_ENCLOS(s, x);
     }
+    R_LookupEpoch++;
 
     if(!isSpecial) { /* Temporary: need to remove the elements identified by objects(CAR(args)) */
 #ifdef USE_GLOBAL_CACHE
@@ -2506,6 +2517,7 @@ SEXP attribute_hidden do_detach(SEXP call, SEXP op, SEXP args, SEXP env)
 
 	SET_ENCLOS(s, R_BaseEnv);
     }
+    R_LookupEpoch++;
 #ifdef USE_GLOBAL_CACHE
     if(!isSpecial) {
 	R_FlushGlobalCacheFromTable(HASHTAB(s));
@@ -3287,6 +3299,7 @@ void R_MakeActiveBinding(SEXP sym, SEXP fun, SEXP env)
     if (TYPEOF(env) != ENVSXP &&
 	TYPEOF((env = simple_as_environment(env))) != ENVSXP)
 	error(_("not an environment"));
+    R_LookupEpoch++;
     if (env == R_BaseEnv || env == R_BaseNamespace) {
 	if (SYMVALUE(sym) != R_UnboundValue && ! IS_ACTIVE_BINDING(sym))
 	    error(_("symbol already has a regular binding"));
@@ -3443,6 +3456,7 @@ SEXP attribute_hidden do_mkUnbound(SEXP call, SEXP op, SEXP args, SEXP rho)
 	error(_("cannot unbind a locked binding"));
     if (R_BindingIsActive(sym, R_BaseEnv))
 	error(_("cannot unbind an active binding"));
+    NOTE_BINDING_CHANGE(SYMVALUE(sym), R_UnboundValue);
     SET_SYMVALUE(sym, R_UnboundValue);
 #ifdef USE_GLOBAL_CACHE
     R_FlushGlobalCache(sym);
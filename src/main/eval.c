@@ -28,10 +28,13 @@
 #include <Internal.h>
 #include <Rinterface.h>
 #include <Fileio.h>
+#include <Rversion.h>
 #include <R_ext/Print.h>
+#include <R_ext/Itermacros.h>
 
 
 static SEXP bcEval(SEXP, SEXP, Rboolean);
+static ptrdiff_t R_findBCInterpreterOffset(RCNTXT *);
 
 /* BC_PROFILING needs to be enabled at build time. It is not enabled
    by default as enabling it disables the more efficient threaded code
@@ -104,6 +107,8 @@ static char **R_Srcfiles;			   /* an array of pointers into the filename buffer
 static size_t R_Srcfile_bufcount;                  /* how big is the array above? */
 static SEXP R_Srcfiles_buffer = NULL;              /* a big RAWSXP to use as a buffer for filenames and pointers to them */
 static int R_Profiling_Error;		   /* record errors here */
+static int R_BC_Profiling = 0;		   /* record byte code offsets */
+static int R_Native_Profiling = 0;	   /* record native call stacks */
 
 #ifdef Win32
 HANDLE MainThread;
@@ -176,6 +181,100 @@ static void lineprof(char* buf, SEXP srcref)
     }
 }
 
+/* Byte code offsets are written as "@offset" after the line location
+   of the same frame, counting the version number at the start of the
+   code as offset 0. */
+static void bcprof(char *buf, RCNTXT *cptr)
+{
+    size_t len;
+    ptrdiff_t offset = R_findBCInterpreterOffset(cptr);
+    if (offset >= 0 && (len = strlen(buf)) < PROFLINEMAX)
+	snprintf(buf+len, PROFBUFSIZ - len, "@%ld ", (long) offset);
+}
+
+/* Native stacks are found with the unwinder that comes with GCC and
+   clang.  Only the frames called by the innermost builtin or foreign
+   function, i.e. those whose frame address is beyond that of its
+   context, are written, innermost first, and the outermost ones that
+   are in R itself (the code calling the native routine) are dropped.
+   Frames are named by dladdr, which gives the nearest exported
+   symbol.  Neither the unwinder nor dladdr is async-signal-safe (nor
+   is the rest of doprof): they may deadlock if the signal interrupts
+   the dynamic loader or an unwind in progress, as the help page of
+   Rprof says. */
+#if defined(HAVE_DLADDR) && defined(__GNUC__) && !defined(Win32)
+# define HAVE_NATIVE_PROFILING
+# include <dlfcn.h>
+# include <unwind.h>
+
+#define PROFNATIVEMAX 64
+
+typedef struct {
+    uintptr_t limit;
+    int started;
+    int n;
+    uintptr_t ip[PROFNATIVEMAX];
+} nativeprof_t;
+
+static void *R_Profiling_Self = NULL; /* base address of R's own code */
+
+static _Unwind_Reason_Code nativeprof_frame(struct _Unwind_Context *ctx,
+					    void *data)
+{
+    nativeprof_t *t = data;
+    int before;
+    uintptr_t ip = _Unwind_GetIPInfo(ctx, &before);
+
+    /* skip the frames of the handler: the interrupted frame is the
+       first one whose instruction pointer is not a return address */
+    if (! t->started) {
+	if (! before)
+	    return _URC_NO_REASON;
+	t->started = 1;
+    }
+    else if (! before)
+	ip--; /* point into the call instruction */
+    if (R_CStackDir * ((intptr_t) t->limit - (intptr_t) _Unwind_GetCFA(ctx))
+	<= 0 || t->n == PROFNATIVEMAX)
+	return _URC_END_OF_STACK;
+    t->ip[t->n++] = ip;
+    return _URC_NO_REASON;
+}
+
+static void nativeprof(char *buf, RCNTXT *cptr)
+{
+    nativeprof_t t;
+    Dl_info info;
+    int n;
+
+    t.limit = (uintptr_t) cptr;
+    t.started = 0;
+    t.n = 0;
+    _Unwind_Backtrace(nativeprof_frame, &t);
+    for (n = t.n; n > 0; n--)
+	if (! dladdr((void *) t.ip[n-1], &info) ||
+	    info.dli_fbase != R_Profiling_Self)
+	    break;
+    for (int i = 0; i < n; i++) {
+	size_t len = strlen(buf);
+	if (len >= PROFLINEMAX)
+	    break;
+	if (! dladdr((void *) t.ip[i], &info))
+	    snprintf(buf+len, PROFBUFSIZ - len, "\"<native:%p>\" ",
+		     (void *) t.ip[i]);
+	else if (info.dli_sname)
+	    snprintf(buf+len, PROFBUFSIZ - len, "\"<native:%.*s>\" ",
+		     PROFITEMMAX, info.dli_sname);
+	else {
+	    const char *lib = strrchr(info.dli_fname, '/');
+	    snprintf(buf+len, PROFBUFSIZ - len, "\"<native:%.*s+0x%lx>\" ",
+		     PROFITEMMAX, lib ? lib + 1 : info.dli_fname,
+		     (unsigned long) (t.ip[i] - (uintptr_t) info.dli_fbase));
+	}
+    }
+}
+#endif
+
 /* FIXME: This should be done wih a proper configure test, also making
    sure that the pthreads library is linked in. LT */
 #ifndef Win32
@@ -221,8 +320,20 @@ static void doprof(int sig)  /* sig is ignored in Windows */
     if (R_GC_Profiling && R_gc_running())
 	strcat(buf, "\"<GC>\" ");
 
+#ifdef HAVE_NATIVE_PROFILING
+    if (R_Native_Profiling) {
+	for (cptr = R_GlobalContext; cptr; cptr = cptr->nextcontext)
+	    if (cptr->callflag & (CTXT_FUNCTION | CTXT_BUILTIN))
+		break;
+	if (cptr && (cptr->callflag & CTXT_BUILTIN))
+	    nativeprof(buf, cptr);
+    }
+#endif
+
     if (R_Line_Profiling)
 	lineprof(buf, R_getCurrentSrcref());
+    if (R_BC_Profiling && R_Srcref == R_InBCInterpreter)
+	bcprof(buf, NULL);
 
     for (cptr = R_GlobalContext; cptr; cptr = cptr->nextcontext) {
 	if ((cptr->callflag & (CTXT_FUNCTION | CTXT_BUILTIN))
@@ -298,6 +409,8 @@ static void doprof(int sig)  /* sig is ignored in Windows */
 		    else
 			lineprof(buf, cptr->srcref);
 		}
+		if (R_BC_Profiling && cptr->srcref == R_InBCInterpreter)
+		    bcprof(buf, cptr);
 	    }
 	}
     }
@@ -369,7 +482,8 @@ static void R_EndProfiling(void)
 
 static void R_InitProfiling(SEXP filename, int append, double dinterval,
 			    int mem_profiling, int gc_profiling,
-			    int line_profiling, int numfiles, int bufsize)
+			    int line_profiling, int numfiles, int bufsize,
+			    int bc_profiling, int native_profiling)
 {
 #ifndef Win32
     struct itimerval itv;
@@ -380,6 +494,12 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
     int interval;
 
     interval = (int)(1e6 * dinterval + 0.5);
+#ifndef HAVE_NATIVE_PROFILING
+    if (native_profiling) {
+	warning(_("native profiling is not supported on this platform"));
+	native_profiling = 0;
+    }
+#endif
     if(R_ProfileOutfile != NULL) R_EndProfiling();
     R_ProfileOutfile = RC_fopen(filename, append ? "a" : "w", TRUE);
     if (R_ProfileOutfile == NULL)
@@ -391,6 +511,10 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
 	fprintf(R_ProfileOutfile, "GC profiling: ");
     if(line_profiling)
 	fprintf(R_ProfileOutfile, "line profiling: ");
+    if(bc_profiling)
+	fprintf(R_ProfileOutfile, "bytecode profiling: ");
+    if(native_profiling)
+	fprintf(R_ProfileOutfile, "native profiling: ");
     fprintf(R_ProfileOutfile, "sample.interval=%d\n", interval);
 
     R_Mem_Profiling=mem_profiling;
@@ -400,6 +524,20 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
     R_Profiling_Error = 0;
     R_Line_Profiling = line_profiling;
     R_GC_Profiling = gc_profiling;
+    R_BC_Profiling = bc_profiling;
+    R_Native_Profiling = native_profiling;
+#ifdef HAVE_NATIVE_PROFILING
+    if (native_profiling) {
+	Dl_info info;
+	nativeprof_t t;
+	R_Profiling_Self = dladdr((void *) doprof, &info) ? info.dli_fbase : NULL;
+	/* the first unwind may need to load the unwinder's data */
+	t.limit = 0;
+	t.started = 1;
+	t.n = 0;
+	_Unwind_Backtrace(nativeprof_frame, &t);
+    }
+#endif
     if (line_profiling) {
 	/* Allocate a big RAW vector to use as a buffer.  The first len1 bytes are an array of pointers
 	   to strings; the actual strings are stored in the second len2 bytes. */
@@ -442,6 +580,7 @@ SEXP do_Rprof(SEXP args)
 {
     SEXP filename;
     int append_mode, mem_profiling, gc_profiling, line_profiling;
+    int bc_profiling, native_profiling;
     double dinterval;
     int numfiles, bufsize;
 
@@ -462,14 +601,17 @@ SEXP do_Rprof(SEXP args)
     numfiles = asInteger(CAR(args));	      args = CDR(args);
     if (numfiles < 0)
 	error(_("invalid '%s' argument"), "numfiles");
-    bufsize = asInteger(CAR(args));
+    bufsize = asInteger(CAR(args));	      args = CDR(args);
     if (bufsize < 0)
 	error(_("invalid '%s' argument"), "bufsize");
+    bc_profiling = asLogical(CAR(args));      args = CDR(args);
+    native_profiling = asLogical(CAR(args));
 
     filename = STRING_ELT(filename, 0);
     if (LENGTH(filename))
 	R_InitProfiling(filename, append_mode, dinterval, mem_profiling,
-			gc_profiling, line_profiling, numfiles, bufsize);
+			gc_profiling, line_profiling, numfiles, bufsize,
+			bc_profiling, native_profiling);
     else
 	R_EndProfiling();
     return R_NilValue;
@@ -917,6 +1059,8 @@ static SEXP R_RepeatSymbol = NULL;
 #define JIT_CACHE_SIZE 1024
 static SEXP JIT_cache = NULL;
 static R_exprhash_t JIT_cache_hashes[JIT_CACHE_SIZE];
+static char *jit_disk_cache_dir = NULL; /* R_JIT_CACHE_DIR */
+static int jit_specialize = 0; /* R_JIT_SPECIALIZE */
 
 /**** allow MIN_JIT_SCORE, or both, to be changed by environment variables? */
 static int MIN_JIT_SCORE = 50;
@@ -984,6 +1128,18 @@ void attribute_hidden R_init_jit_enabled(void)
     R_RepeatSymbol = install("repeat");
 
     R_PreserveObject(JIT_cache = allocVector(VECSXP, JIT_CACHE_SIZE));
+
+    char *dir = getenv("R_JIT_CACHE_DIR");
+    if (dir != NULL && dir[0]) {
+	const char *p = R_ExpandFileName(dir);
+	jit_disk_cache_dir = malloc(strlen(p) + 1);
+	if (jit_disk_cache_dir != NULL)
+	    strcpy(jit_disk_cache_dir, p);
+    }
+
+    char *spec = getenv("R_JIT_SPECIALIZE");
+    if (spec != NULL && atoi(spec) > 0)
+	jit_specialize = atoi(spec);
 }
 
 static int JIT_score(SEXP e)
@@ -1310,6 +1466,257 @@ SEXP attribute_hidden R_cmpfun1(SEXP fun)
     return val;
 }
 
+/* Persistent JIT cache. If R_JIT_CACHE_DIR names a directory, code
+   compiled by the JIT is also saved there and looked up when a
+   function is not found in the in-memory cache, so that new R
+   processes need not compile the same functions again. The in-memory
+   hash depends on addresses of symbols and other objects, so files
+   are keyed by a hash computed from the contents of the body, the R
+   version, the byte code version and the optimization level.
+   Functions with source references or with bodies containing objects
+   other than language objects, symbols and atomic vectors without
+   attributes are not cached on disk. As for the in-memory cache, the
+   compilation environment is recorded as its top level environment
+   and the names of the local variables, and is checked against the
+   function with jit_env_match and jit_expr_match on load. */
+
+static int R_bcVersion; /* forward declaration; defined with the opcodes */
+
+#define HASH(x, h) hash((unsigned char *) &x, sizeof(x), h)
+
+static Rboolean hashexpr_persistent(SEXP e, R_exprhash_t *h)
+{
+    int type = TYPEOF(e);
+    int len;
+    *h = HASH(type, *h);
+
+    switch(type) {
+    case NILSXP:
+	return TRUE;
+    case SYMSXP:
+	*h = hash((unsigned char *) CHAR(PRINTNAME(e)),
+		  LENGTH(PRINTNAME(e)), *h);
+	return TRUE;
+    case LANGSXP:
+    case LISTSXP:
+	for (; e != R_NilValue; e = CDR(e)) {
+	    if (ATTRIB(e) != R_NilValue ||
+		! (TYPEOF(e) == LANGSXP || TYPEOF(e) == LISTSXP) ||
+		! hashexpr_persistent(TAG(e), h) ||
+		! hashexpr_persistent(CAR(e), h))
+		return FALSE;
+	}
+	return TRUE;
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case RAWSXP:
+	if (ATTRIB(e) != R_NilValue)
+	    return FALSE;
+	len = LENGTH(e);
+	*h = HASH(len, *h);
+	*h = hash((unsigned char *) DATAPTR(e),
+		  len * (int) (type == LGLSXP || type == INTSXP ?
+			       sizeof(int) : type == REALSXP ?
+			       sizeof(double) : type == CPLXSXP ?
+			       sizeof(Rcomplex) : 1), *h);
+	return TRUE;
+    case STRSXP:
+	if (ATTRIB(e) != R_NilValue)
+	    return FALSE;
+	len = LENGTH(e);
+	*h = HASH(len, *h);
+	for (int i = 0; i < len; i++) {
+	    SEXP cval = STRING_ELT(e, i);
+	    int na = cval == NA_STRING;
+	    *h = HASH(na, *h);
+	    *h = hash((unsigned char *) CHAR(cval), LENGTH(cval), *h);
+	}
+	return TRUE;
+    default:
+	return FALSE;
+    }
+}
+#undef HASH
+
+/* The top level environment is recorded by name: R_GlobalEnv,
+   R_BaseEnv, or the namespace spec. Returns R_NilValue for other top
+   level environments; code compiled for those is not saved. */
+static SEXP jit_disk_cache_topspec(SEXP top)
+{
+    if (top == R_GlobalEnv)
+	return mkString("R_GlobalEnv");
+    else if (top == R_BaseEnv)
+	return mkString("R_BaseEnv");
+    else if (R_IsNamespaceEnv(top))
+	return R_NamespaceEnvSpec(top);
+    else
+	return R_NilValue;
+}
+
+static int jit_disk_cache_optimize(void)
+{
+    SEXP call, fcall, val;
+    int old_visible = R_Visible;
+
+    PROTECT(fcall = lang3(R_TripleColonSymbol, install("compiler"),
+			  install("getCompilerOption")));
+    PROTECT(call = lang2(fcall, mkString("optimize")));
+    val = eval(call, R_GlobalEnv);
+    UNPROTECT(2);
+    R_Visible = old_visible;
+    return asInteger(val);
+}
+
+/* Sets path to the cache file for fun, which may already be compiled;
+   returns FALSE if fun is not to be cached on disk. */
+static Rboolean jit_disk_cache_file(SEXP fun, char *path, size_t size)
+{
+    R_exprhash_t h = 5381;
+    SEXP body = BODY(fun);
+    if (TYPEOF(body) == BCODESXP)
+	body = bytecodeExpr(body);
+    if (getAttrib(fun, R_SrcrefSymbol) != R_NilValue ||
+	! hashexpr_persistent(body, &h))
+	return FALSE;
+    int n = snprintf(path, size, "%s%s%s.%s-bc%d-O%d-%0*lx.rds",
+		     jit_disk_cache_dir, FILESEP, R_MAJOR, R_MINOR,
+		     R_bcVersion, jit_disk_cache_optimize(),
+		     (int) (2 * sizeof(R_exprhash_t)), h);
+    return n > 0 && (size_t) n < size;
+}
+
+/* Saved entries are lists of the compiled body, the spec of the top
+   level environment and the names of the local variables. */
+typedef struct {
+    FILE *fp;
+    SEXP val;
+    int jit_enabled;
+} jit_disk_cache_io_t;
+
+static SEXP jit_disk_cache_read(void *data)
+{
+    jit_disk_cache_io_t *io = data;
+    struct R_inpstream_st in;
+    R_InitFileInPStream(&in, io->fp, R_pstream_any_format, NULL, R_NilValue);
+    return R_Unserialize(&in);
+}
+
+static SEXP jit_disk_cache_write(void *data)
+{
+    jit_disk_cache_io_t *io = data;
+    struct R_outpstream_st out;
+    R_InitFileOutPStream(&out, io->fp, R_pstream_xdr_format, 3,
+			 NULL, R_NilValue);
+    R_Serialize(io->val, &out);
+    return R_TrueValue;
+}
+
+static SEXP jit_disk_cache_error(SEXP cond, void *data)
+{
+    return R_NilValue;
+}
+
+static void jit_disk_cache_finally(void *data)
+{
+    jit_disk_cache_io_t *io = data;
+    R_jit_enabled = io->jit_enabled;
+}
+
+/* Serialization runs R code (the tryCatch), which must not be
+   compiled by the JIT while the cache is being accessed. */
+static SEXP jit_disk_cache_io(SEXP (*fun)(void *), jit_disk_cache_io_t *io)
+{
+    SEXP cond = PROTECT(mkString("error"));
+    io->jit_enabled = R_jit_enabled;
+    R_jit_enabled = 0;
+    SEXP val = R_tryCatch(fun, io, cond, jit_disk_cache_error, NULL,
+			  jit_disk_cache_finally, io);
+    UNPROTECT(1); /* cond */
+    return val;
+}
+
+static Rboolean jit_disk_cache_load(SEXP fun)
+{
+    char path[PATH_MAX];
+    if (! jit_disk_cache_file(fun, path, sizeof(path)))
+	return FALSE;
+    FILE *fp = R_fopen(path, "rb");
+    if (fp == NULL)
+	return FALSE;
+    jit_disk_cache_io_t io = { fp, R_NilValue, 0 };
+    SEXP entry = jit_disk_cache_io(jit_disk_cache_read, &io);
+    fclose(fp);
+    PROTECT(entry);
+
+    Rboolean ans = FALSE;
+    if (TYPEOF(entry) == VECSXP && LENGTH(entry) == 3 &&
+	R_BCVersionOK(VECTOR_ELT(entry, 0)) &&
+	TYPEOF(VECTOR_ELT(entry, 2)) == STRSXP) {
+	SEXP code = VECTOR_ELT(entry, 0);
+	SEXP top = topenv(R_NilValue, CLOENV(fun));
+	SEXP spec = PROTECT(jit_disk_cache_topspec(top));
+	if (spec != R_NilValue &&
+	    R_compute_identical(spec, VECTOR_ELT(entry, 1), 0)) {
+	    SEXP locals = VECTOR_ELT(entry, 2);
+	    SEXP cmpenv = top;
+	    if (LENGTH(locals) > 0) {
+		cmpenv = NewEnvironment(R_NilValue, R_NilValue, top);
+		PROTECT(cmpenv);
+		for (int i = 0; i < LENGTH(locals); i++)
+		    defineVar(installTrChar(STRING_ELT(locals, i)),
+			      R_NilValue, cmpenv);
+		UNPROTECT(1); /* cmpenv */
+	    }
+	    PROTECT(cmpenv);
+	    if (jit_env_match(cmpenv, fun) &&
+		jit_expr_match(bytecodeExpr(code), BODY(fun))) {
+		SET_BODY(fun, code);
+		ans = TRUE;
+	    }
+	    UNPROTECT(1); /* cmpenv */
+	}
+	UNPROTECT(1); /* spec */
+    }
+    UNPROTECT(1); /* entry */
+    return ans;
+}
+
+static void jit_disk_cache_save(SEXP fun)
+{
+    char path[PATH_MAX];
+    if (! jit_disk_cache_file(fun, path, sizeof(path)))
+	return;
+
+    SEXP cmpenv = PROTECT(make_cached_cmpenv(fun));
+    SEXP top = topenv(R_NilValue, cmpenv);
+    SEXP entry = PROTECT(allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(entry, 0, BODY(fun));
+    SET_VECTOR_ELT(entry, 1, jit_disk_cache_topspec(top));
+    SET_VECTOR_ELT(entry, 2, cmpenv == top ? allocVector(STRSXP, 0) :
+		   R_lsInternal3(cmpenv, TRUE, FALSE));
+    if (VECTOR_ELT(entry, 1) == R_NilValue || ! jit_env_match(cmpenv, fun)) {
+	/* the entry would never be used */
+	UNPROTECT(2); /* entry, cmpenv */
+	return;
+    }
+
+    /* write to a temporary file and rename, so concurrent readers
+       never see a partially written file */
+    char *tmp = R_tmpnam2("jit", jit_disk_cache_dir, ".tmp");
+    FILE *fp = R_fopen(tmp, "wb");
+    if (fp != NULL) {
+	jit_disk_cache_io_t io = { fp, entry, 0 };
+	/* the error handler returns NULL */
+	SEXP ok = jit_disk_cache_io(jit_disk_cache_write, &io);
+	if (fclose(fp) != 0 || ok == R_NilValue || rename(tmp, path) != 0)
+	    remove(tmp);
+    }
+    free(tmp);
+    UNPROTECT(2); /* entry, cmpenv */
+}
+
 /* fun is modified in-place when compiled */
 static void R_cmpfun(SEXP fun)
 {
@@ -1357,6 +1764,11 @@ static void R_cmpfun(SEXP fun)
 	    }
 	}
 	PRINT_JIT_INFO;
+
+	if (jit_disk_cache_dir != NULL && jit_disk_cache_load(fun)) {
+	    set_jit_cache_entry(hash, fun);
+	    return;
+	}
     }
 
     SEXP val = R_cmpfun1(fun);
@@ -1364,12 +1776,170 @@ static void R_cmpfun(SEXP fun)
     if (TYPEOF(BODY(val)) != BCODESXP)
 	SET_NOJIT(fun);
     else {
-	if (jit_strategy != STRATEGY_NO_CACHE)
+	if (jit_strategy != STRATEGY_NO_CACHE) {
 	    set_jit_cache_entry(hash, val); /* val is protected by callee */
+	    if (jit_disk_cache_dir != NULL)
+		jit_disk_cache_save(val);
+	}
 	SET_BODY(fun, BODY(val));
     }
 }
 
+/* Type specialization. If R_JIT_SPECIALIZE is set to a positive
+   number n, the types and lengths of the arguments of compiled
+   closures are recorded when the closures return. After n
+   consecutive calls in which the arguments had the same types and
+   lengths, and some of them were plain logical, integer or double
+   vectors, the closure is compiled again by compiler:::trySpecialize,
+   which may use the recorded types in the code it generates.
+   Specialized code starts with a CHECKARGS guard that runs the
+   generic code if the arguments do not match the recorded ones. If
+   they do not match in more than half of n consecutive calls of the
+   specialized code the generic code is reinstalled for good.
+
+   Profiles are kept in a small table indexed by the address of the
+   body and are overwritten on collisions. The body is not protected
+   and is only compared by address; the code to reinstall is always
+   taken from the specialized body itself (bcSpecializedInfo), so a
+   stale entry can at worst cause a useless specialization. */
+
+#define SPEC_MAX_ARGS 8
+#define SPEC_TABLE_SIZE 256
+
+typedef struct {
+    SEXP body;
+    int count;	/* calls with this signature, or of the specialized code */
+    int fails;	/* calls of the specialized code with other types */
+    Rboolean done;
+    int nargs;
+    int type[SPEC_MAX_ARGS];
+    int length[SPEC_MAX_ARGS];
+} spec_profile_t;
+
+static spec_profile_t spec_table[SPEC_TABLE_SIZE];
+
+/* defined with the opcodes */
+static SEXP bcSpecializedInfo(SEXP);
+static Rboolean bcCheckArgs(SEXP, SEXP);
+
+static spec_profile_t *spec_profile(SEXP body)
+{
+    spec_profile_t *p =
+	&spec_table[((uintptr_t) body / sizeof(SEXPREC)) % SPEC_TABLE_SIZE];
+    if (p->body != body) {
+	memset(p, 0, sizeof(spec_profile_t));
+	p->body = body;
+    }
+    return p;
+}
+
+/* The type of a plain logical, integer or double vector bound to a
+   formal argument, either directly or as the value of a forced
+   promise, and zero for anything else */
+static int spec_arg_type(SEXP v, int *length)
+{
+    if (TYPEOF(v) == PROMSXP)
+	v = PRVALUE(v);
+    *length = 0;
+    switch (TYPEOF(v)) {
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+	if (ATTRIB(v) == R_NilValue && XLENGTH(v) <= INT_MAX) {
+	    *length = (int) XLENGTH(v);
+	    return TYPEOF(v);
+	}
+    }
+    return 0;
+}
+
+static SEXP R_cmpfun_specialize(SEXP fun, int nargs, int *type, int *length)
+{
+    int old_visible = R_Visible;
+    SEXP packsym, funsym, call, fcall, types, lengths, val;
+
+    packsym = install("compiler");
+    funsym = install("trySpecialize");
+
+    PROTECT(types = allocVector(INTSXP, nargs));
+    PROTECT(lengths = allocVector(INTSXP, nargs));
+    for (int i = 0; i < nargs; i++) {
+	INTEGER(types)[i] = type[i];
+	INTEGER(lengths)[i] = length[i];
+    }
+    PROTECT(fcall = lang3(R_TripleColonSymbol, packsym, funsym));
+    PROTECT(call = lang4(fcall, fun, types, lengths));
+    val = eval(call, R_GlobalEnv);
+    UNPROTECT(4);
+
+    R_Visible = old_visible;
+    return val;
+}
+
+/* Called by applyClosure when a compiled closure returns; actuals are
+   the bindings of the formal arguments in the frame newrho. For
+   specialized code, calls in which the forced arguments did not have
+   the recorded types count as failures, whether or not the guard
+   noticed. */
+static void R_jitProfileArgs(SEXP op, SEXP actuals, SEXP newrho)
+{
+    SEXP body = BODY(op);
+    if (TYPEOF(body) != BCODESXP || R_jit_enabled <= 0)
+	return;
+    spec_profile_t *p = spec_profile(body);
+    if (p->done)
+	return;
+
+    SEXP info = bcSpecializedInfo(body);
+    if (info != NULL) {
+	if (! bcCheckArgs(info, newrho))
+	    p->fails++;
+	if (++p->count >= jit_specialize) {
+	    if (2 * p->fails > p->count) {
+		SEXP generic = VECTOR_ELT(info, 3);
+		p->done = TRUE;
+		SET_BODY(op, generic);
+		spec_profile(generic)->done = TRUE;
+	    }
+	    else p->count = p->fails = 0;
+	}
+	return;
+    }
+
+    int nargs = 0, type[SPEC_MAX_ARGS], length[SPEC_MAX_ARGS];
+    Rboolean typed = FALSE;
+    for (SEXP a = actuals; a != R_NilValue; a = CDR(a), nargs++) {
+	if (nargs == SPEC_MAX_ARGS) {
+	    p->done = TRUE;
+	    return;
+	}
+	type[nargs] = spec_arg_type(CAR(a), &length[nargs]);
+	if (type[nargs] != 0)
+	    typed = TRUE;
+    }
+    if (nargs == p->nargs &&
+	memcmp(type, p->type, nargs * sizeof(int)) == 0 &&
+	memcmp(length, p->length, nargs * sizeof(int)) == 0)
+	p->count++;
+    else {
+	p->count = 1;
+	p->nargs = nargs;
+	memcpy(p->type, type, nargs * sizeof(int));
+	memcpy(p->length, length, nargs * sizeof(int));
+    }
+
+    if (typed && p->count >= jit_specialize) {
+	/* the compiler runs R code, which may reuse the entry */
+	p->done = TRUE;
+	int old_enabled = R_jit_enabled;
+	R_jit_enabled = 0;
+	SEXP val = R_cmpfun_specialize(op, nargs, type, length);
+	R_jit_enabled = old_enabled;
+	if (TYPEOF(val) == BCODESXP && BODY(op) == body)
+	    SET_BODY(op, val);
+    }
+}
+
 static SEXP R_compileExpr(SEXP expr, SEXP rho)
 {
     int old_visible = R_Visible;
@@ -1693,6 +2263,12 @@ SEXP applyClosure(SEXP call, SEXP op, SEXP arglist, SEXP rho, SEXP suppliedvars)
 			     (R_GlobalContext->callflag == CTXT_GENERIC) ?
 			     R_GlobalContext->sysparent : rho,
 			     rho, arglist, op);
+    if (jit_specialize > 0) {
+	PROTECT(newrho);
+	PROTECT(val);
+	R_jitProfileArgs(op, actuals, newrho);
+	UNPROTECT(2); /* newrho, val */
+    }
 #ifdef ADJUST_ENVIR_REFCNTS
     R_CleanupEnvir(newrho, val);
     if (MAYBE_REFERENCED(val) && is_getter_call)
@@ -2146,6 +2722,7 @@ static R_INLINE Rboolean SET_BINDING_VALUE(SEXP loc, SEXP value) {
     if (loc != R_NilValue &&
 	! BINDING_IS_LOCKED(loc) && ! IS_ACTIVE_BINDING(loc)) {
 	if (CAR(loc) != value) {
+	    NOTE_BINDING_CHANGE(CAR(loc), value);
 	    SETCAR(loc, value);
 	    if (MISSING(loc))
 		SET_MISSING(loc, 0);
@@ -3683,7 +4260,7 @@ int DispatchGroup(const char* group, SEXP call, SEXP op, SEXP args, SEXP rho,
 }
 
 /* start of bytecode section */
-static int R_bcVersion = 10;
+static int R_bcVersion = 12;
 static int R_bcMinVersion = 9;
 
 static SEXP R_AddSym = NULL;
@@ -3890,6 +4467,17 @@ enum {
   SEQALONG_OP,
   SEQLEN_OP,
   BASEGUARD_OP,
+  GETVAR_CONST_ADD_OP,
+  GETVAR_CONST_SUB_OP,
+  GETVAR_CONST_MUL_OP,
+  GETVAR_CONST_DIV_OP,
+  GETVAR_GETVAR_RELOP_BRIFNOT_OP,
+  GETVAR_CONST_RELOP_BRIFNOT_OP,
+  INCVAR_OP,
+  VECLOOP_OP,
+  CHECKARGS_OP,
+  GETARGELT_OP,
+  CACHEFORMALS_OP,
   OPCOUNT
 };
 
@@ -4395,6 +4983,9 @@ static SEXP cmp_arith2(SEXP call, int opval, SEXP opsym, SEXP x, SEXP y,
     SEXP sb = NULL; \
     int typex = bcStackScalarEx(R_BCNodeStackTop - 2, &vx, &sa);	\
     int typey = bcStackScalarEx(R_BCNodeStackTop - 1, &vy, &sb);	\
+    /* logicals are handled as integers; NA_LOGICAL == NA_INTEGER */ \
+    if (typex == LGLSXP) typex = INTSXP; \
+    if (typey == LGLSXP) typey = INTSXP; \
     if (typex == REALSXP) { \
 	if (typey == REALSXP) \
 	    DO_FAST_BINOP(op, vx.dval, vy.dval, sa ? sa : sb);	\
@@ -4564,6 +5155,25 @@ static R_INLINE double (*getMath1Fun(int i, SEXP call))(double) {
 #include <Rdynpriv.h>
 
 #define DOTCALL_MAX 16
+/* When profiling, foreign calls get a context, as they do in eval(),
+   so that they are recorded in the profile. */
+static SEXP bcDotCall(DL_FUNC ofun, int nargs, SEXP *cargs, SEXP call)
+{
+    if (R_Profiling) {
+	RCNTXT cntxt;
+	SEXP oldref = R_Srcref, val;
+	begincontext(&cntxt, CTXT_BUILTIN, call,
+		     R_BaseEnv, R_BaseEnv, R_NilValue, R_NilValue);
+	R_Srcref = NULL;
+	val = R_doDotCall(ofun, nargs, cargs, call);
+	R_Srcref = oldref;
+	endcontext(&cntxt);
+	return val;
+    }
+    else
+	return R_doDotCall(ofun, nargs, cargs, call);
+}
+
 #define DO_DOTCALL() do {						\
 	SEXP call = VECTOR_ELT(constants, GETOP());			\
 	int nargs = GETOP();						\
@@ -4573,7 +5183,7 @@ static R_INLINE double (*getMath1Fun(int i, SEXP call))(double) {
 	    for (int i = 0; i < nargs; i++)				\
 		cargs[i] = GETSTACK(i - nargs);				\
 	    void *vmax = vmaxget();					\
-	    SEXP val = R_doDotCall(ofun, nargs, cargs, call);		\
+	    SEXP val = bcDotCall(ofun, nargs, cargs, call);		\
 	    vmaxset(vmax);						\
 	    R_BCNodeStackTop -= nargs;					\
 	    SETSTACK(-1, val);						\
@@ -4816,7 +5426,8 @@ static struct { void *addr; int argc; char *instname; } opinfo[OPCOUNT];
 #define LASTOP } retvalue = R_NilValue; goto done
 #define INITIALIZE_MACHINE() if (body == NULL) goto init
 
-#define NEXT() (__extension__ ({currentpc = pc; goto *(*pc++).v;}))
+#define NEXT() (__extension__ ({currentpc = pc; BC_COUNT_PC(); \
+	    goto *(*pc++).v;}))
 #define GETOP() (*pc++).i
 #define SKIP_OP() (pc++)
 
@@ -4827,9 +5438,10 @@ typedef int BCODE;
 #define OP(name,argc) case name##_OP
 
 #ifdef BC_PROFILING
-#define BEGIN_MACHINE  loop: currentpc = pc; current_opcode = *pc; switch(*pc++)
+#define BEGIN_MACHINE  loop: currentpc = pc; current_opcode = *pc; \
+    BC_COUNT_PC(); switch(*pc++)
 #else
-#define BEGIN_MACHINE  loop: currentpc = pc; switch(*pc++)
+#define BEGIN_MACHINE  loop: currentpc = pc; BC_COUNT_PC(); switch(*pc++)
 #endif
 #define LASTOP  default: error(_("bad opcode"))
 #define INITIALIZE_MACHINE()
@@ -4841,6 +5453,12 @@ typedef int BCODE;
 #define BCCODE(e) INTEGER(BCODE_CODE(e))
 #endif
 
+/* Count executions of the instruction at pc when instruction counting
+   is on; pccounts is NULL otherwise. */
+#define BC_COUNT_PC() do {						\
+	if (pccounts != NULL) pccounts[pc - codebase]++;		\
+    } while (0)
+
 static R_INLINE SEXP BINDING_VALUE(SEXP loc)
 {
     if (loc != R_NilValue && ! IS_ACTIVE_BINDING(loc))
@@ -4945,6 +5563,23 @@ static R_INLINE SEXP GET_BINDING_CELL_CACHE(SEXP symbol, SEXP rho,
     }
 }
 
+/* With a small cache the cells of local variables are usually found
+   directly. A variable that is only assigned to and never read will
+   not have been looked up yet; doing so here lets later assignments
+   use the cell instead of going through defineVar. */
+static R_INLINE SEXP SETVAR_BINDING_CELL(int sidx, SEXP constants, SEXP rho,
+					 R_binding_cache_t vcache,
+					 Rboolean smallcache)
+{
+    if (smallcache) {
+	SEXP cell = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);
+	if (cell != R_NilValue)
+	    return cell;
+    }
+    SEXP symbol = VECTOR_ELT(constants, sidx);
+    return GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);
+}
+
 static void NORET MISSING_ARGUMENT_ERROR(SEXP symbol)
 {
     const char *n = CHAR(PRINTNAME(symbol));
@@ -5076,6 +5711,170 @@ static R_INLINE SEXP getvar(SEXP symbol, SEXP rho,
 } while (0)
 #endif
 
+/* Superinstructions. The compiler fuses some very common short
+   instruction sequences in scalar code into a single instruction to
+   save the dispatches between them:
+
+     GETVAR x; LDCONST c; ADD             ==> GETVAR_CONST_ADD x c
+     GETVAR x; GETVAR y; LT; BRIFNOT L    ==> GETVAR_GETVAR_RELOP_BRIFNOT
+     GETVAR x; LDCONST c; LT; BRIFNOT L   ==> GETVAR_CONST_RELOP_BRIFNOT
+     GETVAR x; LDCONST c; ADD; SETVAR x   ==> INCVAR x c
+
+   and similarly for SUB, MUL, DIV and the other comparisons. The
+   fused instructions fetch their operands as GETVAR and LDCONST would
+   and then either handle simple scalars directly or finish like the
+   instructions they replace. */
+static R_INLINE SEXP FUSED_GETVAR(int sidx, SEXP constants, SEXP rho,
+				  R_binding_cache_t vcache,
+				  Rboolean smallcache)
+{
+    if (smallcache) {
+	/* (cell may be R_NilValue or an active binding; the type
+	   check rules these out) */
+	SEXP value = CAR(GET_SMALLCACHE_BINDING_CELL(vcache, sidx));
+	switch(TYPEOF(value)) {
+	case REALSXP:
+	case INTSXP:
+	case LGLSXP:
+	    ENSURE_NAMED(value); /* should not really be needed - LT */
+	    return value;
+	}
+    }
+    return getvar(VECTOR_ELT(constants, sidx), rho, FALSE, FALSE,
+		  vcache, sidx);
+}
+
+static R_INLINE SEXP FUSED_LDCONST(int cidx, SEXP constants)
+{
+    SEXP value = VECTOR_ELT(constants, cidx);
+    if (R_check_constants < 0)
+	value = duplicate(value);
+    MARK_NOT_MUTABLE(value);
+    return value;
+}
+
+#define DO_FUSED_ARITH(op, opval, opsym) do { \
+    int sidx = GETOP(); \
+    BCNPUSH(FUSED_GETVAR(sidx, constants, rho, vcache, smallcache)); \
+    BCNPUSH(FUSED_LDCONST(GETOP(), constants)); \
+    FastBinary(op, opval, opsym); \
+} while (0)
+
+/* Returns the value of the comparison of the two top stack values
+   if both are non-missing numeric scalars, and -1 otherwise. The
+   comparison is specified by the opcode of the relop instruction. */
+static R_INLINE int fusedRelop(int relop)
+{
+    scalar_value_t vx, vy;
+    double x, y;
+    int typex = bcStackScalar(R_BCNodeStackTop - 2, &vx);
+    int typey = bcStackScalar(R_BCNodeStackTop - 1, &vy);
+
+    if (typex == REALSXP && ! ISNAN(vx.dval)) x = vx.dval;
+    else if (typex == INTSXP && vx.ival != NA_INTEGER) x = vx.ival;
+    else return -1;
+    if (typey == REALSXP && ! ISNAN(vy.dval)) y = vy.dval;
+    else if (typey == INTSXP && vy.ival != NA_INTEGER) y = vy.ival;
+    else return -1;
+
+    switch(relop) {
+    case EQ_OP: return x == y;
+    case NE_OP: return x != y;
+    case LT_OP: return x < y;
+    case LE_OP: return x <= y;
+    case GE_OP: return x >= y;
+    case GT_OP: return x > y;
+    default: return -1;
+    }
+}
+
+static SEXP cmp_relop_opcode(int relop, SEXP call, SEXP x, SEXP y, SEXP rho)
+{
+    switch(relop) {
+    case EQ_OP: return cmp_relop(call, EQOP, R_EqSym, x, y, rho);
+    case NE_OP: return cmp_relop(call, NEOP, R_NeSym, x, y, rho);
+    case LT_OP: return cmp_relop(call, LTOP, R_LtSym, x, y, rho);
+    case LE_OP: return cmp_relop(call, LEOP, R_LeSym, x, y, rho);
+    case GE_OP: return cmp_relop(call, GEOP, R_GeSym, x, y, rho);
+    case GT_OP: return cmp_relop(call, GTOP, R_GtSym, x, y, rho);
+    default: error(_("bad relop opcode %d"), relop);
+    }
+}
+
+/* The two operands are on the stack; the remaining instruction
+   operands are the index of the comparison call, the index of the
+   'if' or 'while' call and the branch label. */
+#define DO_FUSED_RELOP_BRIFNOT(relop) do { \
+    int callidx = GETOP(); \
+    int brcallidx = GETOP(); \
+    int label = GETOP(); \
+    int cond = fusedRelop(relop); \
+    if (cond < 0) { \
+	SEXP call = VECTOR_ELT(constants, callidx); \
+	SETSTACK(-2, cmp_relop_opcode(relop, call, GETSTACK(-2), \
+				      GETSTACK(-1), rho)); \
+	R_BCNodeStackTop--; \
+	cond = GETSTACK_LOGICAL_NO_NA_PTR(R_BCNodeStackTop - 1, \
+					  brcallidx, constants, rho); \
+	BCNPOP_IGNORE_VALUE(); \
+    } \
+    else R_BCNodeStackTop -= 2; \
+    R_Visible = TRUE; \
+    if (! cond) { \
+	BC_CHECK_SIGINT(); \
+	pc = codebase + label; \
+    } \
+    NEXT(); \
+} while (0)
+
+/* Inline cache for GETFUN. Entries are selected by the address of the
+   instruction and hold the symbol, the environment the search started
+   from and the function found; they are valid while R_LookupEpoch is
+   unchanged. A standard unhashed frame, usually the frame of the
+   current call, is new for each call; it is searched directly and the
+   search from its enclosure is cached. The empty environment and user
+   databases have no such frame and are searched by findFun. */
+#define FUN_CACHE_SIZE 1024
+static struct {
+    uint64_t epoch;
+    SEXP symbol;
+    SEXP env;
+    SEXP fun;
+} fun_cache[FUN_CACHE_SIZE];
+
+static R_INLINE SEXP FIND_FUN_CACHED(SEXP symbol, SEXP rho, BCODE *pc)
+{
+    SEXP env = rho;
+    if (HASHTAB(rho) == R_NilValue && rho != R_EmptyEnv &&
+	rho != R_BaseEnv && rho != R_BaseNamespace &&
+	! IS_USER_DATABASE(rho)) {
+	for (SEXP frame = FRAME(rho); frame != R_NilValue; frame = CDR(frame))
+	    if (TAG(frame) == symbol) {
+		SEXP value = CAR(frame);
+		if (IS_ACTIVE_BINDING(frame) || IS_LOOKUP_RELEVANT(value))
+		    return findFun(symbol, rho);
+		break; /* other values are skipped by findFun */
+	    }
+	env = ENCLOS(rho);
+    }
+
+    int i = (int) (((uintptr_t) pc / sizeof(BCODE)) % FUN_CACHE_SIZE);
+    if (fun_cache[i].epoch == R_LookupEpoch &&
+	fun_cache[i].symbol == symbol && fun_cache[i].env == env)
+	return fun_cache[i].fun;
+
+    uint64_t epoch = R_LookupEpoch;
+    unsigned int volatile_lookups = R_VolatileLookups;
+    SEXP fun = findFun(symbol, env);
+    if (R_VolatileLookups == volatile_lookups) {
+	fun_cache[i].epoch = epoch;
+	fun_cache[i].symbol = symbol;
+	fun_cache[i].env = env;
+	fun_cache[i].fun = fun;
+    }
+    return fun;
+}
+
 /* call frame accessors */
 #define CALL_FRAME_FUN() GETSTACK(-3)
 #define CALL_FRAME_ARGS() GETSTACK(-2)
@@ -5336,6 +6135,111 @@ static int current_opcode = NO_CURRENT_OPCODE;
 static int opcode_counts[OPCOUNT];
 #endif
 
+/* Instruction counts.  While counting is on each byte code object run
+   by bcEval gets a vector of execution counts for its instructions,
+   indexed by the offset of the instruction.  The table holds the code
+   objects and their counts in consecutive elements, hashed on the
+   address of the code; holding the code keeps the addresses unique.
+   bcEval protects the counts it is using, so they remain valid if
+   counting is stopped while the code is running. */
+static SEXP bc_count_table = NULL;
+static int bc_count_n = 0;
+
+#define BC_COUNT_TABLE_SIZE 1024
+
+static R_INLINE int bcCountHash(SEXP body, int size)
+{
+    return (int) (((uintptr_t) body / sizeof(SEXPREC)) % size);
+}
+
+static void bcCountGrow(void)
+{
+    SEXP old = bc_count_table;
+    int size = LENGTH(old); /* twice the old size */
+    SEXP table = allocVector(VECSXP, 2 * size);
+    R_PreserveObject(table);
+    for (int i = 0; i < LENGTH(old); i += 2) {
+	SEXP body = VECTOR_ELT(old, i);
+	if (body != R_NilValue) {
+	    int h = bcCountHash(body, size);
+	    while (VECTOR_ELT(table, 2 * h) != R_NilValue)
+		h = (h + 1) % size;
+	    SET_VECTOR_ELT(table, 2 * h, body);
+	    SET_VECTOR_ELT(table, 2 * h + 1, VECTOR_ELT(old, i + 1));
+	}
+    }
+    bc_count_table = table;
+    R_ReleaseObject(old);
+}
+
+/* The counts for body, created if necessary. */
+static SEXP bcCounts(SEXP body)
+{
+    int size = LENGTH(bc_count_table) / 2;
+    int h = bcCountHash(body, size);
+    SEXP b;
+    while ((b = VECTOR_ELT(bc_count_table, 2 * h)) != R_NilValue) {
+	if (b == body)
+	    return VECTOR_ELT(bc_count_table, 2 * h + 1);
+	h = (h + 1) % size;
+    }
+
+    /* same length as the BCODE array of the code */
+    SEXP code = BCODE_CODE(body);
+    int m = (sizeof(BCODE) + sizeof(int) - 1) / sizeof(int);
+    SEXP counts = PROTECT(allocVector(REALSXP, LENGTH(code) / m));
+    memset(REAL(counts), 0, XLENGTH(counts) * sizeof(double));
+    SET_VECTOR_ELT(bc_count_table, 2 * h, body);
+    SET_VECTOR_ELT(bc_count_table, 2 * h + 1, counts);
+    if (2 * ++bc_count_n > size)
+	bcCountGrow();
+    UNPROTECT(1); /* counts */
+    return counts;
+}
+
+SEXP attribute_hidden do_bccountstart(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    if (bc_count_table != NULL)
+	error(_("already counting byte code instructions"));
+    SEXP table = allocVector(VECSXP, 2 * BC_COUNT_TABLE_SIZE);
+    R_PreserveObject(table);
+    bc_count_n = 0;
+    bc_count_table = table;
+    return R_NilValue;
+}
+
+/* Stop counting and return a list of the code objects run and a list
+   of their counts. */
+SEXP attribute_hidden do_bccountstop(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    SEXP table = bc_count_table;
+    if (table == NULL)
+	error(_("not counting byte code instructions"));
+    bc_count_table = NULL;
+    PROTECT(table);
+    R_ReleaseObject(table);
+
+    SEXP code = PROTECT(allocVector(VECSXP, bc_count_n));
+    SEXP counts = PROTECT(allocVector(VECSXP, bc_count_n));
+    for (int i = 0, k = 0; i < LENGTH(table); i += 2)
+	if (VECTOR_ELT(table, i) != R_NilValue) {
+	    SET_VECTOR_ELT(code, k, VECTOR_ELT(table, i));
+	    SET_VECTOR_ELT(counts, k, VECTOR_ELT(table, i + 1));
+	    k++;
+	}
+    SEXP val = PROTECT(allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(val, 0, code);
+    SET_VECTOR_ELT(val, 1, counts);
+    SEXP nms = PROTECT(allocVector(STRSXP, 2));
+    SET_STRING_ELT(nms, 0, mkChar("code"));
+    SET_STRING_ELT(nms, 1, mkChar("counts"));
+    setAttrib(val, R_NamesSymbol, nms);
+    UNPROTECT(5); /* table, code, counts, val, nms */
+    return val;
+}
+
 #define BC_COUNT_DELTA 1000
 
 #ifndef IMMEDIATE_FINALIZERS
@@ -5997,6 +6901,19 @@ static SEXP R_findBCInterpreterLocation(RCNTXT *cptr, const char *iname)
     return getLocTableElt(relpc, ltable, constants);
 }
 
+/* Return the offset of the current instruction in the byte code being
+   executed, or of the one that was current when the supplied context
+   was created, or -1 if there is none. */
+static ptrdiff_t R_findBCInterpreterOffset(RCNTXT *cptr)
+{
+    SEXP body = cptr ? cptr->bcbody : R_BCbody;
+    void *bcpc = cptr ? cptr->bcpc : R_BCpc;
+    if (body == NULL || bcpc == NULL || TYPEOF(body) != BCODESXP)
+	return -1;
+    BCODE *pc = *((BCODE **) bcpc);
+    return pc == NULL ? -1 : pc - BCCODE(body);
+}
+
 SEXP attribute_hidden R_findBCInterpreterSrcref(RCNTXT *cptr)
 {
     return R_findBCInterpreterLocation(cptr, "srcrefsIndex");
@@ -6182,6 +7099,255 @@ static R_INLINE Rboolean FIND_ON_STACK(SEXP x, R_bcstack_t *base, int skip)
     return FALSE;
 }
 
+/* Support for the VECLOOP instruction, which runs loops of the form
+
+       for (i in 1:n) y[i] <- E
+
+   a vector at a time when E is element-wise arithmetic or math1 code.
+   The compiler describes the loop by a list of the target and loop
+   variables, the other variables and the constants used in E, the
+   base functions used in E that need a guard, and E as a postfix
+   program of instruction and argument pairs.  bcVecLoop returns FALSE
+   without changing anything if the loop cannot be run this way, or if
+   running it would signal a warning; the ordinary loop code is then
+   used. */
+
+/* Keep these consistent with vecLoopOps in the compiler */
+enum { VL_INDEX = 1, VL_VAR, VL_CONST, VL_SEQ, VL_ARITH, VL_NEG,
+       VL_SQRT, VL_EXP, VL_LOG, VL_MATH1 };
+
+SEXP R_VecLoopArith(ARITHOP_TYPE, SEXP, SEXP, R_xlen_t);
+SEXP R_VecLoopMath1(double (*)(double), SEXP, R_xlen_t);
+
+/* n if the loop sequence is 1:n, zero otherwise */
+static R_xlen_t vecLoopLength(SEXP seq, Rboolean iscompact)
+{
+    if (iscompact) {
+	int n1 = INTEGER(seq)[0];
+	int n2 = INTEGER(seq)[1];
+	return n1 == 1 && n2 >= 1 ? n2 : 0;
+    }
+    if (TYPEOF(seq) != INTSXP || OBJECT(seq) || XLENGTH(seq) == 0)
+	return 0;
+    Rboolean ok = TRUE;
+    ITERATE_BY_REGION(seq, px, idx, nb, int, INTEGER, {
+	    for (R_xlen_t k = 0; k < nb; k++)
+		if (px[k] != idx + k + 1) {
+		    ok = FALSE;
+		    break;
+		}
+	    if (! ok) break;
+	});
+    return ok ? XLENGTH(seq) : 0;
+}
+
+/* The binding of a variable that eval() would find, without forcing
+   promises: R_UnboundValue if there is none, and NULL if the variable
+   is bound by an active binding or the search reaches a user
+   database, since looking at those can have side effects. */
+static SEXP findVarNoEffects(SEXP sym, SEXP rho)
+{
+    for (; rho != R_EmptyEnv; rho = ENCLOS(rho)) {
+	if (rho == R_BaseEnv || rho == R_BaseNamespace)
+	    return IS_ACTIVE_BINDING(sym) ? NULL : SYMVALUE(sym);
+	if (IS_USER_DATABASE(rho))
+	    return NULL;
+	SEXP cell = GET_BINDING_CELL(sym, rho);
+	if (cell != R_NilValue)
+	    return IS_ACTIVE_BINDING(cell) ? NULL : CAR(cell);
+    }
+    return R_UnboundValue;
+}
+
+/* The value of a variable, as eval() would find it, or NULL if it is
+   not found or is bound by an active binding or in a user database.
+   Promises are forced as eval() would force them; VECLOOP evaluates
+   operands in the same order as the first iteration of the loop. */
+static SEXP vecLoopValue(SEXP sym, SEXP rho)
+{
+    SEXP value = findVarNoEffects(sym, rho);
+    if (value == NULL)
+	return NULL;
+    if (TYPEOF(value) == PROMSXP)
+	value = forcePromise(value);
+    return value == R_UnboundValue || value == R_MissingArg ? NULL : value;
+}
+
+/* An operand of the element-wise code: scalar variables must have
+   length one, and subsets x[i] are padded with NA or truncated to
+   length n */
+static SEXP vecLoopOperand(SEXP sym, SEXP rho, Rboolean scalar, R_xlen_t n)
+{
+    SEXP x = vecLoopValue(sym, rho);
+    if (x == NULL || OBJECT(x))
+	return NULL;
+    int type = TYPEOF(x);
+    if (type != LGLSXP && type != INTSXP && type != REALSXP)
+	return NULL;
+    R_xlen_t len = XLENGTH(x);
+    if (scalar)
+	return len == 1 ? x : NULL;
+    if (len == n)
+	return x;
+
+    SEXP ans = allocVector(type, n);
+    R_xlen_t m = len < n ? len : n;
+    if (type == REALSXP) {
+	if (m > 0) REAL_GET_REGION(x, 0, m, REAL(ans));
+	for (R_xlen_t k = m; k < n; k++) REAL(ans)[k] = NA_REAL;
+    }
+    else {
+	/* NA_LOGICAL == NA_INTEGER */
+	if (m > 0) INTEGER_GET_REGION(x, 0, m, INTEGER(ans));
+	for (R_xlen_t k = m; k < n; k++) INTEGER(ans)[k] = NA_INTEGER;
+    }
+    return ans;
+}
+
+static Rboolean bcVecLoop(SEXP call, SEXP info, SEXP seq, Rboolean iscompact,
+			  SEXP rho, R_bcstack_t *base)
+{
+    R_xlen_t n = vecLoopLength(seq, iscompact);
+    if (n == 0)
+	return FALSE;
+
+    SEXP target = VECTOR_ELT(info, 0);
+    SEXP var = VECTOR_ELT(info, 1);
+    SEXP vars = VECTOR_ELT(info, 2);
+    SEXP consts = VECTOR_ELT(info, 3);
+    SEXP funs = VECTOR_ELT(info, 4);
+    const int *code = INTEGER(VECTOR_ELT(info, 5));
+    int ncode = LENGTH(VECTOR_ELT(info, 5));
+
+    /* the variables are assigned in an ordinary frame */
+    if (rho == R_BaseEnv || rho == R_BaseNamespace || IS_USER_DATABASE(rho))
+	return FALSE;
+    SEXP vcell = GET_BINDING_CELL(var, rho);
+    if (vcell != R_NilValue &&
+	(IS_ACTIVE_BINDING(vcell) || BINDING_IS_LOCKED(vcell)))
+	return FALSE;
+
+    for (int k = 0; k < LENGTH(funs); k++) {
+	SEXP sym = VECTOR_ELT(funs, k);
+	if (findFun(sym, rho) != SymbolValue(sym))
+	    return FALSE;
+    }
+
+    /* evaluate E; the program leaves exactly one value on the stack */
+    SEXP idx = iscompact ? R_compact_intrange(1, n) : seq;
+    PROTECT(idx);
+    SEXP stack = PROTECT(allocVector(VECSXP, ncode / 2));
+    int top = 0;
+    for (int k = 0; k < ncode; k += 2) {
+	int arg = code[k + 1];
+	SEXP v;
+	switch (code[k]) {
+	case VL_INDEX:
+	    v = vecLoopOperand(VECTOR_ELT(vars, arg), rho, FALSE, n);
+	    break;
+	case VL_VAR:
+	    v = vecLoopOperand(VECTOR_ELT(vars, arg), rho, TRUE, n);
+	    break;
+	case VL_CONST: v = VECTOR_ELT(consts, arg); break;
+	case VL_SEQ: v = idx; break;
+	case VL_ARITH:
+	    top -= 2;
+	    v = R_VecLoopArith(arg, VECTOR_ELT(stack, top),
+			       VECTOR_ELT(stack, top + 1), n);
+	    break;
+	case VL_NEG:
+	    v = R_VecLoopArith(MINUSOP, VECTOR_ELT(stack, --top), NULL, n);
+	    break;
+	case VL_SQRT:
+	    v = R_VecLoopMath1(sqrt, VECTOR_ELT(stack, --top), n);
+	    break;
+	case VL_EXP:
+	    v = R_VecLoopMath1(exp, VECTOR_ELT(stack, --top), n);
+	    break;
+	case VL_LOG:
+	    v = R_VecLoopMath1(R_log, VECTOR_ELT(stack, --top), n);
+	    break;
+	case VL_MATH1:
+	    v = R_VecLoopMath1(math1funs[arg].fun, VECTOR_ELT(stack, --top), n);
+	    break;
+	default: v = NULL;
+	}
+	if (v == NULL) {
+	    UNPROTECT(2); /* stack, idx */
+	    return FALSE;
+	}
+	SET_VECTOR_ELT(stack, top++, v);
+    }
+    SEXP value = VECTOR_ELT(stack, 0);
+
+    /* y[1:n] <- value, making a local copy of y if needed as
+       STARTASSIGN does */
+    SEXP y = NULL;
+    Rboolean inplace = FALSE;
+    SEXP ycell = GET_BINDING_CELL(target, rho);
+    if (ycell != R_NilValue) {
+	if (! BINDING_IS_LOCKED(ycell)) {
+	    inplace = TYPEOF(CAR(ycell)) != PROMSXP;
+	    y = vecLoopValue(target, rho);
+	}
+    }
+    else if (! R_EnvironmentIsLocked(rho))
+	y = vecLoopValue(target, ENCLOS(rho));
+    if (y == NULL || OBJECT(y)) {
+	UNPROTECT(2); /* stack, idx */
+	return FALSE;
+    }
+    switch (TYPEOF(y)) {
+    case NILSXP: case LGLSXP: case INTSXP: case REALSXP: case CPLXSXP:
+    case STRSXP: case VECSXP:
+	break;
+    default:
+	UNPROTECT(2); /* stack, idx */
+	return FALSE;
+    }
+    if (! inplace || MAYBE_SHARED(y) ||
+	(MAYBE_REFERENCED(y) && FIND_ON_STACK(y, base, FALSE)))
+	y = shallow_duplicate(y);
+    PROTECT(y);
+    defineVar(var, ScalarInteger((int) n), rho);
+    SEXP args = PROTECT(CONS_NR(y, CONS_NR(idx, CONS_NR(value, R_NilValue))));
+    y = do_subassign_dflt(call, R_SubassignSym, args, rho);
+    INCREMENT_NAMED(y);
+    ycell = GET_BINDING_CELL(target, rho);
+    if (! SET_BINDING_VALUE(ycell, y))
+	defineVar(target, y, rho);
+    UNPROTECT(4); /* args, y, stack, idx */
+    return TRUE;
+}
+
+/* Support for type-specialized code (see R_jitProfileArgs). The
+   CHECKARGS guard at the start of specialized code checks that the
+   arguments have the types and lengths recorded in its constant,
+   which also holds the generic code to run instead if they do not.
+   The guard never forces a promise, as that could change the order in
+   which arguments are evaluated: it only looks at values and forced
+   promises.  Unforced promises are left for the body to force, so the
+   instructions using the recorded types still check their operands
+   and handle other values like the generic code. */
+static Rboolean bcCheckArgs(SEXP info, SEXP rho)
+{
+    SEXP syms = VECTOR_ELT(info, 0);
+    const int *type = INTEGER(VECTOR_ELT(info, 1));
+    const int *length = INTEGER(VECTOR_ELT(info, 2));
+    for (int k = 0; k < LENGTH(syms); k++) {
+	SEXP cell = GET_BINDING_CELL(VECTOR_ELT(syms, k), rho);
+	if (cell == R_NilValue || IS_ACTIVE_BINDING(cell))
+	    return FALSE;
+	SEXP v = CAR(cell);
+	if (TYPEOF(v) == PROMSXP && (v = PRVALUE(v)) == R_UnboundValue)
+	    v = NULL;
+	if (v != NULL && (TYPEOF(v) != type[k] || ATTRIB(v) != R_NilValue ||
+			  XLENGTH(v) != length[k]))
+	    return FALSE;
+    }
+    return TRUE;
+}
+
 static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
 {
   SEXP retvalue = R_NilValue, constants;
@@ -6193,6 +7359,7 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
   SEXP oldbcbody = R_BCbody;
   void *oldbcpc = R_BCpc;
   BCODE *currentpc = NULL;
+  double *pccounts = NULL;
 
 #ifdef BC_INT_STACK
   IStackval *olditop = R_BCIntStackTop;
@@ -6239,6 +7406,11 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
   R_BCIntActive = 1;
   R_BCbody = body;
   R_BCpc = &currentpc;
+  if (bc_count_table != NULL) {
+      SEXP counts = bcCounts(body);
+      PROTECT(counts);
+      pccounts = REAL(counts);
+  }
   R_binding_cache_t vcache = NULL;
   Rboolean smallcache = TRUE;
   R_bcstack_t *vcache_top = NULL;
@@ -6475,6 +7647,79 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
 	}
 	NEXT();
       }
+    OP(VECLOOP, 3):
+      {
+	Rboolean iscompact = FALSE;
+	SEXP seq = getForLoopSeq(-1, &iscompact);
+	SEXP call = VECTOR_ELT(constants, GETOP());
+	SEXP info = VECTOR_ELT(constants, GETOP());
+	int label = GETOP();
+	if (bcVecLoop(call, info, seq, iscompact, rho, vcache_top)) {
+	    SETSTACK(-1, R_NilValue);
+	    R_Visible = FALSE;
+	    pc = codebase + label;
+	}
+	NEXT();
+      }
+    OP(CHECKARGS, 1):
+      {
+	SEXP info = VECTOR_ELT(constants, GETOP());
+	if (! bcCheckArgs(info, rho)) {
+	    retvalue = bcEval(VECTOR_ELT(info, 3), rho, useCache);
+	    goto done;
+	}
+	NEXT();
+      }
+    OP(GETARGELT, 3):
+      {
+	SEXP call = VECTOR_ELT(constants, GETOP());
+	int sidx = GETOP();
+	R_xlen_t i = GETOP() - 1;
+	SEXP symbol = VECTOR_ELT(constants, sidx);
+	SEXP vec = getvar(symbol, rho, FALSE, FALSE, vcache, sidx);
+	R_Visible = TRUE;
+	if (ATTRIB(vec) == R_NilValue)
+	    switch (TYPEOF(vec)) {
+	    case REALSXP:
+		if (XLENGTH(vec) <= i) break;
+		BCNPUSH_REAL(REAL_ELT(vec, i));
+		NEXT();
+	    case INTSXP:
+		if (XLENGTH(vec) <= i) break;
+		BCNPUSH_INTEGER(INTEGER_ELT(vec, i));
+		NEXT();
+	    case LGLSXP:
+		if (XLENGTH(vec) <= i) break;
+		BCNPUSH(ScalarLogical(LOGICAL_ELT(vec, i)));
+		NEXT();
+	    }
+	/* not a value the code was specialized for */
+	BCNPUSH(eval(call, rho));
+	NEXT();
+      }
+    OP(CACHEFORMALS, 1):
+      {
+	/* The operand is a vector of the constant pool indices of the
+	   symbols of the formals.  A frame created for a call of the
+	   closure starts with the bindings of the formals in this order,
+	   so their cells can be cached in one walk over the frame rather
+	   than found by a search of the frame on the first use of each
+	   formal.  Other frames are left to the usual lookups from the
+	   first cell that does not match. */
+	SEXP slots = VECTOR_ELT(constants, GETOP());
+	if (vcache != NULL && IS_STANDARD_UNHASHED_FRAME(rho)) {
+	    int n = LENGTH(slots);
+	    int *sidx = INTEGER(slots);
+	    SEXP cell = FRAME(rho);
+	    for (int i = 0; i < n && cell != R_NilValue;
+		 i++, cell = CDR(cell)) {
+		if (TAG(cell) != VECTOR_ELT(constants, sidx[i]))
+		    break;
+		SET_CACHED_BINDING(vcache, sidx[i], cell);
+	    }
+	}
+	NEXT();
+      }
     OP(ENDFOR, 0):
       {
 	Rboolean iscompact = FALSE;
@@ -6506,21 +7751,22 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
       {
 	int sidx = GETOP();
 	SEXP loc;
-	if (smallcache)
-	    loc = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);
-	else {
-	    SEXP symbol = VECTOR_ELT(constants, sidx);
-	    loc = GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);
-	}
+	loc = SETVAR_BINDING_CELL(sidx, constants, rho, vcache, smallcache);
 #ifdef TYPED_STACK
 	R_bcstack_t *s = R_BCNodeStackTop - 1;
+	/* A boxed simple scalar is handled like an immediate value:
+	   it is copied into the binding value rather than shared with
+	   it. This keeps scalar local variables in their own unshared
+	   boxes, so later updates can be done in place. */
+	scalar_value_t sv;
+	int stag = bcStackScalar(s, &sv);
 	/* reading the locked bit is OK even if cell is R_NilValue */
-	if (s->tag && ! BINDING_IS_LOCKED(loc)) {
+	if (stag && ! BINDING_IS_LOCKED(loc)) {
 	    /* if cell is R_NilValue or an active binding, or if the value
 	       is R_UnboundValue, then TYPEOF(CAR(cell)) will not match the
 	       immediate value tag. */
 	    SEXP x = CAR(loc);  /* fast, but assumes binding is a CONS */
-	    if (NOT_SHARED(x) && IS_SIMPLE_SCALAR(x, s->tag)) {
+	    if (NOT_SHARED(x) && IS_SIMPLE_SCALAR(x, stag)) {
 		/* if the binding value is not shared and is a simple
 		   scalar of the same type as the immediate value,
 		   then we can copy the stack value into the binding
@@ -6536,17 +7782,28 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
 		   false positives and unnecessary boxing but is
 		   probably worth it for avoiding checking and
 		   branching. LT */
-		int tag = s->tag;
+		int tag = stag;
 		if (R_BCNodeStackTop - vcache_top > MAX_ON_STACK_CHECK ||
 		    FIND_ON_STACK(x, vcache_top, TRUE))
 		    tag = 0;		
 
 		switch (tag) {
-		case REALSXP: SET_SCALAR_DVAL(x, s->u.dval); NEXT();
-		case INTSXP: SET_SCALAR_IVAL(x, s->u.ival); NEXT();
-		case LGLSXP: SET_SCALAR_LVAL(x, s->u.ival); NEXT();
+		case REALSXP: SET_SCALAR_DVAL(x, sv.dval); NEXT();
+		case INTSXP: SET_SCALAR_IVAL(x, sv.ival); NEXT();
+		case LGLSXP: SET_SCALAR_LVAL(x, sv.ival); NEXT();
 		}
 	    }
+	    else if (s->tag == 0 && MAYBE_REFERENCED(s->u.sxpval) &&
+		     (stag == REALSXP || stag == INTSXP) &&
+		     IS_SIMPLE_SCALAR(x, stag)) {
+		/* The variable already holds a scalar of this type but
+		   its box is shared, and the new value is bound
+		   elsewhere. Rather than sharing the new value as well,
+		   give the variable a fresh box of its own. */
+		s->tag = stag;
+		if (stag == REALSXP) s->u.dval = sv.dval;
+		else s->u.ival = sv.ival;
+	    }
 	}
 #endif
 	SEXP value = GETSTACK(-1);
@@ -6563,7 +7820,7 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
       {
 	/* get the function */
 	SEXP symbol = VECTOR_ELT(constants, GETOP());
-	SEXP value = findFun(symbol, rho);
+	SEXP value = FIND_FUN_CACHED(symbol, rho, pc);
 	INIT_CALL_FRAME(value);
 	if(RTRACE(value)) {
 	  Rprintf("trace: ");
@@ -7281,10 +8538,97 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
     OP(SEQALONG, 1): DO_SEQ_ALONG(); NEXT();
     OP(SEQLEN, 1): DO_SEQ_LEN(); NEXT();
     OP(BASEGUARD, 2): DO_BASEGUARD(); NEXT();
+    OP(GETVAR_CONST_ADD, 3): DO_FUSED_ARITH(R_ADD, PLUSOP, R_AddSym);
+    OP(GETVAR_CONST_SUB, 3): DO_FUSED_ARITH(R_SUB, MINUSOP, R_SubSym);
+    OP(GETVAR_CONST_MUL, 3): DO_FUSED_ARITH(R_MUL, TIMESOP, R_MulSym);
+    OP(GETVAR_CONST_DIV, 3): DO_FUSED_ARITH(R_DIV, DIVOP, R_DivSym);
+    OP(GETVAR_GETVAR_RELOP_BRIFNOT, 6):
+      {
+	int relop = GETOP();
+	int sidx = GETOP();
+	BCNPUSH(FUSED_GETVAR(sidx, constants, rho, vcache, smallcache));
+	sidx = GETOP();
+	BCNPUSH(FUSED_GETVAR(sidx, constants, rho, vcache, smallcache));
+	DO_FUSED_RELOP_BRIFNOT(relop);
+      }
+    OP(GETVAR_CONST_RELOP_BRIFNOT, 6):
+      {
+	int relop = GETOP();
+	int sidx = GETOP();
+	BCNPUSH(FUSED_GETVAR(sidx, constants, rho, vcache, smallcache));
+	BCNPUSH(FUSED_LDCONST(GETOP(), constants));
+	DO_FUSED_RELOP_BRIFNOT(relop);
+      }
+    OP(INCVAR, 3):
+      {
+	int sidx = GETOP();
+	int cidx = GETOP();
+	SEXP loc;
+	loc = SETVAR_BINDING_CELL(sidx, constants, rho, vcache, smallcache);
+#ifdef TYPED_STACK
+	/* As in SETVAR, update an unshared simple scalar binding value
+	   in place if the sum has the same type. */
+	SEXP x = CAR(loc);
+	SEXP inc = VECTOR_ELT(constants, cidx);
+	if (! BINDING_IS_LOCKED(loc) && NOT_SHARED(x) &&
+	    R_BCNodeStackTop - vcache_top <= MAX_ON_STACK_CHECK &&
+	    (IS_SIMPLE_SCALAR(x, REALSXP) || IS_SIMPLE_SCALAR(x, INTSXP)) &&
+	    ! FIND_ON_STACK(x, vcache_top, FALSE)) {
+	    if (TYPEOF(x) == REALSXP) {
+		double dval = SCALAR_DVAL(x);
+		if (IS_SIMPLE_SCALAR(inc, REALSXP))
+		    dval += SCALAR_DVAL(inc);
+		else if (IS_SIMPLE_SCALAR(inc, INTSXP) &&
+			 SCALAR_IVAL(inc) != NA_INTEGER)
+		    dval += SCALAR_IVAL(inc);
+		else goto incvar_slow;
+		SKIP_OP();
+		SET_SCALAR_DVAL(x, dval);
+		BCNPUSH_REAL(dval);
+		R_Visible = TRUE;
+		NEXT();
+	    }
+	    else if (SCALAR_IVAL(x) != NA_INTEGER &&
+		     IS_SIMPLE_SCALAR(inc, INTSXP) &&
+		     SCALAR_IVAL(inc) != NA_INTEGER) {
+		double dval = (double) SCALAR_IVAL(x) + SCALAR_IVAL(inc);
+		if (dval <= INT_MAX && dval >= INT_MIN + 1) {
+		    SKIP_OP();
+		    SET_SCALAR_IVAL(x, (int) dval);
+		    BCNPUSH_INTEGER((int) dval);
+		    R_Visible = TRUE;
+		    NEXT();
+		}
+	    }
+	}
+      incvar_slow:
+#endif
+	BCNPUSH(FUSED_GETVAR(sidx, constants, rho, vcache, smallcache));
+	BCNPUSH(FUSED_LDCONST(cidx, constants));
+	SEXP call = VECTOR_ELT(constants, GETOP());
+	SEXP value = cmp_arith2(call, PLUSOP, R_AddSym,
+				GETSTACK(-2), GETSTACK(-1), rho);
+	R_BCNodeStackTop--;
+	SETSTACK(-1, value);
+	R_Visible = TRUE;
+	/* the binding cell is looked up again since the addition may
+	   have dispatched to a method that changed the frame */
+	loc = SETVAR_BINDING_CELL(sidx, constants, rho, vcache, smallcache);
+	INCREMENT_NAMED(value);
+	if (! SET_BINDING_VALUE(loc, value)) {
+	    SEXP symbol = VECTOR_ELT(constants, sidx);
+	    PROTECT(value);
+	    defineVar(symbol, value, rho);
+	    UNPROTECT(1);
+	}
+	NEXT();
+      }
     LASTOP;
   }
 
  done:
+  if (pccounts != NULL)
+      UNPROTECT(1); /* counts */
   R_BCIntActive = oldbcintactive;
   R_BCbody = oldbcbody;
   R_BCpc = oldbcpc;
@@ -7391,6 +8735,23 @@ SEXP R_bcEncode(SEXP x) { return x; }
 SEXP R_bcDecode(SEXP x) { return duplicate(x); }
 #endif
 
+/* The constant of the CHECKARGS guard of type-specialized code, or
+   NULL if body is not specialized */
+static SEXP bcSpecializedInfo(SEXP body)
+{
+    BCODE *pc = BCCODE(body);
+#ifdef THREADED_CODE
+    if (pc[1].v != opinfo[CHECKARGS_OP].addr)
+	return NULL;
+    int idx = pc[2].i;
+#else
+    if (pc[1] != CHECKARGS_OP)
+	return NULL;
+    int idx = pc[2];
+#endif
+    return VECTOR_ELT(BCCONSTS(body), idx);
+}
+
 /* Add BCODESXP bc into the constants registry, performing a deep copy of the
    bc's constants */
 #define CONST_CHECK_COUNT 1000
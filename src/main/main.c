@@ -96,6 +96,7 @@ static void R_ReplFile(FILE *fp, SEXP rho)
 	    count++;
 	    PROTECT(R_CurrentExpr);
 	    R_CurrentExpr = eval(R_CurrentExpr, rho);
+	    NOTE_BINDING_CHANGE(SYMVALUE(R_LastvalueSymbol), R_CurrentExpr);
 	    SET_SYMVALUE(R_LastvalueSymbol, R_CurrentExpr);
 	    UNPROTECT(1);
 	    if (R_Visible)
@@ -256,6 +257,7 @@ Rf_ReplIteration(SEXP rho, int savestack, int browselevel, R_ReplState *state)
 	PROTECT(thisExpr = R_CurrentExpr);
 	R_Busy(1);
 	PROTECT(value = eval(thisExpr, rho));
+	NOTE_BINDING_CHANGE(SYMVALUE(R_LastvalueSymbol), value);
 	SET_SYMVALUE(R_LastvalueSymbol, value);
 	wasDisplayed = R_Visible;
 	if (R_Visible)
@@ -389,6 +391,7 @@ int R_ReplDLLdo1(void)
 	R_Busy(1);
 	lastExpr = R_CurrentExpr;
 	R_CurrentExpr = eval(R_CurrentExpr, rho);
+	NOTE_BINDING_CHANGE(SYMVALUE(R_LastvalueSymbol), R_CurrentExpr);
 	SET_SYMVALUE(R_LastvalueSymbol, R_CurrentExpr);
 	wasDisplayed = R_Visible;
 	if (R_Visible)
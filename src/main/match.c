@@ -180,6 +180,61 @@ SEXP attribute_hidden matchArgExact(SEXP tag, SEXP * list)
 #define SET_ARGUSED(x,v) SETLEVELS(x,v)
 
 
+/* Fast path for the common case of arguments supplied in the order of
+   the formals, each either untagged or tagged with the exact name of
+   its formal.  If the last formal is '...' it can take any remaining
+   untagged arguments.  The three passes of matchArgs then match every
+   supplied argument to the formal at its position, so the matched
+   arguments are built in one pass comparing symbols, without
+   comparing names or marking the supplied arguments.  Returns NULL
+   for other calls.  If 'rc' is true the list is built with reference
+   counting, as matchArgs_RC would return it. */
+
+static SEXP matchArgsInOrder(SEXP formals, SEXP supplied, Rboolean rc)
+{
+    SEXP f, b, rest = R_NilValue;
+    for (f = formals, b = supplied; b != R_NilValue; f = CDR(f), b = CDR(b)) {
+	if (f == R_NilValue)
+	    return NULL;
+	if (TAG(f) == R_DotsSymbol) {
+	    if (CDR(f) != R_NilValue)
+		return NULL;
+	    for (rest = b; b != R_NilValue; b = CDR(b))
+		if (TAG(b) != R_NilValue)
+		    return NULL;
+	    break;
+	}
+	if (TAG(b) != R_NilValue && TAG(b) != TAG(f))
+	    return NULL;
+    }
+
+    SEXP actuals = R_NilValue;
+    for (f = formals; f != R_NilValue; f = CDR(f))
+	actuals = rc ? CONS(R_MissingArg, actuals) :
+	    CONS_NR(R_MissingArg, actuals);
+    PROTECT(actuals);
+    SEXP a = actuals;
+    for (f = formals, b = supplied; b != rest;
+	 b = CDR(b), f = CDR(f), a = CDR(a)) {
+	SETCAR(a, CAR(b));
+	if (CAR(b) == R_MissingArg)
+	    SET_MISSING(a, 1);
+    }
+    /* unmatched formals are missing, except that an unmatched '...'
+       is empty */
+    for (; f != R_NilValue; f = CDR(f), a = CDR(a))
+	SET_MISSING(a, TAG(f) == R_DotsSymbol ? 0 : 1);
+    if (rest != R_NilValue) {
+	SEXP dots = allocList(length(rest));
+	SET_TYPEOF(dots, DOTSXP);
+	for (a = dots, b = rest; b != R_NilValue; a = CDR(a), b = CDR(b))
+	    SETCAR(a, CAR(b));
+	SETCAR(lastElt(actuals), dots);
+    }
+    UNPROTECT(1); /* actuals */
+    return actuals;
+}
+
 /* We need to leave 'supplied' unchanged in case we call UseMethod */
 /* MULTIPLE_MATCHES was added by RI in Jan 2005 but never activated:
    code in R-2-8-branch */
@@ -190,6 +245,9 @@ SEXP attribute_hidden matchArgs(SEXP formals, SEXP supplied, SEXP call)
     int i, arg_i = 0;
     SEXP f, a, b, dots, actuals;
 
+    if ((actuals = matchArgsInOrder(formals, supplied, FALSE)) != NULL)
+	return actuals;
+
     actuals = R_NilValue;
     for (f = formals ; f != R_NilValue ; f = CDR(f), arg_i++) {
 	/* CONS_NR is used since argument lists created here are only
@@ -401,7 +459,10 @@ SEXP attribute_hidden matchArgs(SEXP formals, SEXP supplied, SEXP call)
 /* Use matchArgs_RC if the result might escape into R. */
 SEXP attribute_hidden matchArgs_RC(SEXP formals, SEXP supplied, SEXP call)
 {
-    SEXP args = matchArgs(formals, supplied, call);
+    SEXP args = matchArgsInOrder(formals, supplied, TRUE);
+    if (args != NULL)
+	return args;
+    args = matchArgs(formals, supplied, call);
     /* it would be better not to build this arglist with CONS_NR in
        the first place */
     for (SEXP a = args; a  != R_NilValue; a = CDR(a)) {
@@ -35,6 +35,7 @@
 #endif
 
 #include <stdarg.h>
+#include <errno.h>
 
 #include <R_ext/RS.h> /* for S4 allocation */
 #include <R_ext/Print.h>
@@ -250,6 +251,8 @@ static void R_ReportNewPage();
 }  while(0)
 
 static void R_gc_internal(R_size_t size_needed);
+static R_size_t thread_arena_bytes(void);
+static void init_thread_arena_max(void);
 static void R_gc_no_finalizers(R_size_t size_needed);
 static void R_gc_lite();
 static void mem_err_heap(R_size_t size);
@@ -344,6 +347,54 @@ static double R_VGrowIncrFrac = 0.2, R_VShrinkIncrFrac = 0.2;
 static int R_VGrowIncrMin = 80000, R_VShrinkIncrMin = 0;
 #endif
 
+/* The adjustment described above is the "occupancy" heap sizing
+   policy.  The alternative "throughput" policy instead aims to keep
+   the fraction of CPU time spent in the collector near R_GCTimeTarget,
+   as the GCTimeRatio option of some Java virtual machines does.  The
+   fraction is measured over the interval between full collections
+   and smoothed.  The heap sizes are set to leave free space of
+   R_GCFreeRatio times the space in use after a full collection, and
+   this ratio is scaled by the ratio of the measured fraction to the
+   target, within limits: the work of a collection is roughly
+   proportional to the space in use, and the number of collections
+   needed for a given amount of allocation inversely proportional to
+   the free space.
+
+   The policy is chosen by the environment variable R_GC_POLICY at
+   start-up, or by gcpolicy() at run time. */
+static void AdjustHeapSizeOccupancy(R_size_t size_needed);
+static void AdjustHeapSizeThroughput(R_size_t size_needed);
+
+typedef struct {
+    const char *name;
+    void (*adjust)(R_size_t size_needed);
+    Rboolean timed;		/* needs the CPU time of collections */
+} R_HeapPolicy_t;
+
+static R_HeapPolicy_t R_HeapPolicies[] = {
+    { "occupancy", AdjustHeapSizeOccupancy, FALSE },
+    { "throughput", AdjustHeapSizeThroughput, TRUE },
+    { NULL, NULL, FALSE }
+};
+
+static R_HeapPolicy_t *R_HeapPolicy = R_HeapPolicies;
+static double R_GCTimeTarget = 0.05;
+static double R_GCTimeFrac = 0;	/* smoothed measured fraction */
+static double R_GCFreeRatio = 0;
+
+#define GC_TIME_SCALE_MIN 0.5
+#define GC_TIME_SCALE_MAX 4.0
+#define GC_FREE_RATIO_MIN 0.1
+#define GC_FREE_RATIO_MAX 3.0
+
+static R_HeapPolicy_t *find_heap_policy(const char *name)
+{
+    for (R_HeapPolicy_t *p = R_HeapPolicies; p->name != NULL; p++)
+	if (strcmp(p->name, name) == 0)
+	    return p;
+    return NULL;
+}
+
 static void init_gc_grow_settings()
 {
     char *arg;
@@ -386,6 +437,18 @@ static void init_gc_grow_settings()
 	    R_VGrowIncrFrac = frac;
 	}
     }
+    arg = getenv("R_GC_POLICY");
+    if (arg != NULL) {
+	R_HeapPolicy_t *policy = find_heap_policy(arg);
+	if (policy != NULL)
+	    R_HeapPolicy = policy;
+    }
+    arg = getenv("R_GC_TIME_TARGET");
+    if (arg != NULL) {
+	double frac = atof(arg);
+	if (0.001 <= frac && frac <= 0.5)
+	    R_GCTimeTarget = frac;
+    }
     arg = getenv("R_GC_NGROWINCRFRAC");
     if (arg != NULL) {
 	double frac = atof(arg);
@@ -559,8 +622,11 @@ static struct {
     SEXP OldToNew[NUM_OLD_GENERATIONS];
     SEXPREC OldToNewPeg[NUM_OLD_GENERATIONS];
 #endif
+    SEXP Pinned;
+    SEXPREC PinnedPeg;
     int OldCount[NUM_OLD_GENERATIONS], AllocCount, PageCount;
-    PAGE_HEADER *pages;
+    PAGE_HEADER *pages, *unswept;
+    int SweepReleaseCount;
 } R_GenHeap[NUM_NODE_CLASSES];
 
 static R_size_t R_NodesInUse = 0;
@@ -731,7 +797,8 @@ static R_size_t R_NodesInUse = 0;
 #define CLASS_GET_FREE_NODE(c,s) do { \
   SEXP __n__ = R_GenHeap[c].Free; \
   if (__n__ == R_GenHeap[c].New) { \
-    GetNewPage(c); \
+    if (! SweepPages(c)) \
+      GetNewPage(c); \
     __n__ = R_GenHeap[c].Free; \
   } \
   R_GenHeap[c].Free = NEXT_NODE(__n__); \
@@ -806,6 +873,13 @@ static void DEBUG_CHECK_NODE_COUNTS(char *where)
 		    REprintf("Inconsistent node generation\n");
 	    }
 	}
+	for (s = NEXT_NODE(R_GenHeap[i].Pinned);
+	     s != R_GenHeap[i].Pinned;
+	     s = NEXT_NODE(s)) {
+	    OldCount++;
+	    if (i != NODE_CLASS(s))
+		REprintf("Inconsistent class assignment for node!\n");
+	}
 	REprintf("Class: %d, New = %d, Old = %d, OldToNew = %d, Total = %d\n",
 		 i,
 		 NewCount, OldCount, OldToNewCount,
@@ -920,6 +994,10 @@ static void GetNewPage(int node_class)
     }
 }
 
+/* Release counts used by GC event tracing */
+static double R_PagesReleased = 0;
+static double R_LargeBytesReleased[NUM_NODE_CLASSES];
+
 static void ReleasePage(PAGE_HEADER *page, int node_class)
 {
     SEXP s;
@@ -936,28 +1014,53 @@ static void ReleasePage(PAGE_HEADER *page, int node_class)
 	R_GenHeap[node_class].AllocCount--;
     }
     R_GenHeap[node_class].PageCount--;
+    R_PagesReleased++;
     free(page);
 }
 
-static void TryToReleasePages(void)
+/* Page releases are attempted on every R_PageReleaseFreq-th call. */
+static Rboolean PageReleaseDue(void)
 {
-    SEXP s;
-    int i;
     static int release_count = 0;
 
     if (release_count == 0) {
 	release_count = R_PageReleaseFreq;
+	return TRUE;
+    }
+    else {
+	release_count--;
+	return FALSE;
+    }
+}
+
+/* The number of pages of class i that can be released while keeping
+   R_MaxKeepFrac times the number of nodes in use free. */
+static int MaxReleasablePages(int i)
+{
+    int node_size = NODE_SIZE(i);
+    int page_count = (R_PAGE_SIZE - sizeof(PAGE_HEADER)) / node_size;
+    int maxrel, gen;
+
+    maxrel = R_GenHeap[i].AllocCount;
+    for (gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
+	maxrel -= (1.0 + R_MaxKeepFrac) * R_GenHeap[i].OldCount[gen];
+    return maxrel > 0 ? maxrel / page_count : 0;
+}
+
+static void TryToReleasePages(void)
+{
+    SEXP s;
+    int i;
+
+    if (PageReleaseDue()) {
 	for (i = 0; i < NUM_SMALL_NODE_CLASSES; i++) {
 	    int pages_free = 0;
 	    PAGE_HEADER *page, *last, *next;
 	    int node_size = NODE_SIZE(i);
 	    int page_count = (R_PAGE_SIZE - sizeof(PAGE_HEADER)) / node_size;
-	    int maxrel, maxrel_pages, rel_pages, gen;
+	    int maxrel_pages, rel_pages;
 
-	    maxrel = R_GenHeap[i].AllocCount;
-	    for (gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
-		maxrel -= (1.0 + R_MaxKeepFrac) * R_GenHeap[i].OldCount[gen];
-	    maxrel_pages = maxrel > 0 ? maxrel / page_count : 0;
+	    maxrel_pages = MaxReleasablePages(i);
 
 	    /* all nodes in New space should be both free and unmarked */
 	    for (page = R_GenHeap[i].pages, rel_pages = 0, last = NULL;
@@ -990,7 +1093,6 @@ static void TryToReleasePages(void)
 	    R_GenHeap[i].Free = NEXT_NODE(R_GenHeap[i].New);
 	}
     }
-    else release_count--;
 }
 
 /* compute size in VEC units so result will fit in LENGTH field for FREESXPs */
@@ -1031,6 +1133,262 @@ static R_INLINE R_size_t getVecSizeInVEC(SEXP s)
 
 static void custom_node_free(void *ptr);
 
+/* Large Vector Pool.
+
+   Large vector nodes of at least LARGE_POOL_MIN_SIZE bytes are
+   allocated with mmap in a set of size classes, LARGE_POOL_STEPS to
+   each power of two, instead of with malloc.  The collector returns
+   the blocks of unreachable nodes to a free list for their class, and
+   later allocations reuse them, taking a block at most one doubling
+   larger than needed if none of the right class is free.  This keeps
+   large temporaries that are repeatedly created and discarded from
+   fragmenting the malloc heap.
+
+   A cached block that has not been reused by the end of the next
+   collection has its pages returned to the system with madvise but
+   keeps its address range, so it can still be reused cheaply.  A
+   block that stays unused for LARGE_POOL_MAX_IDLE collections is
+   unmapped.  Blocks larger than the largest class are mapped and
+   unmapped directly.
+
+   Each block starts with a LARGE_BLOCK_HEADER, which is followed by
+   the node.  The first page, holding the header, is never released
+   while the block is cached.  Smaller large nodes are allocated with
+   malloc, but get a header too, with class LARGE_BLOCK_MALLOC, so that
+   a node is freed the way it was allocated without working that out
+   again from its size. */
+
+#if defined(HAVE_MMAP) && ! defined(Win32) && SIZEOF_SIZE_T > 4 && \
+    VALGRIND_LEVEL == 0
+# define LARGE_VECTOR_POOL
+#endif
+
+#ifdef LARGE_VECTOR_POOL
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if ! defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* On Linux MADV_DONTNEED releases the pages at once, which is
+   reflected in the resident set size; MADV_FREE only does so under
+   memory pressure.  Elsewhere MADV_FREE is the one that is acted on. */
+#if defined(__linux__) && defined(MADV_DONTNEED)
+# define LARGE_POOL_ADVICE MADV_DONTNEED
+#elif defined(MADV_FREE)
+# define LARGE_POOL_ADVICE MADV_FREE
+#elif defined(MADV_DONTNEED)
+# define LARGE_POOL_ADVICE MADV_DONTNEED
+#endif
+
+#define LARGE_POOL_MIN_SIZE ((size_t) 1 << 20)
+#define LARGE_POOL_STEPS 4
+#define LARGE_POOL_DOUBLINGS 10
+#define NUM_LARGE_POOL_CLASSES (LARGE_POOL_STEPS * LARGE_POOL_DOUBLINGS + 1)
+#define LARGE_POOL_MAX_SIZE (LARGE_POOL_MIN_SIZE << LARGE_POOL_DOUBLINGS)
+#define LARGE_POOL_MAX_IDLE 20
+#define LARGE_BLOCK_MALLOC -2
+
+typedef union large_block_header {
+    struct {
+	union large_block_header *next;	/* next cached block of the class */
+	size_t size;	/* size of the mapping */
+	int lclass;	/* size class, -1 for an unpooled block or
+			   LARGE_BLOCK_MALLOC */
+	int advised;	/* pages have been returned to the system */
+	int freed_at;	/* value of gc_count when the block was cached */
+    } b;
+    double align;
+} LARGE_BLOCK_HEADER;
+
+static LARGE_BLOCK_HEADER *R_LargePoolFree[NUM_LARGE_POOL_CLASSES];
+static size_t R_LargePoolPageSize = 0;
+
+static struct {
+    R_size_t inuse;	/* bytes mapped for nodes in use */
+    R_size_t cached;	/* bytes mapped for cached blocks */
+    R_size_t resident;	/* cached bytes not yet returned to the system */
+    double mapped, reused, advised, unmapped;	/* block counts */
+} R_LargePoolStats;
+
+static R_INLINE size_t LargePoolClassSize(int c)
+{
+    return (LARGE_POOL_MIN_SIZE << (c / LARGE_POOL_STEPS)) /
+	LARGE_POOL_STEPS * (LARGE_POOL_STEPS + c % LARGE_POOL_STEPS);
+}
+
+static R_INLINE int LargePoolClass(size_t size)
+{
+    if (size > LARGE_POOL_MAX_SIZE)
+	return -1;
+    int c = 0;
+    while (LargePoolClassSize(c) < size)
+	c++;
+    return c;
+}
+
+static R_INLINE Rboolean UseLargePool(size_t bytes)
+{
+    return bytes >= LARGE_POOL_MIN_SIZE;
+}
+
+/* Blocks of at least LARGE_POOL_HUGE_SIZE bytes are aligned to that
+   size, so that where transparent huge pages are available they can
+   be used for the whole block. */
+#define LARGE_POOL_HUGE_SIZE ((size_t) 1 << 21)
+
+static void *LargePoolMap(size_t size)
+{
+    size_t extra = size >= LARGE_POOL_HUGE_SIZE ? LARGE_POOL_HUGE_SIZE : 0;
+    char *mem = mmap(NULL, size + extra, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+	return NULL;
+    if (extra > 0) {
+	size_t lead = (LARGE_POOL_HUGE_SIZE -
+		       (uintptr_t) mem % LARGE_POOL_HUGE_SIZE) %
+	    LARGE_POOL_HUGE_SIZE;
+	if (lead > 0)
+	    munmap(mem, lead);
+	if (extra - lead > 0)
+	    munmap(mem + lead + size, extra - lead);
+	mem += lead;
+#ifdef MADV_HUGEPAGE
+	madvise(mem, size, MADV_HUGEPAGE);
+#endif
+    }
+    return mem;
+}
+
+static void *large_pool_alloc(size_t bytes)
+{
+    LARGE_BLOCK_HEADER *blk;
+    size_t size = bytes + sizeof(LARGE_BLOCK_HEADER);
+    int c = LargePoolClass(size);
+
+    /* use the smallest cached block at most one doubling larger */
+    int fc = c;
+    if (c >= 0)
+	while (fc < NUM_LARGE_POOL_CLASSES && fc <= c + LARGE_POOL_STEPS &&
+	       R_LargePoolFree[fc] == NULL)
+	    fc++;
+    if (c >= 0 && fc < NUM_LARGE_POOL_CLASSES && fc <= c + LARGE_POOL_STEPS) {
+	blk = R_LargePoolFree[fc];
+	R_LargePoolFree[fc] = blk->b.next;
+	R_LargePoolStats.cached -= blk->b.size;
+	if (! blk->b.advised)
+	    R_LargePoolStats.resident -= blk->b.size;
+	R_LargePoolStats.reused++;
+    }
+    else {
+	if (R_LargePoolPageSize == 0)
+	    R_LargePoolPageSize = (size_t) sysconf(_SC_PAGESIZE);
+	if (c >= 0)
+	    size = LargePoolClassSize(c);
+	else if (size > SIZE_MAX - R_LargePoolPageSize)
+	    return NULL;
+	else
+	    size = (size + R_LargePoolPageSize - 1) /
+		R_LargePoolPageSize * R_LargePoolPageSize;
+	blk = LargePoolMap(size);
+	if (blk == NULL)
+	    return NULL;
+	blk->b.size = size;
+	blk->b.lclass = c;
+	R_LargePoolStats.mapped++;
+    }
+    blk->b.next = NULL;
+    blk->b.advised = FALSE;
+    R_LargePoolStats.inuse += blk->b.size;
+    return blk + 1;
+}
+
+static void large_pool_free(void *ptr)
+{
+    LARGE_BLOCK_HEADER *blk = ((LARGE_BLOCK_HEADER *) ptr) - 1;
+    int c = blk->b.lclass;
+
+    R_LargePoolStats.inuse -= blk->b.size;
+    if (c < 0) {
+	munmap(blk, blk->b.size);
+	R_LargePoolStats.unmapped++;
+    }
+    else {
+	blk->b.freed_at = gc_count;
+	blk->b.next = R_LargePoolFree[c];
+	R_LargePoolFree[c] = blk;
+	R_LargePoolStats.cached += blk->b.size;
+	R_LargePoolStats.resident += blk->b.size;
+    }
+}
+
+/* Called at the end of each collection.  With 'all' true every cached
+   block is unmapped; this is used when an allocation fails. */
+static void TrimLargeVectorPool(Rboolean all)
+{
+    for (int c = 0; c < NUM_LARGE_POOL_CLASSES; c++) {
+	LARGE_BLOCK_HEADER **pblk = &R_LargePoolFree[c];
+	while (*pblk != NULL) {
+	    LARGE_BLOCK_HEADER *blk = *pblk;
+	    int idle = gc_count - blk->b.freed_at;
+	    if (all || idle >= LARGE_POOL_MAX_IDLE) {
+		*pblk = blk->b.next;
+		R_LargePoolStats.cached -= blk->b.size;
+		if (! blk->b.advised)
+		    R_LargePoolStats.resident -= blk->b.size;
+		munmap(blk, blk->b.size);
+		R_LargePoolStats.unmapped++;
+		continue;
+	    }
+#ifdef LARGE_POOL_ADVICE
+	    if (idle > 0 && ! blk->b.advised) {
+		char *start = (char *) blk + R_LargePoolPageSize;
+		if (madvise(start, blk->b.size - R_LargePoolPageSize,
+			    LARGE_POOL_ADVICE) == 0) {
+		    blk->b.advised = TRUE;
+		    R_LargePoolStats.resident -= blk->b.size;
+		    R_LargePoolStats.advised++;
+		}
+	    }
+#endif
+	    pblk = &blk->b.next;
+	}
+    }
+}
+#endif
+
+static void *large_vector_alloc(size_t bytes)
+{
+#ifdef LARGE_VECTOR_POOL
+    if (UseLargePool(bytes))
+	return large_pool_alloc(bytes);
+    if (bytes > SIZE_MAX - sizeof(LARGE_BLOCK_HEADER))
+	return NULL;
+    LARGE_BLOCK_HEADER *blk = malloc(sizeof(LARGE_BLOCK_HEADER) + bytes);
+    if (blk == NULL)
+	return NULL;
+    blk->b.lclass = LARGE_BLOCK_MALLOC;
+    return blk + 1;
+#else
+    return malloc(bytes);
+#endif
+}
+
+static void large_vector_free(void *ptr)
+{
+#ifdef LARGE_VECTOR_POOL
+    LARGE_BLOCK_HEADER *blk = ((LARGE_BLOCK_HEADER *) ptr) - 1;
+    if (blk->b.lclass == LARGE_BLOCK_MALLOC)
+	free(blk);
+    else
+	large_pool_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 static void ReleaseLargeFreeVectors()
 {
     for (int node_class = CUSTOM_NODE_CLASS; node_class <= LARGE_NODE_CLASS; node_class++) {
@@ -1050,9 +1408,11 @@ static void ReleaseLargeFreeVectors()
 #endif
 		UNSNAP_NODE(s);
 		R_GenHeap[node_class].AllocCount--;
+		R_LargeBytesReleased[node_class] +=
+		    sizeof(SEXPREC_ALIGN) + size * sizeof(VECREC);
 		if (node_class == LARGE_NODE_CLASS) {
 		    R_LargeVallocSize -= size;
-		    free(s);
+		    large_vector_free(s);
 		} else {
 		    custom_node_free(s);
 		}
@@ -1064,7 +1424,7 @@ static void ReleaseLargeFreeVectors()
 
 /* Heap Size Adjustment. */
 
-static void AdjustHeapSize(R_size_t size_needed)
+static void AdjustHeapSizeOccupancy(R_size_t size_needed)
 {
     R_size_t R_MinNFree = (R_size_t)(orig_R_NSize * R_MinFreeFrac);
     R_size_t R_MinVFree = (R_size_t)(orig_R_VSize * R_MinFreeFrac);
@@ -1123,6 +1483,74 @@ static void AdjustHeapSize(R_size_t size_needed)
     DEBUG_ADJUST_HEAP_PRINT(node_occup, vect_occup);
 }
 
+/* CPU time used by collections since the last full collection, and
+   the CPU time at its start and at the start of the current one. */
+static double gc_cycle_gctime = 0, gc_cycle_start = -1, gc_run_start = 0;
+
+static double gc_cpu_time(void)
+{
+    double times[5];
+    R_getProcTime(times);
+    return times[0] + times[1];
+}
+
+static R_size_t ThroughputHeapSize(R_size_t in_use, R_size_t min_free,
+				   R_size_t min_size, R_size_t max_size)
+{
+    double size = in_use * (1 + R_GCFreeRatio);
+    if (size < (double) in_use + min_free)
+	size = (double) in_use + min_free;
+    if (size < min_size)
+	size = min_size;
+    return size < max_size ? (R_size_t) size : max_size;
+}
+
+static void AdjustHeapSizeThroughput(R_size_t size_needed)
+{
+    double now = gc_cpu_time();
+    if (gc_cycle_start >= 0 && now > gc_cycle_start) {
+	double frac =
+	    (gc_cycle_gctime + now - gc_run_start) / (now - gc_cycle_start);
+	R_GCTimeFrac = R_GCTimeFrac > 0 ? 0.5 * (R_GCTimeFrac + frac) : frac;
+    }
+    gc_cycle_start = now;
+    /* the rest of this collection counts towards the next cycle */
+    gc_cycle_gctime = gc_run_start - now;
+
+    if (R_GCTimeFrac <= 0) {
+	AdjustHeapSizeOccupancy(size_needed);
+	return;
+    }
+
+    double scale = R_GCTimeFrac / R_GCTimeTarget;
+    if (0.8 <= scale && scale <= 1.25)
+	scale = 1;
+    else if (scale < GC_TIME_SCALE_MIN)
+	scale = GC_TIME_SCALE_MIN;
+    else if (scale > GC_TIME_SCALE_MAX)
+	scale = GC_TIME_SCALE_MAX;
+    if (R_GCFreeRatio <= 0)
+	R_GCFreeRatio = 1 / R_NGrowFrac - 1;
+    R_GCFreeRatio *= scale;
+    if (R_GCFreeRatio < GC_FREE_RATIO_MIN)
+	R_GCFreeRatio = GC_FREE_RATIO_MIN;
+    else if (R_GCFreeRatio > GC_FREE_RATIO_MAX)
+	R_GCFreeRatio = GC_FREE_RATIO_MAX;
+
+    R_size_t R_MinNFree = (R_size_t)(orig_R_NSize * R_MinFreeFrac);
+    R_size_t R_MinVFree = (R_size_t)(orig_R_VSize * R_MinFreeFrac);
+    R_size_t VInUse = R_SmallVallocSize + R_LargeVallocSize + size_needed;
+    R_NSize = ThroughputHeapSize(R_NodesInUse, R_MinNFree,
+				 orig_R_NSize, R_MaxNSize);
+    R_VSize = ThroughputHeapSize(VInUse, R_MinVFree,
+				 orig_R_VSize, R_MaxVSize);
+}
+
+static void AdjustHeapSize(R_size_t size_needed)
+{
+    R_HeapPolicy->adjust(size_needed);
+}
+
 
 /* Managing Old-to-New References. */
 
@@ -1166,6 +1594,37 @@ static void old_to_new(SEXP x, SEXP y)
 #endif
 }
 
+
+/* Large Vectors in Forked Processes.
+
+   A forked child shares its parent's memory copy-on-write until one of
+   them writes to a page.  The header of a large vector is at the start
+   of its allocation, and a collection in the child that unmarks,
+   relinks and re-marks every old node would copy at least one page per
+   large vector, and with transparent huge pages much more.
+
+   R_PinLargeVectors, called in the child just after the fork, moves
+   the old large and custom-allocated vectors onto per-class pinned
+   lists.  This relinks whole lists at once, so only the first and last
+   nodes of each list are written.  Pinned nodes are never unmarked:
+   old nodes are already marked, so no side mark table is needed.  When
+   their generation is collected the collector only reads them,
+   counting them as live and forwarding their children (attributes and
+   list or string elements).  A pinned node that is given a reference
+   to a newer node by the write barrier, or that is aged through an
+   older node, is unsnapped by the usual code and returns to the
+   generation lists.  The cost is that inherited vectors the child no
+   longer uses are not reclaimed before it exits; their memory is
+   still in use by the parent. */
+
+void R_PinLargeVectors(void)
+{
+    for (int i = CUSTOM_NODE_CLASS; i <= LARGE_NODE_CLASS; i++)
+	for (int gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
+	    if (NEXT_NODE(R_GenHeap[i].Old[gen]) != R_GenHeap[i].Old[gen])
+		BULK_MOVE(R_GenHeap[i].Old[gen], R_GenHeap[i].Pinned);
+}
+
 #ifdef COMPUTE_REFCNT_VALUES
 #define FIX_REFCNT(x, old, new) do {					\
 	if (TRACKREFS(x)) {						\
@@ -1194,7 +1653,10 @@ static void old_to_new(SEXP x, SEXP y)
 */
 
 #define SORT_NODES
-#ifdef SORT_NODES
+#ifndef PROTECTCHECK
+# define LAZY_SWEEP /* see below */
+#endif
+#if defined(SORT_NODES) && ! defined(LAZY_SWEEP)
 static void SortNodes(void)
 {
     SEXP s;
@@ -1223,6 +1685,121 @@ static void SortNodes(void)
 #endif
 
 
+/* Lazy Sweeping.  After a full collection the free lists of the small
+   node classes are not rebuilt during the collection pause.  Instead
+   the pages of each class are put on an unswept list and the free
+   list is emptied.  When allocation in a class runs out of free nodes
+   the next unswept page is swept: its unmarked nodes are added to the
+   free list, in page order as SortNodes would do, or, if none of its
+   nodes are in use and the page release policy allows it, the page is
+   returned to malloc.  Only when no unswept pages are left is a new
+   page obtained.
+
+   Nodes on unswept pages that are not in use are on no list at all.
+   This is safe as long as no node on an unswept page becomes
+   unmarked, which happens only in collections of level one or
+   higher; any remaining pages are therefore swept at the start of
+   such collections.  Level zero collections leave the sweep state
+   alone.  With PROTECTCHECK free nodes need to be on the New lists
+   at all times, so the eager SortNodes is used instead. */
+
+#ifdef LAZY_SWEEP
+/* Sweep the first unswept page of node_class; return the number of
+   free nodes added to the free list. */
+static int SweepPage(int node_class)
+{
+    PAGE_HEADER *page = R_GenHeap[node_class].unswept;
+    int node_size = NODE_SIZE(node_class);
+    int page_count = (R_PAGE_SIZE - sizeof(PAGE_HEADER)) / node_size;
+    SEXP s, base = R_GenHeap[node_class].New, first = NULL;
+    char *data;
+    int i, nfree = 0;
+
+    R_GenHeap[node_class].unswept = page->next;
+
+    if (R_GenHeap[node_class].SweepReleaseCount > 0) {
+	Rboolean in_use = FALSE;
+	for (i = 0, data = PAGE_DATA(page); i < page_count;
+	     i++, data += node_size)
+	    if (NODE_IS_MARKED((SEXP) data)) {
+		in_use = TRUE;
+		break;
+	    }
+	if (! in_use) {
+	    /* none of the nodes are on a list, so no unsnapping needed */
+	    R_GenHeap[node_class].AllocCount -= page_count;
+	    R_GenHeap[node_class].PageCount--;
+	    R_GenHeap[node_class].SweepReleaseCount--;
+	    R_PagesReleased++;
+	    free(page);
+	    return 0;
+	}
+    }
+
+    page->next = R_GenHeap[node_class].pages;
+    R_GenHeap[node_class].pages = page;
+    for (i = 0, data = PAGE_DATA(page); i < page_count;
+	 i++, data += node_size) {
+	s = (SEXP) data;
+	if (! NODE_IS_MARKED(s)) {
+	    SNAP_NODE(s, base);
+	    if (first == NULL)
+		first = s;
+	    nfree++;
+	}
+    }
+    if (R_GenHeap[node_class].Free == base && first != NULL)
+	R_GenHeap[node_class].Free = first;
+    return nfree;
+}
+#endif
+
+/* Sweep unswept pages of node_class until some free nodes are
+   available; returns FALSE if a new page is needed. */
+static Rboolean SweepPages(int node_class)
+{
+#ifdef LAZY_SWEEP
+    while (R_GenHeap[node_class].unswept != NULL)
+	if (SweepPage(node_class) > 0)
+	    return TRUE;
+#endif
+    return FALSE;
+}
+
+static void FinishLazySweep(void)
+{
+#ifdef LAZY_SWEEP
+    for (int i = 0; i < NUM_SMALL_NODE_CLASSES; i++) {
+	while (R_GenHeap[i].unswept != NULL)
+	    SweepPage(i);
+	R_GenHeap[i].SweepReleaseCount = 0;
+    }
+#endif
+}
+
+#ifdef LAZY_SWEEP
+/* Called at the end of a full collection in place of TryToReleasePages
+   and SortNodes. */
+static void StartLazySweep(void)
+{
+    Rboolean release = PageReleaseDue();
+
+    for (int i = 0; i < NUM_SMALL_NODE_CLASSES; i++) {
+	R_GenHeap[i].SweepReleaseCount = release ? MaxReleasablePages(i) : 0;
+
+	/* all nodes on the New list are free after a full collection;
+	   the sweep will put them back */
+	SET_NEXT_NODE(R_GenHeap[i].New, R_GenHeap[i].New);
+	SET_PREV_NODE(R_GenHeap[i].New, R_GenHeap[i].New);
+	R_GenHeap[i].Free = R_GenHeap[i].New;
+
+	R_GenHeap[i].unswept = R_GenHeap[i].pages;
+	R_GenHeap[i].pages = NULL;
+    }
+}
+#endif
+
+
 /* Finalization and Weak References */
 
 /* The design of this mechanism is very close to the one described in
@@ -1549,14 +2126,453 @@ SEXP attribute_hidden do_regFinaliz(SEXP call, SEXP op, SEXP args, SEXP rho)
     } \
 } while (0)
 
+
+/* Parallel Marking.  On builds with OpenMP support the main marking
+   pass of a full collection can be shared among several threads.  The
+   number of threads is taken from the environment variable
+   R_GC_MARK_THREADS at startup; the default of one uses the
+   sequential PROCESS_NODES loop.
+
+   The forwarding list relies on unsnapping nodes from the generation
+   lists as they are marked, and this cannot be done concurrently.
+   Instead the mark bit is set atomically and newly marked nodes are
+   pushed on per-thread mark stacks.  Each stack has a private part,
+   used without locking, and a shared part that other threads steal
+   from when they run out of work.  Nodes stay on their New lists
+   while marking proceeds; every thread records the nodes it has
+   scanned, and these are moved to their old generations sequentially
+   once all stacks are empty.  If memory for the stacks or records
+   cannot be obtained the marks are kept and all marked nodes still
+   on the New lists are handed back to PROCESS_NODES, which completes
+   the marking sequentially.  Weak references, the CHARSXP cache,
+   finalization and sweeping are handled as before.
+
+   The GNU OpenMP runtime does not survive a fork once its thread
+   pool has been started: a parallel region in the child waits for
+   threads that do not exist.  Forked children, such as those of the
+   parallel package, therefore always mark sequentially. */
+
+#if defined(_OPENMP) && ! defined(PROTECTCHECK)
+# define PARALLEL_MARK
+#endif
+
+#define MAX_GC_MARK_THREADS 64
+static int R_GCMarkThreads = 1;
+
+#ifdef PARALLEL_MARK
+#include <omp.h>
+
+/* the bit of the first sxpinfo word that holds the mark; zero if the
+   layout does not allow the mark to be set atomically */
+static unsigned int mark_bit_mask = 0;
+
+#define MARK_LOCAL_SIZE 256
+#define MARK_CHUNK_SIZE 1022
+
+typedef struct mark_chunk {
+    struct mark_chunk *next;
+    int count;
+    SEXP nodes[MARK_CHUNK_SIZE];
+} mark_chunk;
+
+typedef struct {
+    SEXP local[MARK_LOCAL_SIZE];    /* private part of the stack */
+    int nlocal;
+    SEXP *shared;                   /* stealable part, guarded by lock */
+    R_size_t nshared, shared_size;
+    omp_lock_t lock;
+    mark_chunk *scanned;            /* nodes scanned by this thread */
+    Rboolean failed;
+} mark_thread_t;
+
+static void init_parallel_mark(void)
+{
+    SEXPREC tmp;
+    unsigned int word;
+
+    memset(&tmp, 0, sizeof(tmp));
+    MARK_NODE(&tmp);
+    memcpy(&word, &tmp.sxpinfo, sizeof(word));
+    mark_bit_mask = word;
+}
+
+static R_INLINE Rboolean mark_node_atomic(SEXP s)
+{
+    unsigned int *w = (unsigned int *) &s->sxpinfo;
+    unsigned int old;
+#pragma omp atomic read
+    old = *w;
+    if (old & mark_bit_mask)
+	return FALSE;
+#pragma omp atomic capture
+    { old = *w; *w |= mark_bit_mask; }
+    return (old & mark_bit_mask) == 0;
+}
+
+static R_INLINE void unmark_node_atomic(SEXP s)
+{
+    unsigned int *w = (unsigned int *) &s->sxpinfo;
+#pragma omp atomic update
+    *w &= ~mark_bit_mask;
+}
+
+static R_INLINE R_size_t mark_shared_count(mark_thread_t *t)
+{
+    R_size_t n;
+#pragma omp atomic read
+    n = t->nshared;
+    return n;
+}
+
+/* Move the older half of the private stack to the shared part. */
+static Rboolean mark_spill(mark_thread_t *t)
+{
+    int half = MARK_LOCAL_SIZE / 2;
+    Rboolean ok = TRUE;
+
+    omp_set_lock(&t->lock);
+    if (t->nshared + half > t->shared_size) {
+	R_size_t size = t->shared_size ? 2 * t->shared_size : 4096;
+	SEXP *shared = realloc(t->shared, size * sizeof(SEXP));
+	if (shared != NULL) {
+	    t->shared = shared;
+	    t->shared_size = size;
+	}
+	else ok = FALSE;
+    }
+    if (ok) {
+	memcpy(t->shared + t->nshared, t->local, half * sizeof(SEXP));
+#pragma omp atomic
+	t->nshared += half;
+    }
+    omp_unset_lock(&t->lock);
+
+    if (ok) {
+	memmove(t->local, t->local + half,
+		(MARK_LOCAL_SIZE - half) * sizeof(SEXP));
+	t->nlocal -= half;
+    }
+    return ok;
+}
+
+/* Move up to half of the shared part of v's stack (all of it if v is
+   the caller's own stack) to the private part of t's stack. */
+static Rboolean mark_take(mark_thread_t *t, mark_thread_t *v)
+{
+    R_size_t n;
+
+    if (mark_shared_count(v) == 0)
+	return FALSE;
+    omp_set_lock(&v->lock);
+    n = (v == t || v->nshared < 2) ? v->nshared : v->nshared / 2;
+    if (n > MARK_LOCAL_SIZE)
+	n = MARK_LOCAL_SIZE;
+    if (n > 0) {
+	R_size_t m = v->nshared - n;
+	memcpy(t->local, v->shared + m, n * sizeof(SEXP));
+#pragma omp atomic write
+	v->nshared = m;
+    }
+    omp_unset_lock(&v->lock);
+    t->nlocal = (int) n;
+    return n > 0;
+}
+
+static R_INLINE void mark_push(mark_thread_t *t, SEXP s)
+{
+    if (t->nlocal == MARK_LOCAL_SIZE && ! mark_spill(t)) {
+	/* leave the node unmarked; its parent is still marked and on a
+	   New list, so the sequential fallback will find it */
+	unmark_node_atomic(s);
+	t->failed = TRUE;
+	return;
+    }
+    t->local[t->nlocal++] = s;
+}
+
+static R_INLINE void mark_record(mark_thread_t *t, SEXP s)
+{
+    mark_chunk *c = t->scanned;
+    if (c == NULL || c->count == MARK_CHUNK_SIZE) {
+	c = malloc(sizeof(mark_chunk));
+	if (c == NULL) {
+	    t->failed = TRUE;
+	    return;
+	}
+	c->count = 0;
+	c->next = t->scanned;
+	t->scanned = c;
+    }
+    c->nodes[c->count++] = s;
+}
+
+#define PM_FORWARD_NODE(__n__,__t__) do { \
+  SEXP pm__n__ = (__n__); \
+  if (pm__n__ && mark_node_atomic(pm__n__)) \
+    mark_push(__t__, pm__n__); \
+} while (0)
+
+static void ParallelMarkWorker(mark_thread_t *threads, int nthreads,
+			       int *idle)
+{
+    mark_thread_t *t = threads + omp_get_thread_num();
+    int victim = omp_get_thread_num();
+
+    for (;;) {
+	while (t->nlocal > 0 || mark_take(t, t)) {
+	    SEXP s = t->local[--t->nlocal];
+	    if (! t->failed)
+		mark_record(t, s);
+	    DO_CHILDREN(s, PM_FORWARD_NODE, t);
+	}
+
+	/* out of work: try to steal, or stop once every thread is idle */
+	int nidle;
+#pragma omp atomic capture
+	nidle = ++(*idle);
+	while (nidle < nthreads) {
+	    Rboolean found = FALSE;
+	    for (int i = 0; i < nthreads; i++) {
+		victim = (victim + 1) % nthreads;
+		if (mark_shared_count(threads + victim) > 0) {
+		    found = TRUE;
+		    break;
+		}
+	    }
+	    if (found) {
+#pragma omp atomic update
+		(*idle)--;
+		if (mark_take(t, threads + victim))
+		    break;
+#pragma omp atomic capture
+		nidle = ++(*idle);
+	    }
+	    else {
+#pragma omp atomic read
+		nidle = *idle;
+	    }
+	}
+	if (t->nlocal == 0)
+	    return;
+    }
+}
+
+/* Mark everything reachable from the nodes on the forwarding list.
+   Returns the list of nodes that still need to be processed by
+   PROCESS_NODES; this is empty unless memory ran out. */
+static SEXP ParallelProcessNodes(SEXP forwarded_nodes)
+{
+    int nthreads = R_GCMarkThreads, idle = 0, i;
+    Rboolean failed = FALSE;
+    mark_thread_t *threads;
+    SEXP s;
+
+    threads = calloc(nthreads, sizeof(mark_thread_t));
+    if (threads == NULL)
+	return forwarded_nodes;
+    for (i = 0; i < nthreads; i++)
+	omp_init_lock(&threads[i].lock);
+
+    /* put the roots back on the New lists, still marked, and seed the
+       first thread's shared stack with them */
+    while (forwarded_nodes != NULL) {
+	s = forwarded_nodes;
+	forwarded_nodes = NEXT_NODE(forwarded_nodes);
+	SNAP_NODE(s, R_GenHeap[NODE_CLASS(s)].New);
+	if (threads[0].nshared == threads[0].shared_size) {
+	    R_size_t size = threads[0].shared_size ?
+		2 * threads[0].shared_size : 4096;
+	    SEXP *shared = realloc(threads[0].shared, size * sizeof(SEXP));
+	    if (shared == NULL) {
+		failed = TRUE;
+		break;
+	    }
+	    threads[0].shared = shared;
+	    threads[0].shared_size = size;
+	}
+	threads[0].shared[threads[0].nshared++] = s;
+    }
+
+    if (! failed) {
+#pragma omp parallel num_threads(nthreads) default(none) \
+    shared(threads, idle)
+	ParallelMarkWorker(threads, omp_get_num_threads(), &idle);
+    }
+
+    for (i = 0; i < nthreads; i++)
+	if (threads[i].failed)
+	    failed = TRUE;
+
+    /* move the scanned nodes to their old generations */
+    for (i = 0; i < nthreads; i++) {
+	mark_chunk *c = threads[i].scanned;
+	while (c != NULL) {
+	    mark_chunk *next = c->next;
+	    if (! failed)
+		for (int j = 0; j < c->count; j++) {
+		    s = c->nodes[j];
+		    UNSNAP_NODE(s);
+		    SNAP_NODE(s, R_GenHeap[NODE_CLASS(s)].Old[NODE_GENERATION(s)]);
+		    R_GenHeap[NODE_CLASS(s)].OldCount[NODE_GENERATION(s)]++;
+		}
+	    free(c);
+	    c = next;
+	}
+	free(threads[i].shared);
+	omp_destroy_lock(&threads[i].lock);
+    }
+    free(threads);
+
+    if (failed) {
+	/* hand all marked nodes still on the New lists, including any
+	   roots not yet seeded, back to the sequential loop */
+	for (i = 0; i < NUM_NODE_CLASSES; i++) {
+	    s = NEXT_NODE(R_GenHeap[i].New);
+	    while (s != R_GenHeap[i].New) {
+		SEXP next = NEXT_NODE(s);
+		if (NODE_IS_MARKED(s)) {
+		    UNSNAP_NODE(s);
+		    SET_NEXT_NODE(s, forwarded_nodes);
+		    forwarded_nodes = s;
+		}
+		s = next;
+	    }
+	}
+    }
+    return forwarded_nodes;
+}
+#endif
+
+static void init_gc_mark_threads(void)
+{
+    char *arg = getenv("R_GC_MARK_THREADS");
+    if (arg != NULL) {
+	int n = atoi(arg);
+	if (n >= 1)
+	    R_GCMarkThreads = n < MAX_GC_MARK_THREADS ?
+		n : MAX_GC_MARK_THREADS;
+    }
+#ifdef PARALLEL_MARK
+    init_parallel_mark();
+    if (mark_bit_mask == 0 || (mark_bit_mask & (mark_bit_mask - 1)))
+	R_GCMarkThreads = 1;
+#else
+    R_GCMarkThreads = 1;
+#endif
+}
+
+/* GC Event Tracing.
+
+   When tracing is on RunGenCollect fills in a gc_event_t for each
+   collection.  The most recent R_GCTraceSize events are kept in a ring
+   buffer that gcevents() returns as a data frame, and each event can
+   also be appended as a line of comma-separated values to a file, so
+   collections can be related to pauses seen in a running process.
+
+   Nodes reclaimed are computed per node class as the number in use
+   before the collection less the number in the old generations after
+   it.  Bytes reclaimed for the large and custom classes are counted
+   as vectors are released.  Pages released are those returned since
+   the previous event, which with lazy sweeping includes pages released
+   while sweeping after that collection. */
+
+typedef struct {
+    double count, time, mark, sweep;
+    int level;
+    double nodes[NUM_NODE_CLASSES], bytes[NUM_NODE_CLASSES];
+    double pages, nsize, vsize, ngrow, vgrow;
+} gc_event_t;
+
+static const char *gc_event_class_names[NUM_NODE_CLASSES] = {
+    "cons", "vec8", "vec16", "vec32", "vec64", "vec128", "custom", "large"
+};
+
+static gc_event_t *R_GCTraceBuffer = NULL;
+static int R_GCTraceSize = 0;		/* capacity of the ring buffer */
+static int R_GCTraceCount = 0;		/* number of events in the buffer */
+static int R_GCTraceNext = 0;		/* slot for the next event */
+static FILE *R_GCTraceFile = NULL;
+static double R_GCTracePages = 0;	/* R_PagesReleased at the last event */
+
+#define GC_TRACING() (R_GCTraceSize > 0 || R_GCTraceFile != NULL)
+
+static void gc_trace_begin(gc_event_t *event)
+{
+    memset(event, 0, sizeof(gc_event_t));
+    event->time = currentTime();
+    for (int i = 0; i < NUM_NODE_CLASSES; i++) {
+	/* nodes allocated since the last collection precede Free */
+	double n = 0;
+	for (SEXP s = NEXT_NODE(R_GenHeap[i].New);
+	     s != R_GenHeap[i].Free; s = NEXT_NODE(s))
+	    n++;
+	for (int gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
+	    n += R_GenHeap[i].OldCount[gen];
+	event->nodes[i] = n;
+	R_LargeBytesReleased[i] = 0;
+    }
+}
+
+static void gc_trace_write(gc_event_t *event)
+{
+    int i;
+    fprintf(R_GCTraceFile, "%.0f,%.6f,%d,%.6f,%.6f", event->count,
+	    event->time, event->level, event->mark, event->sweep);
+    for (i = 0; i < NUM_NODE_CLASSES; i++)
+	fprintf(R_GCTraceFile, ",%.0f", event->nodes[i]);
+    for (i = 0; i < NUM_NODE_CLASSES; i++)
+	fprintf(R_GCTraceFile, ",%.0f", event->bytes[i]);
+    fprintf(R_GCTraceFile, ",%.0f,%.0f,%.0f,%.0f,%.0f\n", event->pages,
+	    event->nsize, event->vsize, event->ngrow, event->vgrow);
+    fflush(R_GCTraceFile);
+}
+
+static void gc_trace_end(gc_event_t *event, int level)
+{
+    event->count = gc_count;
+    event->level = level;
+    event->sweep = currentTime() - event->time - event->mark;
+    for (int i = 0; i < NUM_NODE_CLASSES; i++) {
+	for (int gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
+	    event->nodes[i] -= R_GenHeap[i].OldCount[gen];
+	if (i == 0)
+	    event->bytes[i] = event->nodes[i] * sizeof(SEXPREC);
+	else if (i < NUM_SMALL_NODE_CLASSES)
+	    event->bytes[i] = event->nodes[i] *
+		(sizeof(SEXPREC_ALIGN) + NodeClassSize[i] * sizeof(VECREC));
+	else
+	    event->bytes[i] = R_LargeBytesReleased[i];
+    }
+    event->pages = R_PagesReleased - R_GCTracePages;
+    R_GCTracePages = R_PagesReleased;
+    event->nsize = R_NSize;
+    event->vsize = R_VSize;
+
+    if (R_GCTraceSize > 0) {
+	R_GCTraceBuffer[R_GCTraceNext] = *event;
+	R_GCTraceNext = (R_GCTraceNext + 1) % R_GCTraceSize;
+	if (R_GCTraceCount < R_GCTraceSize)
+	    R_GCTraceCount++;
+    }
+    if (R_GCTraceFile != NULL)
+	gc_trace_write(event);
+}
+
 static void RunGenCollect(R_size_t size_needed)
 {
     int i, gen, gens_collected;
     RCNTXT *ctxt;
     SEXP s;
     SEXP forwarded_nodes;
+    gc_event_t event;
+    Rboolean tracing = GC_TRACING();
+    double mark_start = 0;
 
     bad_sexp_type_seen = 0;
+    /* nodes freed here may be reused: invalidate lookup caches */
+    R_LookupEpoch++;
+    if (tracing)
+	gc_trace_begin(&event);
 
     /* determine number of generations to collect */
     while (num_old_gens_to_collect < NUM_OLD_GENERATIONS) {
@@ -1575,6 +2591,12 @@ static void RunGenCollect(R_size_t size_needed)
  again:
     gens_collected = num_old_gens_to_collect;
 
+    /* pages not yet swept must be swept before nodes can be unmarked */
+    if (num_old_gens_to_collect > 0)
+	FinishLazySweep();
+    if (tracing)
+	mark_start = currentTime();
+
 #ifndef EXPEL_OLD_TO_NEW
     /* eliminate old-to-new references in generations to collect by
        transferring referenced nodes to referring generation */
@@ -1616,6 +2638,20 @@ static void RunGenCollect(R_size_t size_needed)
 
     forwarded_nodes = NULL;
 
+    /* pinned nodes stay marked and are treated as live; their children
+       are forwarded, and they are counted, without touching their
+       headers */
+    for (i = CUSTOM_NODE_CLASS; i <= LARGE_NODE_CLASS; i++)
+	for (s = NEXT_NODE(R_GenHeap[i].Pinned);
+	     s != R_GenHeap[i].Pinned;
+	     s = NEXT_NODE(s)) {
+	    gen = NODE_GENERATION(s);
+	    if (gen < num_old_gens_to_collect) {
+		R_GenHeap[i].OldCount[gen]++;
+		FORWARD_CHILDREN(s);
+	    }
+	}
+
 #ifndef EXPEL_OLD_TO_NEW
     /* scan nodes in uncollected old generations with old-to-new pointers */
     for (gen = num_old_gens_to_collect; gen < NUM_OLD_GENERATIONS; gen++)
@@ -1713,6 +2749,11 @@ static void RunGenCollect(R_size_t size_needed)
     FORWARD_NODE(R_CachedScalarInteger);
 
     /* main processing loop */
+#ifdef PARALLEL_MARK
+    if (R_GCMarkThreads > 1 && ! R_isForkedChild &&
+	gens_collected == NUM_OLD_GENERATIONS)
+	forwarded_nodes = ParallelProcessNodes(forwarded_nodes);
+#endif
     PROCESS_NODES();
 
     /* identify weakly reachable nodes */
@@ -1779,6 +2820,9 @@ static void RunGenCollect(R_size_t size_needed)
     FORWARD_NODE(R_StringHash);
     PROCESS_NODES();
 
+    if (tracing)
+	event.mark += currentTime() - mark_start;
+
 #ifdef PROTECTCHECK
     for(i=0; i< NUM_SMALL_NODE_CLASSES;i++){
 	s = NEXT_NODE(R_GenHeap[i].New);
@@ -1823,6 +2867,9 @@ static void RunGenCollect(R_size_t size_needed)
 
     /* release large vector allocations */
     ReleaseLargeFreeVectors();
+#ifdef LARGE_VECTOR_POOL
+    TrimLargeVectorPool(FALSE);
+#endif
 
     DEBUG_CHECK_NODE_COUNTS("after releasing large allocated nodes");
 
@@ -1869,15 +2916,23 @@ static void RunGenCollect(R_size_t size_needed)
 
     if (gens_collected == NUM_OLD_GENERATIONS) {
 	/**** do some adjustment for intermediate collections? */
+	R_size_t old_nsize = R_NSize, old_vsize = R_VSize;
 	AdjustHeapSize(size_needed);
+	event.ngrow = (double) R_NSize - (double) old_nsize;
+	event.vgrow = (double) R_VSize - (double) old_vsize;
+#ifdef LAZY_SWEEP
+	/* page release is done while sweeping */
+	StartLazySweep();
+#else
 	TryToReleasePages();
+#endif
 	DEBUG_CHECK_NODE_COUNTS("after heap adjustment");
     }
     else if (gens_collected > 0) {
 	TryToReleasePages();
 	DEBUG_CHECK_NODE_COUNTS("after heap adjustment");
     }
-#ifdef SORT_NODES
+#if defined(SORT_NODES) && ! defined(LAZY_SWEEP)
     if (gens_collected == NUM_OLD_GENERATIONS)
 	SortNodes();
 #endif
@@ -1886,6 +2941,9 @@ static void RunGenCollect(R_size_t size_needed)
 	    (R_check_constants > 1 && gens_collected == NUM_OLD_GENERATIONS))
 	R_checkConstants(TRUE);
 
+    if (tracing)
+	gc_trace_end(&event, gens_collected);
+
     if (gc_reporting) {
 	REprintf("Garbage collection %d = %d", gc_count, gen_gc_counts[0]);
 	for (i = 0; i < NUM_OLD_GENERATIONS; i++)
@@ -1986,6 +3044,166 @@ SEXP attribute_hidden do_gcinfo(SEXP call, SEXP op, SEXP args, SEXP rho)
     return old;
 }
 
+/* gcpolicy(policy, target) sets the heap sizing policy and its target
+   fraction of time in the collector; NULL arguments leave the setting
+   unchanged.  The previous settings are returned. */
+SEXP attribute_hidden do_gcpolicy(SEXP call, SEXP op, SEXP args, SEXP rho)
+{
+    SEXP spolicy, starget, value, names;
+    R_HeapPolicy_t *policy = R_HeapPolicy;
+    double target = R_GCTimeTarget;
+
+    checkArity(op, args);
+    spolicy = CAR(args);
+    starget = CADR(args);
+    if (spolicy != R_NilValue) {
+	if (!isString(spolicy) || LENGTH(spolicy) != 1 ||
+	    STRING_ELT(spolicy, 0) == NA_STRING ||
+	    (policy = find_heap_policy(CHAR(STRING_ELT(spolicy, 0)))) == NULL)
+	    error(_("invalid '%s' argument"), "policy");
+    }
+    if (starget != R_NilValue) {
+	target = asReal(starget);
+	if (!R_FINITE(target) || target < 0.001 || target > 0.5)
+	    error(_("'%s' must be between %g and %g"), "target", 0.001, 0.5);
+    }
+
+    PROTECT(value = allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(value, 0, mkString(R_HeapPolicy->name));
+    SET_VECTOR_ELT(value, 1, ScalarReal(R_GCTimeTarget));
+    SET_VECTOR_ELT(value, 2, ScalarReal(R_HeapPolicy->timed ?
+					R_GCTimeFrac : NA_REAL));
+    PROTECT(names = allocVector(STRSXP, 3));
+    SET_STRING_ELT(names, 0, mkChar("policy"));
+    SET_STRING_ELT(names, 1, mkChar("target"));
+    SET_STRING_ELT(names, 2, mkChar("time.fraction"));
+    setAttrib(value, R_NamesSymbol, names);
+
+    if (policy != R_HeapPolicy) {
+	/* start measuring afresh */
+	R_GCTimeFrac = 0;
+	R_GCFreeRatio = 0;
+	gc_cycle_gctime = 0;
+	gc_cycle_start = -1;
+	R_HeapPolicy = policy;
+    }
+    R_GCTimeTarget = target;
+    UNPROTECT(2);
+    return value;
+}
+
+/* gctrace(size, file) starts or stops tracing of collections, and
+   returns the previous size of the ring buffer. */
+SEXP attribute_hidden do_gctrace(SEXP call, SEXP op, SEXP args, SEXP rho)
+{
+    SEXP file;
+    int size, old = R_GCTraceSize;
+
+    checkArity(op, args);
+    size = asInteger(CAR(args));
+    if (size == NA_INTEGER || size < 0)
+	error(_("invalid '%s' argument"), "size");
+    file = CADR(args);
+    if (!isString(file) || LENGTH(file) != 1 ||
+	STRING_ELT(file, 0) == NA_STRING)
+	error(_("invalid '%s' argument"), "file");
+
+    if (R_GCTraceFile != NULL) {
+	fclose(R_GCTraceFile);
+	R_GCTraceFile = NULL;
+    }
+    if (size != R_GCTraceSize) {
+	gc_event_t *buf = NULL;
+	if (size > 0) {
+	    buf = malloc(size * sizeof(gc_event_t));
+	    if (buf == NULL)
+		error(_("cannot allocate buffer for GC events"));
+	}
+	free(R_GCTraceBuffer);
+	R_GCTraceBuffer = buf;
+	R_GCTraceSize = size;
+	R_GCTraceCount = R_GCTraceNext = 0;
+    }
+    if (LENGTH(STRING_ELT(file, 0))) {
+	FILE *fp = RC_fopen(STRING_ELT(file, 0), "a", TRUE);
+	if (fp == NULL)
+	    error(_("cannot open file '%s': %s"),
+		  translateChar(STRING_ELT(file, 0)), strerror(errno));
+	if (ftell(fp) == 0) {
+	    int i;
+	    fprintf(fp, "count,time,level,mark,sweep");
+	    for (i = 0; i < NUM_NODE_CLASSES; i++)
+		fprintf(fp, ",nodes.%s", gc_event_class_names[i]);
+	    for (i = 0; i < NUM_NODE_CLASSES; i++)
+		fprintf(fp, ",bytes.%s", gc_event_class_names[i]);
+	    fprintf(fp, ",pages,ncells.trigger,vcells.trigger,"
+		    "ncells.grow,vcells.grow\n");
+	    fflush(fp);
+	}
+	R_GCTraceFile = fp;
+    }
+    R_GCTracePages = R_PagesReleased;
+    return ScalarInteger(old);
+}
+
+/* gcevents() returns the events in the ring buffer, oldest first, as
+   a named list of columns. */
+SEXP attribute_hidden do_gcevents(SEXP call, SEXP op, SEXP args, SEXP rho)
+{
+    int i, j, k, n = R_GCTraceCount;
+    int ncol = 5 + 2 * NUM_NODE_CLASSES + 5;
+    SEXP value, names;
+    char buf[20];
+
+    checkArity(op, args);
+    PROTECT(value = allocVector(VECSXP, ncol));
+    PROTECT(names = allocVector(STRSXP, ncol));
+    for (j = 0; j < ncol; j++)
+	SET_VECTOR_ELT(value, j, allocVector(j == 2 ? INTSXP : REALSXP, n));
+    k = 0;
+    SET_STRING_ELT(names, k++, mkChar("count"));
+    SET_STRING_ELT(names, k++, mkChar("time"));
+    SET_STRING_ELT(names, k++, mkChar("level"));
+    SET_STRING_ELT(names, k++, mkChar("mark"));
+    SET_STRING_ELT(names, k++, mkChar("sweep"));
+    for (j = 0; j < NUM_NODE_CLASSES; j++) {
+	snprintf(buf, 20, "nodes.%s", gc_event_class_names[j]);
+	SET_STRING_ELT(names, k++, mkChar(buf));
+    }
+    for (j = 0; j < NUM_NODE_CLASSES; j++) {
+	snprintf(buf, 20, "bytes.%s", gc_event_class_names[j]);
+	SET_STRING_ELT(names, k++, mkChar(buf));
+    }
+    SET_STRING_ELT(names, k++, mkChar("pages"));
+    SET_STRING_ELT(names, k++, mkChar("ncells.trigger"));
+    SET_STRING_ELT(names, k++, mkChar("vcells.trigger"));
+    SET_STRING_ELT(names, k++, mkChar("ncells.grow"));
+    SET_STRING_ELT(names, k++, mkChar("vcells.grow"));
+    setAttrib(value, R_NamesSymbol, names);
+
+    for (i = 0; i < n; i++) {
+	gc_event_t *e = R_GCTraceBuffer +
+	    (R_GCTraceNext - n + i + R_GCTraceSize) % R_GCTraceSize;
+	k = 0;
+	REAL(VECTOR_ELT(value, k++))[i] = e->count;
+	REAL(VECTOR_ELT(value, k++))[i] = e->time;
+	INTEGER(VECTOR_ELT(value, k++))[i] = e->level;
+	REAL(VECTOR_ELT(value, k++))[i] = e->mark;
+	REAL(VECTOR_ELT(value, k++))[i] = e->sweep;
+	for (j = 0; j < NUM_NODE_CLASSES; j++)
+	    REAL(VECTOR_ELT(value, k++))[i] = e->nodes[j];
+	for (j = 0; j < NUM_NODE_CLASSES; j++)
+	    REAL(VECTOR_ELT(value, k++))[i] = e->bytes[j];
+	REAL(VECTOR_ELT(value, k++))[i] = e->pages;
+	REAL(VECTOR_ELT(value, k++))[i] = e->nsize;
+	REAL(VECTOR_ELT(value, k++))[i] = e->vsize;
+	REAL(VECTOR_ELT(value, k++))[i] = e->ngrow;
+	REAL(VECTOR_ELT(value, k++))[i] = e->vgrow;
+    }
+    UNPROTECT(2);
+    return value;
+}
+
 /* reports memory use to profiler in eval.c */
 
 void attribute_hidden get_current_mem(size_t *smallvsize,
@@ -2015,15 +3233,18 @@ SEXP attribute_hidden do_gc(SEXP call, SEXP op, SEXP args, SEXP rho)
 	R_gc_lite();
 
     gc_reporting = ogc;
+    /* vector use includes the scratch memory of thread arenas */
+    R_size_t vused = R_VSize - VHEAP_FREE() +
+	(thread_arena_bytes() + vsfac - 1) / vsfac;
     /*- now return the [used , gc trigger size] for cells and heap */
     PROTECT(value = allocVector(REALSXP, 14));
     REAL(value)[0] = onsize - R_Collected;
-    REAL(value)[1] = R_VSize - VHEAP_FREE();
+    REAL(value)[1] = vused;
     REAL(value)[4] = R_NSize;
     REAL(value)[5] = R_VSize;
     /* next four are in 0.1Mb, rounded up */
     REAL(value)[2] = 0.1*ceil(10. * (onsize - R_Collected)/Mega * sizeof(SEXPREC));
-    REAL(value)[3] = 0.1*ceil(10. * (R_VSize - VHEAP_FREE())/Mega * vsfac);
+    REAL(value)[3] = 0.1*ceil(10. * vused/Mega * vsfac);
     REAL(value)[6] = 0.1*ceil(10. * R_NSize/Mega * sizeof(SEXPREC));
     REAL(value)[7] = 0.1*ceil(10. * R_VSize/Mega * vsfac);
     REAL(value)[8] = (R_MaxNSize < R_SIZE_T_MAX) ?
@@ -2032,8 +3253,10 @@ SEXP attribute_hidden do_gc(SEXP call, SEXP op, SEXP args, SEXP rho)
 	0.1*ceil(10. * R_MaxVSize/Mega * vsfac) : NA_REAL;
     if (reset_max){
 	    R_N_maxused = onsize - R_Collected;
-	    R_V_maxused = R_VSize - VHEAP_FREE();
+	    R_V_maxused = vused;
     }
+    else if (vused > R_V_maxused)
+	R_V_maxused = vused;
     REAL(value)[10] = R_N_maxused;
     REAL(value)[11] = R_V_maxused;
     REAL(value)[12] = 0.1*ceil(10. * R_N_maxused/Mega*sizeof(SEXPREC));
@@ -2072,6 +3295,8 @@ void attribute_hidden InitMemory()
 
     init_gctorture();
     init_gc_grow_settings();
+    init_gc_mark_threads();
+    init_thread_arena_max();
 
     gc_reporting = R_Verbose;
     R_StandardPPStackSize = R_PPStackSize;
@@ -2105,6 +3330,9 @@ void attribute_hidden InitMemory()
       R_GenHeap[i].New = &R_GenHeap[i].NewPeg;
       SET_PREV_NODE(R_GenHeap[i].New, R_GenHeap[i].New);
       SET_NEXT_NODE(R_GenHeap[i].New, R_GenHeap[i].New);
+      R_GenHeap[i].Pinned = &R_GenHeap[i].PinnedPeg;
+      SET_PREV_NODE(R_GenHeap[i].Pinned, R_GenHeap[i].Pinned);
+      SET_NEXT_NODE(R_GenHeap[i].Pinned, R_GenHeap[i].Pinned);
     }
 
     for (i = 0; i < NUM_NODE_CLASSES; i++)
@@ -2261,6 +3489,206 @@ char *S_realloc(char *p, long new, long old, int size)
     return q;
 }
 
+/* THREAD SCRATCH ARENAS
+
+   R_alloc allocates on the R heap and so can only be used by the main
+   thread.  R_thread_alloc provides scratch memory for native code
+   running in any thread, such as OpenMP or pthreads workers.  Each
+   thread has its own arena, a stack of malloc'ed chunks that requests
+   are carved from, so no locking is needed except when a chunk is
+   obtained or released.  As with R_alloc, memory is released in bulk:
+   R_thread_vmaxset(p) releases everything allocated by the calling
+   thread since p was obtained from R_thread_vmaxget(), and an arena is
+   freed when its thread exits.
+
+   Worker threads cannot signal R errors, so R_thread_alloc returns
+   NULL if the memory cannot be allocated or if the arenas of all
+   threads together would exceed R_ThreadArenaMax bytes.  The size of
+   the chunks held by all arenas is included in the vector memory use
+   reported by gc(). */
+
+#ifndef Win32
+#if (defined(__APPLE__) || defined(_REENTRANT) || defined(HAVE_OPENMP)) && \
+     ! defined(HAVE_PTHREAD)
+# define HAVE_PTHREAD
+#endif
+#endif
+
+#define THREAD_CHUNK_SIZE 65536
+#define THREAD_ALLOC_ALIGN 16
+
+static R_size_t R_ThreadArenaMax = (R_size_t) 1 << 30;
+static R_size_t R_ThreadArenaBytes = 0; /* held by all arenas */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+typedef union thread_chunk {
+    struct {
+	union thread_chunk *prev;
+	size_t size;	/* bytes available after the header */
+	size_t used;
+    } c;
+    char align[THREAD_ALLOC_ALIGN * 2];
+} THREAD_CHUNK;
+
+#define THREAD_CHUNK_DATA(chunk) ((char *) ((chunk) + 1))
+
+typedef struct {
+    THREAD_CHUNK *top;
+} thread_arena_t;
+
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t thread_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* account for 'bytes' more held by the arenas, unless that would take
+   them over the limit */
+static Rboolean thread_arena_reserve(R_size_t bytes)
+{
+    Rboolean ok;
+    pthread_mutex_lock(&thread_arena_mutex);
+    ok = bytes <= R_ThreadArenaMax - R_ThreadArenaBytes;
+    if (ok)
+	R_ThreadArenaBytes += bytes;
+    pthread_mutex_unlock(&thread_arena_mutex);
+    return ok;
+}
+
+static void thread_arena_release(R_size_t bytes)
+{
+    pthread_mutex_lock(&thread_arena_mutex);
+    R_ThreadArenaBytes -= bytes;
+    pthread_mutex_unlock(&thread_arena_mutex);
+}
+
+/* release the chunks above the one containing 'mark' */
+static void thread_arena_reset(thread_arena_t *arena, const char *mark)
+{
+    R_size_t released = 0;
+    THREAD_CHUNK *chunk = arena->top;
+    while (chunk != NULL &&
+	   ! (mark >= THREAD_CHUNK_DATA(chunk) &&
+	      mark <= THREAD_CHUNK_DATA(chunk) + chunk->c.size)) {
+	THREAD_CHUNK *prev = chunk->c.prev;
+	released += sizeof(THREAD_CHUNK) + chunk->c.size;
+	free(chunk);
+	chunk = prev;
+    }
+    arena->top = chunk;
+    if (chunk != NULL)
+	chunk->c.used = mark - THREAD_CHUNK_DATA(chunk);
+    if (released > 0)
+	thread_arena_release(released);
+}
+
+static void thread_arena_destroy(void *data)
+{
+    thread_arena_t *arena = data;
+    thread_arena_reset(arena, NULL);
+    free(arena);
+}
+
+static void thread_arena_make_key(void)
+{
+    pthread_key_create(&thread_arena_key, thread_arena_destroy);
+}
+
+static thread_arena_t *thread_arena(Rboolean create)
+{
+    thread_arena_t *arena;
+    pthread_once(&thread_arena_once, thread_arena_make_key);
+    arena = pthread_getspecific(thread_arena_key);
+    if (arena == NULL && create) {
+	arena = malloc(sizeof(thread_arena_t));
+	if (arena != NULL) {
+	    arena->top = NULL;
+	    if (pthread_setspecific(thread_arena_key, arena) != 0) {
+		free(arena);
+		arena = NULL;
+	    }
+	}
+    }
+    return arena;
+}
+
+static void init_thread_arena_max(void)
+{
+    char *arg = getenv("R_THREAD_ARENA_MAX");
+    if (arg != NULL) {
+	int ierr;
+	R_size_t value = R_Decode2Long(arg, &ierr);
+	if (ierr == 0 && value > 0)
+	    R_ThreadArenaMax = value;
+    }
+}
+
+void *R_thread_alloc(size_t nelem, int eltsize)
+{
+    thread_arena_t *arena;
+    THREAD_CHUNK *chunk;
+    size_t size, csize;
+
+    if (nelem == 0 || eltsize <= 0 ||
+	nelem > (SIZE_MAX - THREAD_ALLOC_ALIGN) / eltsize)
+	return NULL;
+    size = (nelem * eltsize + THREAD_ALLOC_ALIGN - 1) /
+	THREAD_ALLOC_ALIGN * THREAD_ALLOC_ALIGN;
+    if ((arena = thread_arena(TRUE)) == NULL)
+	return NULL;
+
+    chunk = arena->top;
+    if (chunk == NULL || chunk->c.size - chunk->c.used < size) {
+	csize = size > THREAD_CHUNK_SIZE ? size : THREAD_CHUNK_SIZE;
+	if (csize > SIZE_MAX - sizeof(THREAD_CHUNK) ||
+	    ! thread_arena_reserve(sizeof(THREAD_CHUNK) + csize))
+	    return NULL;
+	if ((chunk = malloc(sizeof(THREAD_CHUNK) + csize)) == NULL) {
+	    thread_arena_release(sizeof(THREAD_CHUNK) + csize);
+	    return NULL;
+	}
+	chunk->c.prev = arena->top;
+	chunk->c.size = csize;
+	chunk->c.used = 0;
+	arena->top = chunk;
+    }
+    void *p = THREAD_CHUNK_DATA(chunk) + chunk->c.used;
+    chunk->c.used += size;
+    return p;
+}
+
+void *R_thread_vmaxget(void)
+{
+    thread_arena_t *arena = thread_arena(FALSE);
+    if (arena == NULL || arena->top == NULL)
+	return NULL;
+    return THREAD_CHUNK_DATA(arena->top) + arena->top->c.used;
+}
+
+void R_thread_vmaxset(const void *ovmax)
+{
+    thread_arena_t *arena = thread_arena(FALSE);
+    if (arena != NULL)
+	thread_arena_reset(arena, ovmax);
+}
+
+static R_size_t thread_arena_bytes(void)
+{
+    R_size_t bytes;
+    pthread_mutex_lock(&thread_arena_mutex);
+    bytes = R_ThreadArenaBytes;
+    pthread_mutex_unlock(&thread_arena_mutex);
+    return bytes;
+}
+#else
+/* Without POSIX threads no arenas are available. */
+static void init_thread_arena_max(void) { }
+void *R_thread_alloc(size_t nelem, int eltsize) { return NULL; }
+void *R_thread_vmaxget(void) { return NULL; }
+void R_thread_vmaxset(const void *ovmax) { }
+static R_size_t thread_arena_bytes(void) { return 0; }
+#endif
+
 /* "allocSExp" allocate a SEXPREC */
 /* call gc if necessary */
 
@@ -2710,15 +4138,18 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 		   indexable by size_t. - TK */
 		mem = allocator ?
 		    custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-		    malloc(hdrsize + size * sizeof(VECREC));
+		    large_vector_alloc(hdrsize + size * sizeof(VECREC));
 		if (mem == NULL) {
 		    /* If we are near the address space limit, we
 		       might be short of address space.  So return
 		       all unused objects to malloc and try again. */
 		    R_gc_no_finalizers(alloc_size);
+#ifdef LARGE_VECTOR_POOL
+		    TrimLargeVectorPool(TRUE);
+#endif
 		    mem = allocator ?
 			custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-			malloc(hdrsize + size * sizeof(VECREC));
+			large_vector_alloc(hdrsize + size * sizeof(VECREC));
 		}
 		if (mem != NULL) {
 		    s = mem;
@@ -2995,7 +4426,11 @@ static void R_gc_internal(R_size_t size_needed)
     BEGIN_SUSPEND_INTERRUPTS {
 	R_in_gc = TRUE;
 	gc_start_timing();
+	if (R_HeapPolicy->timed)
+	    gc_run_start = gc_cpu_time();
 	RunGenCollect(size_needed);
+	if (R_HeapPolicy->timed)
+	    gc_cycle_gctime += gc_cpu_time() - gc_run_start;
 	gc_end_timing();
 	R_in_gc = FALSE;
     } END_SUSPEND_INTERRUPTS;
@@ -3021,6 +4456,27 @@ static void R_gc_internal(R_size_t size_needed)
 	vcells = 0.1*ceil(10*vcells * vsfac/Mega);
 	REprintf("%.1f Mbytes of vectors used (%d%%)\n",
 		 vcells, (int) (vfrac + 0.5));
+	R_size_t abytes = thread_arena_bytes();
+	if (abytes > 0)
+	    REprintf("%.1f Mbytes of thread scratch memory used\n",
+		     0.1*ceil(10. * abytes/Mega));
+	if (R_HeapPolicy->timed)
+	    REprintf("heap policy '%s': %.1f%% of time in GC (target %.1f%%)\n",
+		     R_HeapPolicy->name, 100 * R_GCTimeFrac,
+		     100 * R_GCTimeTarget);
+	else
+	    REprintf("heap policy '%s'\n", R_HeapPolicy->name);
+#ifdef LARGE_VECTOR_POOL
+	REprintf("%.1f Mbytes of large vector pool used, %.1f cached"
+		 " (%.1f resident)\n",
+		 0.1*ceil(10. * R_LargePoolStats.inuse/Mega),
+		 0.1*ceil(10. * R_LargePoolStats.cached/Mega),
+		 0.1*ceil(10. * R_LargePoolStats.resident/Mega));
+	REprintf("  blocks mapped %.0f, reused %.0f, released %.0f,"
+		 " unmapped %.0f\n",
+		 R_LargePoolStats.mapped, R_LargePoolStats.reused,
+		 R_LargePoolStats.advised, R_LargePoolStats.unmapped);
+#endif
     }
 
 #ifdef IMMEDIATE_FINALIZERS
@@ -3111,6 +4567,16 @@ SEXP attribute_hidden do_memoryprofile(SEXP call, SEXP op, SEXP args, SEXP env)
 	  }
 	}
       }
+      for (i = 0; i < NUM_NODE_CLASSES; i++) {
+	  SEXP s;
+	  for (s = NEXT_NODE(R_GenHeap[i].Pinned);
+	       s != R_GenHeap[i].Pinned;
+	       s = NEXT_NODE(s)) {
+	      tmp = TYPEOF(s);
+	      if(tmp > LGLSXP) tmp -= 2;
+	      INTEGER(ans)[tmp]++;
+	  }
+      }
     } END_SUSPEND_INTERRUPTS;
     UNPROTECT(2);
     return ans;
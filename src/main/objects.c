@@ -412,13 +412,92 @@ SEXP dispatchMethod(SEXP op, SEXP sxp, SEXP dotClass, RCNTXT *cptr, SEXP method,
     return ans;
 }
 
+/* Cache for the method lookups in usemethod. Entries are keyed by the
+   generic, the class vector and the calling and defining environments
+   and hold the index of the class whose method was found (nclass for
+   the default method, -1 if there is none); they are valid while
+   R_LookupEpoch is unchanged (see Defn.h). The calling environment is
+   usually the frame of a function call, which is new for each call;
+   for a standard unhashed frame the frame itself is checked for
+   bindings of the method names tried, and the entry is keyed by its
+   enclosure. */
+#define S3_CACHE_SIZE 256
+#define S3_CACHE_MAXCLASS 8
+#define S3_CACHE_MAXGENERIC 32
+
+typedef struct {
+    uint64_t epoch;
+    char generic[S3_CACHE_MAXGENERIC];
+    int nclass;
+    SEXP klass[S3_CACHE_MAXCLASS];  /* CHARSXPs */
+    SEXP callenv, defrho;
+    int which;
+    SEXP method, sxp;
+    int ntried;
+    SEXP tried[S3_CACHE_MAXCLASS + 1];
+} S3_cache_entry;
+
+static S3_cache_entry S3_cache[S3_CACHE_SIZE];
+
+/* Returns the environment an S3 lookup from callrho is keyed by, or
+   NULL if lookups from callrho are not cached. */
+static SEXP S3_cache_env(SEXP callrho)
+{
+    if (HASHTAB(callrho) != R_NilValue || callrho == R_BaseEnv ||
+	callrho == R_BaseNamespace || callrho == R_EmptyEnv)
+	return callrho;
+    if (ATTRIB(callrho) != R_NilValue)
+	return NULL;
+    static SEXP s_packageName = NULL, s_namespace = NULL;
+    if (s_packageName == NULL) {
+	s_packageName = install(".packageName");
+	s_namespace = install(".__NAMESPACE__.");
+    }
+    for (SEXP frame = FRAME(callrho); frame != R_NilValue; frame = CDR(frame))
+	if (TAG(frame) == s_packageName || TAG(frame) == s_namespace)
+	    return NULL; /* callrho might be its own topenv */
+    return ENCLOS(callrho);
+}
+
+static int S3_cache_index(const char *generic, SEXP klass, SEXP env)
+{
+    uintptr_t h = 5381;
+    for (const char *p = generic; *p; p++)
+	h = h * 33 + (unsigned char) *p;
+    if (length(klass) > 0)
+	h = h * 33 + (uintptr_t) STRING_ELT(klass, 0) / sizeof(SEXPREC);
+    h = h * 33 + (uintptr_t) env / sizeof(SEXPREC);
+    return (int) (h % S3_CACHE_SIZE);
+}
+
+static S3_cache_entry *S3_cache_lookup(const char *generic, SEXP klass,
+				       SEXP callrho, SEXP defrho, SEXP env)
+{
+    S3_cache_entry *e = &S3_cache[S3_cache_index(generic, klass, env)];
+    int nclass = length(klass);
+    if (e->epoch != R_LookupEpoch || e->callenv != env ||
+	e->defrho != defrho || e->nclass != nclass ||
+	strcmp(e->generic, generic) != 0)
+	return NULL;
+    for (int i = 0; i < nclass; i++)
+	if (e->klass[i] != STRING_ELT(klass, i))
+	    return NULL;
+    if (env != callrho)
+	for (SEXP frame = FRAME(callrho); frame != R_NilValue;
+	     frame = CDR(frame))
+	    for (int i = 0; i < e->ntried; i++)
+		if (TAG(frame) == e->tried[i])
+		    return NULL;
+    return e;
+}
+
 attribute_hidden
 int usemethod(const char *generic, SEXP obj, SEXP call, SEXP args,
 	      SEXP rho, SEXP callrho, SEXP defrho, SEXP *ans)
 {
-    SEXP klass, method, sxp;
+    SEXP klass, method = R_NilValue, sxp = R_NilValue;
     SEXP op;
-    int i, nclass;
+    int i, nclass, which = -1;
     RCNTXT *cptr;
 
     /* Get the context which UseMethod was called from. */
@@ -428,39 +507,80 @@ int usemethod(const char *generic, SEXP obj, SEXP call, SEXP args,
     PROTECT(klass = R_data_class2(obj));
 
     nclass = length(klass);
-    for (i = 0; i < nclass; i++) {
-	const void *vmax = vmaxget();
-	const char *ss = translateChar(STRING_ELT(klass, i));
-	method = installS3Signature(generic, ss);
-	vmaxset(vmax);
-	sxp = R_LookupMethod(method, rho, callrho, defrho);
-	if (isFunction(sxp)) {
-	    if(method == R_SortListSymbol && CLOENV(sxp) == R_BaseNamespace)
-		continue; /* kludge because sort.list is not a method */
-	    PROTECT(sxp);
-	    if (i > 0) {
-		SEXP dotClass = PROTECT(stringSuffix(klass, i));
-		setAttrib(dotClass, R_PreviousSymbol, klass);
-		*ans = dispatchMethod(op, sxp, dotClass, cptr, method, generic,
-				      rho, callrho, defrho);
-		UNPROTECT(1); /* dotClass */
-	    } else {
-		*ans = dispatchMethod(op, sxp, klass, cptr, method, generic,
-				      rho, callrho, defrho);
+    SEXP env = nclass <= S3_CACHE_MAXCLASS &&
+	strlen(generic) < S3_CACHE_MAXGENERIC ? S3_cache_env(callrho) : NULL;
+    S3_cache_entry *e = env != NULL ?
+	S3_cache_lookup(generic, klass, callrho, defrho, env) : NULL;
+    if (e != NULL) {
+	which = e->which;
+	method = e->method;
+	sxp = e->sxp;
+    }
+    else {
+	uint64_t epoch = R_LookupEpoch;
+	unsigned int volatile_lookups = R_VolatileLookups;
+	SEXP tried[S3_CACHE_MAXCLASS + 1];
+	int ntried = 0;
+	for (i = 0; i <= nclass; i++) {
+	    const void *vmax = vmaxget();
+	    const char *ss = i < nclass ?
+		translateChar(STRING_ELT(klass, i)) : "default";
+	    method = installS3Signature(generic, ss);
+	    vmaxset(vmax);
+	    if (ntried <= S3_CACHE_MAXCLASS)
+		tried[ntried++] = method;
+	    sxp = R_LookupMethod(method, rho, callrho, defrho);
+	    if (isFunction(sxp)) {
+		if(i < nclass && method == R_SortListSymbol &&
+		   CLOENV(sxp) == R_BaseNamespace)
+		    continue; /* kludge because sort.list is not a method */
+		which = i;
+		break;
 	    }
-	    UNPROTECT(2); /* klass, sxp */
-	    return 1;
+	}
+	if (env != NULL && env != callrho)
+	    for (SEXP frame = FRAME(callrho); frame != R_NilValue;
+		 frame = CDR(frame))
+		for (i = 0; i < ntried; i++)
+		    if (TAG(frame) == tried[i])
+			env = NULL; /* found in the calling frame */
+	if (env != NULL && R_VolatileLookups == volatile_lookups) {
+	    e = &S3_cache[S3_cache_index(generic, klass, env)];
+	    e->epoch = epoch;
+	    strcpy(e->generic, generic);
+	    e->nclass = nclass;
+	    for (i = 0; i < nclass; i++)
+		e->klass[i] = STRING_ELT(klass, i);
+	    e->callenv = env;
+	    e->defrho = defrho;
+	    e->which = which;
+	    e->method = method;
+	    e->sxp = sxp;
+	    e->ntried = ntried;
+	    for (i = 0; i < ntried; i++)
+		e->tried[i] = tried[i];
 	}
     }
-    method = installS3Signature(generic, "default");
-    PROTECT(sxp = R_LookupMethod(method, rho, callrho, defrho));
-    if (isFunction(sxp)) {
-	*ans = dispatchMethod(op, sxp, R_NilValue, cptr, method, generic,
-			      rho, callrho, defrho);
+
+    if (which >= 0) {
+	PROTECT(sxp);
+	if (which == nclass)
+	    *ans = dispatchMethod(op, sxp, R_NilValue, cptr, method, generic,
+				  rho, callrho, defrho);
+	else if (which > 0) {
+	    SEXP dotClass = PROTECT(stringSuffix(klass, which));
+	    setAttrib(dotClass, R_PreviousSymbol, klass);
+	    *ans = dispatchMethod(op, sxp, dotClass, cptr, method, generic,
+				  rho, callrho, defrho);
+	    UNPROTECT(1); /* dotClass */
+	} else {
+	    *ans = dispatchMethod(op, sxp, klass, cptr, method, generic,
+				  rho, callrho, defrho);
+	}
 	UNPROTECT(2); /* klass, sxp */
 	return 1;
     }
-    UNPROTECT(2); /* klass, sxp */
+    UNPROTECT(1); /* klass */
     cptr->callflag = CTXT_RETURN;
     return 0;
 }
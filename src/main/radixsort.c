@@ -27,6 +27,10 @@
 #include <Defn.h>
 #include <Internal.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /* It would be better to find a way to avoid abusing TRUELENGTH, but
    in the meantime replace TRUELENGTH/SET_TRUELENGTH with
    TRLEN/SET_TRLEN that cast to int to avoid warnings. */
@@ -325,7 +329,119 @@ static void icount(int *x, int *o, int n)
     return;
 }
 
-static void iinsert(int *x, int *o, int n)
+static int skip[8];
+
+typedef unsigned int radix_counts[8][257];
+
+/* Working memory of the radix passes.  The passes run by the calling
+   thread use rw0, and push their group sizes straight onto gs.  When
+   the groups of a pass are sorted by several threads, each thread has
+   its own, keeps the group sizes it finds on a local stack until they
+   can be pushed in order, and only sets 'failed' on errors; these are
+   signalled once all threads are done. */
+typedef struct {
+    // 4 are used for iradix, 8 for dradix and i64radix
+    radix_counts counts;
+    // keys of the group being sorted, and the scatter buffers for the
+    // keys and the order; all of length 'alloc'
+    void *xsub;
+    int *otmp;
+    void *xtmp;
+    int alloc;
+    // counts for cradix_r, 256 for each byte up to maxlen, and its
+    // scatter buffer
+    int *ccounts, ccounts_alloc;
+    SEXP *cxtmp;
+    int cxtmp_alloc;
+    Rboolean local, failed;
+    int *gs, gsngrp, gsalloc;
+} radix_work;
+
+/* global because iradix and iradix_r interact and are called repetitively.
+   counts are set back to 0 after each use, to benefit from skipped radix. */
+static radix_work rw0;
+
+#define WError(w, ...) do {			\
+	if ((w)->local) {			\
+	    (w)->failed = TRUE;			\
+	    return;				\
+	}					\
+	Error(__VA_ARGS__);			\
+    } while(0)
+
+static Rboolean work_alloc(radix_work *w, int n)
+{
+    if (w->alloc >= n)
+	return TRUE;
+    // TO DO: xsub and xtmp are always the largest type (double) but
+    //        could be int if that's all that's needed
+    void *xsub = realloc(w->xsub, n * sizeof(double));
+    if (xsub == NULL)
+	return FALSE;
+    w->xsub = xsub;
+    int *otmp = (int *) realloc(w->otmp, n * sizeof(int));
+    if (otmp == NULL)
+	return FALSE;
+    w->otmp = otmp;
+    void *xtmp = realloc(w->xtmp, n * sizeof(double));
+    if (xtmp == NULL)
+	return FALSE;
+    w->xtmp = xtmp;
+    w->alloc = n;
+    return TRUE;
+}
+
+static void work_free(radix_work *w)
+{
+    free(w->xsub);
+    free(w->otmp);
+    free(w->xtmp);
+    free(w->ccounts);
+    free(w->cxtmp);
+    free(w->gs);
+    memset(w, 0, sizeof(radix_work));
+}
+
+static void wpush(radix_work *w, int x)
+{
+    if (!w->local) {
+	push(x);
+	return;
+    }
+    if (!stackgrps || x == 0)
+	return;
+    if (w->gsalloc == w->gsngrp) {
+	int newlen = (w->gsalloc == 0) ? 1024 : w->gsalloc * 2;
+	int *tmp = (int *) realloc(w->gs, newlen * sizeof(int));
+	if (tmp == NULL) {
+	    w->failed = TRUE;
+	    return;
+	}
+	w->gs = tmp;
+	w->gsalloc = newlen;
+    }
+    w->gs[w->gsngrp++] = x;
+}
+
+/* Passes over at least N_PARALLEL keys use R_num_math_threads
+   threads: each counts the bytes of its own chunk of the keys, and
+   scatters them using its own positions in the buckets, so the result
+   is that of the serial pass.  The groups of the first radix are then
+   sorted by the threads in any order. */
+#define N_PARALLEL 100000
+
+static int radix_nthreads(int n)
+{
+#ifdef _OPENMP
+    if (n >= N_PARALLEL && R_num_math_threads > 1)
+	return R_num_math_threads;
+#endif
+    return 1;
+}
+
+#define CHUNK(n, nth, t) ((int) ((double) (n) * (t) / (nth)))
+
+static void iinsert(radix_work *w, int *x, int *o, int n)
 /*  orders both x and o by reference in-place. Fast for small vectors,
     low overhead.  don't be tempted to binsearch backwards here, have
     to shift anyway; many memmove would have overhead and do the same
@@ -352,10 +468,10 @@ static void iinsert(int *x, int *o, int n)
 	if (x[i] == x[i - 1])
 	    tt++;
 	else {
-	    push(tt + 1);
+	    wpush(w, tt + 1);
 	    tt = 0;
 	}
-    push(tt + 1);
+    wpush(w, tt + 1);
 }
 
 /*
@@ -389,44 +505,155 @@ static void iinsert(int *x, int *o, int n)
   there is wide random access in each LSD radix pass, though.
 */
 
-// 4 are used for iradix, 8 for dradix and i64radix
-static unsigned int radixcounts[8][257] = { {0} };
+static void iradix_r(radix_work *w, int *xsub, int *osub, int n, int radix);
+static void dradix_r(radix_work *w, unsigned char *xsub, int *osub, int n,
+		     int radix);
+static unsigned long long (*twiddle) (void *, int, int);
 
-static int skip[8];
-/* global because iradix and iradix_r interact and are called repetitively.
-   counts are set back to 0 after each use, to benefit from skipped radix. */
-static void *radix_xsub = NULL;
-static size_t radix_xsuballoc = 0;
+static R_INLINE unsigned long long radix_key(void *x, int i, Rboolean isdouble)
+{
+    return isdouble ? twiddle(x, i, order) :
+	(unsigned int) (icheck(((int *) x)[i])) - INT_MIN;
+}
 
-static int *otmp = NULL, otmp_alloc = 0;
-static void alloc_otmp(int n)
+/* Parallel histogramming pass of iradix and dradix, with the counts
+   of each thread in hist[thread]; their sums are added to rw0.counts. */
+static void radix_hist(void *x, int n, int nradix, Rboolean isdouble,
+		       int nth, radix_counts *hist)
 {
-    if (otmp_alloc >= n)
-	return;
-    otmp = (int *) realloc(otmp, n * sizeof(int));
-    if (otmp == NULL)
-	Error("Failed to allocate working memory for otmp. Requested %d * %d bytes",
-	      n, sizeof(int));
-    otmp_alloc = n;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(x, n, nradix, isdouble, nth, hist)
+#endif
+    for (int t = 0; t < nth; t++) {
+	unsigned int (*counts)[257] = hist[t];
+	for (int i = CHUNK(n, nth, t); i < CHUNK(n, nth, t + 1); i++) {
+	    unsigned long long thisx = radix_key(x, i, isdouble);
+	    for (int radix = 0; radix < nradix; radix++)
+		counts[radix][thisx >> (radix * 8) & 0xFF]++;
+	}
+    }
+    for (int t = 0; t < nth; t++)
+	for (int radix = 0; radix < nradix; radix++)
+	    for (int i = 0; i < 256; i++)
+		rw0.counts[radix][i] += hist[t][radix][i];
+}
+
+/* Scatter of the order of x into o by the byte 'radix' of the keys,
+   using the counts of each thread from radix_hist.  thiscounts holds
+   the cumulated counts, and is left as the serial scatter leaves
+   it. */
+static void radix_scatter(void *x, int *o, int n, int radix,
+			  Rboolean isdouble, int nth, radix_counts *hist,
+			  unsigned int *thiscounts)
+{
+    for (int i = 0; i < 256; i++) {
+	if (thiscounts[i] == 0)
+	    continue;
+	unsigned int pos = 0;
+	for (int t = 0; t < nth; t++)
+	    pos += hist[t][radix][i];
+	pos = thiscounts[i] - pos;
+	thiscounts[i] = pos;
+	for (int t = 0; t < nth; t++) {
+	    unsigned int thisgrpn = hist[t][radix][i];
+	    hist[t][radix][i] = pos;
+	    pos += thisgrpn;
+	}
+    }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(x, o, n, radix, isdouble, nth, hist)
+#endif
+    for (int t = 0; t < nth; t++) {
+	unsigned int *pos = hist[t][radix];
+	for (int i = CHUNK(n, nth, t); i < CHUNK(n, nth, t + 1); i++)
+	    o[pos[radix_key(x, i, isdouble) >> (radix * 8) & 0xFF]++] = i + 1;
+    }
 }
 
-// TO DO: save xtmp if possible, see allocs in do_radixsort
-static void *xtmp = NULL;
-static int xtmp_alloc = 0;
-// TO DO: currently always the largest type (double) but
-//        could be int if that's all that's needed
-static void alloc_xtmp(int n)
+static void radix_group(radix_work *w, void *x, int *osub, int n,
+			int nextradix, Rboolean isdouble)
 {
-    if (xtmp_alloc >= n)
+    if (n == 1 || nextradix == -1) {
+	wpush(w, n);
 	return;
-    xtmp = (double *) realloc(xtmp, n * sizeof(double));
-    if (xtmp == NULL)
-	Error("Failed to allocate working memory for xtmp. Requested %d * %d bytes",
-	      n, sizeof(double));
-    xtmp_alloc = n;
+    }
+    if (!work_alloc(w, n))
+	WError(w, "Failed to realloc working memory %d*8bytes (xsub in %s), radix=%d",
+	       n, isdouble ? "dradix" : "iradix", nextradix + 1);
+    // this is why this xsub here can't be the same memory as xsub
+    // in do_radixsort.
+    if (isdouble) {
+	for (int j = 0; j < n; j++)
+	    ((unsigned long long *) w->xsub)[j] = twiddle(x, osub[j] - 1, order);
+	// changes xsub and o by reference recursively.
+	dradix_r(w, w->xsub, osub, n, nextradix);
+    } else {
+	for (int j = 0; j < n; j++)
+	    ((int *) w->xsub)[j] = icheck(((int *) x)[osub[j] - 1]);
+	iradix_r(w, w->xsub, osub, n, nextradix);
+    }
 }
 
-static void iradix_r(int *xsub, int *osub, int n, int radix);
+/* Sorts the groups of the first radix of iradix and dradix on the
+   remaining radixes and pushes their group sizes, clearing
+   thiscounts.  With several threads each group is sorted by one of
+   them. */
+static void radix_groups(void *x, int *o, int n, unsigned int *thiscounts,
+			 int nextradix, Rboolean isdouble, int nth)
+{
+    int itmp = 0, ngrp = 0, start[256], grpn[256];
+
+    thiscounts[256] = n;
+    for (int i = 1; itmp < n && i <= 256; i++) {
+	if (thiscounts[i] == 0)
+	    continue;
+	// undo cumulate; i.e. diff
+	start[ngrp] = itmp;
+	grpn[ngrp++] = thiscounts[i] - itmp;
+	itmp = thiscounts[i];
+	thiscounts[i] = 0;
+    }
+    if (nth > ngrp)
+	nth = ngrp;
+    if (nth <= 1 || nextradix == -1) {
+	for (int g = 0; g < ngrp; g++)
+	    radix_group(&rw0, x, o + start[g], grpn[g], nextradix, isdouble);
+	return;
+    }
+#ifdef _OPENMP
+    int thread[256], first[256], last[256];
+    Rboolean failed = FALSE;
+    radix_work *ws = calloc(nth, sizeof(radix_work));
+    if (ws == NULL)
+	Error("Failed to allocate working memory for %d threads", nth);
+    for (int t = 0; t < nth; t++)
+	ws[t].local = TRUE;
+#pragma omp parallel for num_threads(nth) schedule(dynamic) default(none) \
+    firstprivate(x, o, nextradix, isdouble, ngrp, ws) \
+    shared(start, grpn, thread, first, last)
+    for (int g = 0; g < ngrp; g++) {
+	int t = omp_get_thread_num();
+	thread[g] = t;
+	first[g] = ws[t].gsngrp;
+	radix_group(ws + t, x, o + start[g], grpn[g], nextradix, isdouble);
+	last[g] = ws[t].gsngrp;
+    }
+    for (int t = 0; t < nth; t++)
+	if (ws[t].failed)
+	    failed = TRUE;
+    if (! failed)
+	for (int g = 0; g < ngrp; g++)
+	    for (int i = first[g]; i < last[g]; i++)
+		push(ws[thread[g]].gs[i]);
+    for (int t = 0; t < nth; t++)
+	work_free(ws + t);
+    free(ws);
+    if (failed)
+	Error("Failed to allocate working memory for sorting groups in parallel");
+#endif
+}
 
 static void iradix(int *x, int *o, int n)
 /* As icount :
@@ -436,17 +663,25 @@ static void iradix(int *x, int *o, int n)
 {
     int nextradix, itmp, thisgrpn, maxgrpn;
     unsigned int thisx = 0, shift, *thiscounts;
+    unsigned int (*radixcounts)[257] = rw0.counts;
+    int nth = radix_nthreads(n);
+    radix_counts *hist = (nth > 1) ? calloc(nth, sizeof(radix_counts)) : NULL;
 
-    for (int i = 0; i < n;i++) {
-	/* parallel histogramming pass; i.e. count occurrences of
-	   0:255 in each byte.  Sequential so almost negligible. */
-	// relies on overflow behaviour. And shouldn't -INT_MIN be up in iradix?
-	thisx = (unsigned int) (icheck(x[i])) - INT_MIN;
-	// unrolled since inside n-loop
-	radixcounts[0][thisx & 0xFF]++;
-	radixcounts[1][thisx >> 8 & 0xFF]++;
-	radixcounts[2][thisx >> 16 & 0xFF]++;
-	radixcounts[3][thisx >> 24 & 0xFF]++;
+    if (hist != NULL) {
+	radix_hist(x, n, 4, FALSE, nth, hist);
+	thisx = (unsigned int) (icheck(x[n - 1])) - INT_MIN;
+    } else {
+	for (int i = 0; i < n;i++) {
+	    /* parallel histogramming pass; i.e. count occurrences of
+	       0:255 in each byte.  Sequential so almost negligible. */
+	    // relies on overflow behaviour. And shouldn't -INT_MIN be up in iradix?
+	    thisx = (unsigned int) (icheck(x[i])) - INT_MIN;
+	    // unrolled since inside n-loop
+	    radixcounts[0][thisx & 0xFF]++;
+	    radixcounts[1][thisx >> 8 & 0xFF]++;
+	    radixcounts[2][thisx >> 16 & 0xFF]++;
+	    radixcounts[3][thisx >> 24 & 0xFF]++;
+	}
     }
     for (int radix = 0; radix < 4; radix++) {
 	/* any(count == n) => all radix must have been that value =>
@@ -461,6 +696,7 @@ static void iradix(int *x, int *o, int n)
     int radix = 3;  // MSD
     while (radix >= 0 && skip[radix]) radix--;
     if (radix == -1) { // All radix are skipped; one number repeated n times.
+	free(hist);
 	if (nalast == 0 && x[0] == NA_INTEGER)
 	    // all values are identical. return 0 if nalast=0 & all NA
 	    // because of 'return', have to take care of it here.
@@ -493,54 +729,33 @@ static void iradix(int *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
-    for (int i = n - 1; i >= 0; i--) {
-	thisx = ((unsigned int) (icheck(x[i])) - INT_MIN) >> shift & 0xFF;
-	o[--thiscounts[thisx]] = i + 1;
-    }
-
-    if (radix_xsuballoc < maxgrpn) {
-        // The largest group according to the first non-skipped radix,
-        // so could be big (if radix is needed on first arg)
-        // TO DO: could include extra bits to divide the first radix
-        // up more. Often the MSD has groups in just 0-4 out of 256.
-        // free'd at the end of do_radixsort once we're done calling iradix
-        // repetitively
-        radix_xsub = (int *) realloc(radix_xsub, maxgrpn * sizeof(double));
-        if (!radix_xsub)
-            Error("Failed to realloc working memory %d*8bytes (xsub in iradix), radix=%d",
-                  maxgrpn, radix);
-        radix_xsuballoc = maxgrpn;
+    if (hist != NULL) {
+	radix_scatter(x, o, n, radix, FALSE, nth, hist, thiscounts);
+	free(hist);
+    } else {
+	for (int i = n - 1; i >= 0; i--) {
+	    thisx = ((unsigned int) (icheck(x[i])) - INT_MIN) >> shift & 0xFF;
+	    o[--thiscounts[thisx]] = i + 1;
+	}
     }
 
-    // TO DO: can we leave this to do_radixsort and remove these calls??
-    alloc_otmp(maxgrpn);
-    // TO DO: doesn't need to be sizeof(double) always, see inside
-    alloc_xtmp(maxgrpn);
+    // The largest group according to the first non-skipped radix,
+    // so could be big (if radix is needed on first arg)
+    // TO DO: could include extra bits to divide the first radix
+    // up more. Often the MSD has groups in just 0-4 out of 256.
+    // free'd at the end of do_radixsort once we're done calling iradix
+    // repetitively.  With several threads each allocates its own.
+    if (nth == 1 && !work_alloc(&rw0, maxgrpn))
+	Error("Failed to realloc working memory %d*8bytes (xsub in iradix), radix=%d",
+	      maxgrpn, radix);
 
     nextradix = radix - 1;
     while (nextradix >= 0 && skip[nextradix]) nextradix--;
     if (thiscounts[0] != 0)
 	Error("Internal error. thiscounts[0]=%d but should have been decremented to 0. dradix=%d",
 	      thiscounts[0], radix);
-    thiscounts[256] = n;
-    itmp = 0;
-    for (int i = 1; itmp < n && i <= 256; i++) {
-        if (thiscounts[i] == 0) continue;
-        // undo cumulate; i.e. diff
-        thisgrpn = thiscounts[i] - itmp;
-        if (thisgrpn == 1 || nextradix == -1) {
-            push(thisgrpn);
-        } else {
-            for (int j = 0; j < thisgrpn; j++)
-                // this is why this xsub here can't be the same memory as
-                // xsub in do_radixsort.
-                ((int *)radix_xsub)[j] = icheck(x[o[itmp+j]-1]);
-            // changes xsub and o by reference recursively.
-            iradix_r(radix_xsub, o+itmp, thisgrpn, nextradix);
-        }
-        itmp = thiscounts[i];
-        thiscounts[i] = 0;
-    }
+    // changes o by reference recursively.
+    radix_groups(x, o, n, thiscounts, nextradix, FALSE, nth);
     if (nalast == 0) // nalast = 1, -1 are both taken care already.
 	// nalast = 0 is dealt with separately as it just sets o to 0
 	for (int i = 0; i < n; i++)
@@ -549,7 +764,7 @@ static void iradix(int *x, int *o, int n)
     // modified by reference unlike iinsert or iradix_r
 }
 
-static void iradix_r(int *xsub, int *osub, int n, int radix)
+static void iradix_r(radix_work *w, int *xsub, int *osub, int n, int radix)
 // xsub is a recursive offset into xsub working memory above in
 // iradix, reordered by reference.  osub is a an offset into the main
 // answer o, reordered by reference.  radix iterates 3,2,1,0
@@ -563,12 +778,12 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
     // unlikely.  when nalast==0, iinsert will be called only from
     // within iradix.
     if (n < N_SMALL) {
-	iinsert(xsub, osub, n);
+	iinsert(w, xsub, osub, n);
 	return;
     }
 
     shift = radix * 8;
-    thiscounts = radixcounts[radix];
+    thiscounts = w->counts[radix];
 
     for (int i = 0; i < n; i++) {
 	thisx = (unsigned int) xsub[i] - INT_MIN; // sequential in xsub
@@ -582,11 +797,11 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
     for (int i = n - 1; i >= 0; i--) {
 	thisx = ((unsigned int) xsub[i] - INT_MIN) >> shift & 0xFF;
 	j = --thiscounts[thisx];
-	otmp[j] = osub[i];
-	((int *) xtmp)[j] = xsub[i];
+	w->otmp[j] = osub[i];
+	((int *) w->xtmp)[j] = xsub[i];
     }
-    memcpy(osub, otmp, n * sizeof(int));
-    memcpy(xsub, xtmp, n * sizeof(int));
+    memcpy(osub, w->otmp, n * sizeof(int));
+    memcpy(xsub, w->xtmp, n * sizeof(int));
 
     nextradix = radix - 1;
     while (nextradix >= 0 && skip[nextradix]) nextradix--;
@@ -595,8 +810,8 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
        before returning. */
 
     if (thiscounts[0] != 0)
-	Error("Logical error. thiscounts[0]=%d but should have been decremented to 0. radix=%d",
-	      thiscounts[0], radix);
+	WError(w, "Logical error. thiscounts[0]=%d but should have been decremented to 0. radix=%d",
+	       thiscounts[0], radix);
     thiscounts[256] = n;
     itmp = 0;
     for (int i = 1; itmp < n && i <= 256; i++) {
@@ -604,9 +819,9 @@ static void iradix_r(int *xsub, int *osub, int n, int radix)
 	    continue;
 	thisgrpn = thiscounts[i] - itmp;        // undo cummulate; i.e. diff
 	if (thisgrpn == 1 || nextradix == -1) {
-	    push(thisgrpn);
+	    wpush(w, thisgrpn);
 	} else {
-	    iradix_r(xsub+itmp, osub+itmp, thisgrpn, nextradix);
+	    iradix_r(w, xsub+itmp, osub+itmp, thisgrpn, nextradix);
 	}
 	itmp = thiscounts[i];
 	thiscounts[i] = 0;
@@ -626,14 +841,13 @@ static void setNumericRounding(int dround)
     dmask2 = 0xffffffffffffffff << dround * 8;
 }
 
-static union {
-    double d;
-    unsigned long long ull;
-} u;
-
 static
 unsigned long long dtwiddle(void *p, int i, int order)
 {
+    union {
+	double d;
+	unsigned long long ull;
+    } u;
     u.d = order * ((double *)p)[i]; // take care of 'order' at the beginning
     if (R_FINITE(u.d)) {
 	u.ull = (u.d != 0.0) ? u.ull + ((u.ull & dmask1) << 1) : 0;
@@ -650,18 +864,14 @@ unsigned long long dtwiddle(void *p, int i, int order)
 
 static Rboolean dnan(void *p, int i)
 {
-    u.d = ((double *) p)[i];
-    return (ISNAN(u.d));
+    return (ISNAN(((double *) p)[i]));
 }
 
-static unsigned long long (*twiddle) (void *, int, int);
 static Rboolean(*is_nan) (void *, int);
 // the size of the arg type (4 or 8). Just 8 currently until iradix is
 // merged in.
 static size_t colSize = 8;
 
-static void dradix_r(unsigned char *xsub, int *osub, int n, int radix);
-
 #ifdef WORDS_BIGENDIAN
 #define RADIX_BYTE colSize - radix - 1
 #else
@@ -673,15 +883,24 @@ static void dradix(unsigned char *x, int *o, int n)
     int radix, nextradix, itmp, thisgrpn, maxgrpn;
     unsigned int *thiscounts;
     unsigned long long thisx = 0;
+    unsigned int (*radixcounts)[257] = rw0.counts;
+    int nth = radix_nthreads(n);
+    radix_counts *hist = (nth > 1) ? calloc(nth, sizeof(radix_counts)) : NULL;
     // see comments in iradix for structure.  This follows the same.
     // TO DO: merge iradix in here (almost ready)
-    for (int i = 0; i < n; i++) {
-	thisx = twiddle(x, i, order);
-	for (radix = 0; radix < colSize; radix++)
-	    // if dround == 2 then radix 0 and 1 will be all 0 here and skipped.
-	    /* on little endian, 0 is the least significant bits (the right)
-	       and 7 is the most including sign (the left); i.e. reversed. */
-	    radixcounts[radix][((unsigned char *)&thisx)[RADIX_BYTE]]++;
+    if (hist != NULL) {
+	// the byte of thisx at RADIX_BYTE is thisx >> (radix * 8) & 0xFF
+	radix_hist(x, n, (int) colSize, TRUE, nth, hist);
+	thisx = twiddle(x, n - 1, order);
+    } else {
+	for (int i = 0; i < n; i++) {
+	    thisx = twiddle(x, i, order);
+	    for (radix = 0; radix < colSize; radix++)
+		// if dround == 2 then radix 0 and 1 will be all 0 here and skipped.
+		/* on little endian, 0 is the least significant bits (the right)
+		   and 7 is the most including sign (the left); i.e. reversed. */
+		radixcounts[radix][((unsigned char *)&thisx)[RADIX_BYTE]]++;
+	}
     }
     for (radix = 0; radix < colSize; radix++) {
 	// thisx is the last x after loop above
@@ -695,6 +914,7 @@ static void dradix(unsigned char *x, int *o, int n)
     while (radix >= 0 && skip[radix]) radix--;
     if (radix == -1) {
 	// All radix are skipped; i.e. one number repeated n times.
+	free(hist);
 	if (nalast == 0 && is_nan(x, 0))
 	    // all values are identical. return 0 if nalast=0 & all NA
 	    // because of 'return', have to take care of it here.
@@ -723,28 +943,26 @@ static void dradix(unsigned char *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
-    for (int i = n - 1; i >= 0; i--) {
-	thisx = twiddle(x, i, order);
-	o[ --thiscounts[((unsigned char *)&thisx)[RADIX_BYTE]] ] = i + 1;
-    }
-
-    if (radix_xsuballoc < maxgrpn) {
-        // TO DO: centralize this alloc
-        // The largest group according to the first non-skipped radix,
-        // so could be big (if radix is needed on first arg) TO DO:
-        // could include extra bits to divide the first radix up
-        // more. Often the MSD has groups in just 0-4 out of 256.
-        // free'd at the end of do_radixsort once we're done calling iradix
-        // repetitively
-        radix_xsub = (double *) realloc(radix_xsub, maxgrpn * sizeof(double));
-        if (!radix_xsub)
-            Error("Failed to realloc working memory %d*8bytes (xsub in dradix), radix=%d",
-                  maxgrpn, radix);
-        radix_xsuballoc = maxgrpn;
+    if (hist != NULL) {
+	radix_scatter(x, o, n, radix, TRUE, nth, hist, thiscounts);
+	free(hist);
+    } else {
+	for (int i = n - 1; i >= 0; i--) {
+	    thisx = twiddle(x, i, order);
+	    o[ --thiscounts[((unsigned char *)&thisx)[RADIX_BYTE]] ] = i + 1;
+	}
     }
 
-    alloc_otmp(maxgrpn);   // TO DO: leave to do_radixsort and remove these?
-    alloc_xtmp(maxgrpn);
+    // TO DO: centralize this alloc
+    // The largest group according to the first non-skipped radix,
+    // so could be big (if radix is needed on first arg) TO DO:
+    // could include extra bits to divide the first radix up
+    // more. Often the MSD has groups in just 0-4 out of 256.
+    // free'd at the end of do_radixsort once we're done calling iradix
+    // repetitively
+    if (nth == 1 && !work_alloc(&rw0, maxgrpn))
+	Error("Failed to realloc working memory %d*8bytes (xsub in dradix), radix=%d",
+	      maxgrpn, radix);
 
     nextradix = radix - 1;
     while (nextradix >= 0 && skip[nextradix])
@@ -752,31 +970,8 @@ static void dradix(unsigned char *x, int *o, int n)
     if (thiscounts[0] != 0)
 	Error("Logical error. thiscounts[0]=%d but should have been decremented to 0. dradix=%d",
 	      thiscounts[0], radix);
-    thiscounts[256] = n;
-    itmp = 0;
-    for (int i = 1; itmp < n && i <= 256; i++) {
-        if (thiscounts[i] == 0)
-            continue;
-        thisgrpn = thiscounts[i] - itmp;  // undo cummulate; i.e. diff
-        if (thisgrpn == 1 || nextradix == -1) {
-            push(thisgrpn);
-        } else {
-            if (colSize == 4) { // ready for merging in iradix ...
-                error("Not yet used, still using iradix instead");
-                for (int j = 0; j < thisgrpn; j++)
-                    ((int *)radix_xsub)[j] = (int)twiddle(x, o[itmp+j]-1, order);
-                // this is why this xsub here can't be the same memory
-                // as xsub in do_radixsort
-            } else 
-		for (int j = 0; j < thisgrpn; j++)
-		    ((unsigned long long *)radix_xsub)[j] =
-			twiddle(x, o[itmp+j]-1, order);
-	    // changes xsub and o by reference recursively.
-	    dradix_r(radix_xsub, o+itmp, thisgrpn, nextradix);
-	}
-	itmp = thiscounts[i];
-	thiscounts[i] = 0;
-    }
+    // changes o by reference recursively.
+    radix_groups(x, o, n, thiscounts, nextradix, TRUE, nth);
     if (nalast == 0) // nalast = 1, -1 are both taken care already.
 	for (int i = 0; i < n; i++)
 	    o[i] = is_nan(x, o[i] - 1) ? 0 : o[i];
@@ -786,7 +981,7 @@ static void dradix(unsigned char *x, int *o, int n)
 
 }
 
-static void dinsert(unsigned long long *x, int *o, int n)
+static void dinsert(radix_work *w, unsigned long long *x, int *o, int n)
 // orders both x and o by reference in-place. Fast for small vectors,
 // low overhead.  don't be tempted to binsearch backwards here, have
 // to shift anyway; many memmove would have overhead and do the same
@@ -813,13 +1008,14 @@ static void dinsert(unsigned long long *x, int *o, int n)
 	if (x[i] == x[i - 1])
 	    tt++;
 	else {
-	    push(tt + 1);
+	    wpush(w, tt + 1);
 	    tt = 0;
 	}
-    push(tt + 1);
+    wpush(w, tt + 1);
 }
 
-static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
+static void dradix_r(radix_work *w, unsigned char *xsub, int *osub, int n,
+		     int radix)
 /* xsub is a recursive offset into xsub working memory above in
    dradix, reordered by reference.  osub is a an offset into the main
    answer o, reordered by reference.  dradix iterates
@@ -833,11 +1029,11 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
 	   based on sum(1:50)=1275 worst -vs- 256 cummulate + 256 memset +
 	   allowance since reverse order is unlikely */
 	// order=1 here because it's already taken care of in iradix
-	dinsert((void *)xsub, osub, n);
+	dinsert(w, (void *)xsub, osub, n);
 
 	return;
     }
-    thiscounts = radixcounts[radix];
+    thiscounts = w->counts[radix];
     p = xsub + RADIX_BYTE;
     for (int i = 0; i < n; i++) {
 	thiscounts[*p]++;
@@ -853,20 +1049,20 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
 	error("Not yet used, still using iradix instead");
 	for (int i = n - 1; i >= 0; i--) {
 	    int j = --thiscounts[*(p + RADIX_BYTE)];
-	    otmp[j] = osub[i];
-	    ((int *) xtmp)[j] = *(int *) p;
+	    w->otmp[j] = osub[i];
+	    ((int *) w->xtmp)[j] = *(int *) p;
 	    p -= colSize;
 	}
     } else {
 	for (int i = n - 1; i >= 0; i--) {
 	    int j = --thiscounts[*(p + RADIX_BYTE)];
-	    otmp[j] = osub[i];
-	    ((unsigned long long *) xtmp)[j] = *(unsigned long long *) p;
+	    w->otmp[j] = osub[i];
+	    ((unsigned long long *) w->xtmp)[j] = *(unsigned long long *) p;
 	    p -= colSize;
 	}
     }
-    memcpy(osub, otmp, n * sizeof(int));
-    memcpy(xsub, xtmp, n * colSize);
+    memcpy(osub, w->otmp, n * sizeof(int));
+    memcpy(xsub, w->xtmp, n * colSize);
 
     nextradix = radix - 1;
     while (nextradix >= 0 && skip[nextradix])
@@ -876,8 +1072,8 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
     // returning.
 
     if (thiscounts[0] != 0)
-	Error("Logical error. thiscounts[0]=%d but should have been decremented to 0. radix=%d",
-	      thiscounts[0], radix);
+	WError(w, "Logical error. thiscounts[0]=%d but should have been decremented to 0. radix=%d",
+	       thiscounts[0], radix);
     thiscounts[256] = n;
     itmp = 0;
     for (int i = 1; itmp < n && i <= 256; i++) {
@@ -885,9 +1081,9 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
 	    continue;
 	thisgrpn = thiscounts[i] - itmp;        // undo cummulate; i.e. diff
 	if (thisgrpn == 1 || nextradix == -1)
-	    push(thisgrpn);
+	    wpush(w, thisgrpn);
 	else
-	    dradix_r(xsub + itmp * colSize, osub + itmp, thisgrpn,
+	    dradix_r(w, xsub + itmp * colSize, osub + itmp, thisgrpn,
 		     nextradix);
 	itmp = thiscounts[i];
 	thiscounts[i] = 0;
@@ -899,11 +1095,31 @@ static void dradix_r(unsigned char *xsub, int *osub, int n, int radix)
 // be suitable. Fixed precision such as 1.10, 1.15, 1.20, 1.25, 1.30
 // ... do use all bits so dradix skipping may not help.
 
-static int *cradix_counts = NULL;
-static int cradix_counts_alloc = 0;
 static int maxlen = 1;
-static SEXP *cradix_xtmp = NULL;
-static int cradix_xtmp_alloc = 0;
+
+// These allocs are here, to save them being in the recursive cradix_r()
+static Rboolean cradix_alloc(radix_work *w, int n)
+{
+    if (w->ccounts_alloc < maxlen) {
+	int newlen = maxlen + 10;   // +10 to save too many reallocs
+	int *counts = (int *) realloc(w->ccounts, newlen * 256 * sizeof(int));
+	if (!counts)
+	    return FALSE;
+	memset(counts, 0, newlen * 256 * sizeof(int));
+	w->ccounts = counts;
+	w->ccounts_alloc = newlen;
+    }
+    if (w->cxtmp_alloc < n) {
+	// TO DO: Reuse the one we have in do_radixsort.
+	// Does it need to be n length?
+	SEXP *xtmp = (SEXP *) realloc(w->cxtmp, n * sizeof(SEXP));
+	if (!xtmp)
+	    return FALSE;
+	w->cxtmp = xtmp;
+	w->cxtmp_alloc = n;
+    }
+    return TRUE;
+}
 
 // same as StrCmp but also takes into account 'decreasing' and 'na.last' args.
 static int StrCmp2(SEXP x, SEXP y)
@@ -952,7 +1168,14 @@ static void checkEncodings(SEXP x)
     */
 }
 
-static void cradix_r(SEXP * xsub, int n, int radix)
+// the byte of s at radix: 0 for NA, 1 for "" and past the end of s
+static R_INLINE int cradix_byte(SEXP s, int radix)
+{
+    return s == NA_STRING ?
+	0 : (radix < LENGTH(s) ? (unsigned char) (CHAR(s)[radix]) : 1);
+}
+
+static void cradix_r(radix_work *w, SEXP * xsub, int n, int radix)
 // xsub is a unique set of CHARSXP, to be ordered by reference
 
 // First time, radix == 0, and xsub == x. Then recursively moves SEXP together
@@ -994,18 +1217,16 @@ static void cradix_r(SEXP * xsub, int n, int radix)
     // CHAR) or using StrCmp. But 256 is narrow, so quick and not too
     // much an issue.
 
-    thiscounts = cradix_counts + radix * 256;
+    thiscounts = w->ccounts + radix * 256;
     for (int i = 0; i < n; i++) {
-	thisx = xsub[i] == NA_STRING ?
-	    0 : (radix < LENGTH(xsub[i]) ?
-		 (unsigned char) (CHAR(xsub[i])[radix]) : 1);
+	thisx = cradix_byte(xsub[i], radix);
 	thiscounts[ thisx ]++;   // 0 for NA,  1 for ""
     }
     // this also catches when subx has shorter strings than the rest,
     // thiscounts[0] == n and we'll recurse very quickly through to the
     // overall maxlen with no 256 overhead each time
     if (thiscounts[thisx] == n && radix < maxlen - 1) {
-	cradix_r(xsub, n, radix + 1);
+	cradix_r(w, xsub, n, radix + 1);
 	thiscounts[thisx] = 0;  // the rest must be 0 already, save the memset
 	return;
     }
@@ -1015,26 +1236,24 @@ static void cradix_r(SEXP * xsub, int n, int radix)
 	if (thiscounts[i])
 	    thiscounts[i] = (itmp += thiscounts[i]);
     for (int i = n - 1; i >= 0; i--) {
-	thisx = xsub[i] == NA_STRING ?
-	    0 : (radix < LENGTH(xsub[i]) ?
-		 (unsigned char) (CHAR(xsub[i])[radix]) : 1);
+	thisx = cradix_byte(xsub[i], radix);
 	int j = --thiscounts[thisx];
-	cradix_xtmp[j] = xsub[i];
+	w->cxtmp[j] = xsub[i];
     }
-    memcpy(xsub, cradix_xtmp, n * sizeof(SEXP));
+    memcpy(xsub, w->cxtmp, n * sizeof(SEXP));
     if (radix == maxlen - 1) {
 	memset(thiscounts, 0, 256 * sizeof(int));
 	return;
     }
     if (thiscounts[0] != 0)
-	Error("Logical error. counts[0]=%d in cradix but should have been decremented to 0. radix=%d",
-	      thiscounts[0], radix);
+	WError(w, "Logical error. counts[0]=%d in cradix but should have been decremented to 0. radix=%d",
+	       thiscounts[0], radix);
     itmp = 0;
     for (int i = 1; i < 256; i++) {
 	if (thiscounts[i] == 0)
 	    continue;
 	thisgrpn = thiscounts[i] - itmp;        // undo cummulate; i.e. diff
-	cradix_r(xsub + itmp, thisgrpn, radix + 1);
+	cradix_r(w, xsub + itmp, thisgrpn, radix + 1);
 	itmp = thiscounts[i];
 	// set to 0 now since we're here, saves memset
 	// afterwards. Important to clear! Also more portable for
@@ -1042,7 +1261,90 @@ static void cradix_r(SEXP * xsub, int n, int radix)
 	thiscounts[i] = 0;
     }
     if (itmp < n - 1)
-	cradix_r(xsub + itmp, n - itmp, radix + 1);     // final group
+	cradix_r(w, xsub + itmp, n - itmp, radix + 1);     // final group
+}
+
+static void cradix(SEXP *x, int n)
+/* cradix_r(x, n, 0), with the bytes of the first radix at which the
+   strings differ counted and scattered by several threads, as in
+   radix_hist and radix_scatter, which then sort the groups on the
+   remaining radixes. */
+{
+    int nth = radix_nthreads(n);
+    unsigned int (*hist)[256] = (nth > 1) ? calloc(nth, sizeof(*hist)) : NULL;
+
+    if (hist == NULL) {
+	cradix_r(&rw0, x, n, 0);
+	return;
+    }
+#ifdef _OPENMP
+    int radix = 0, start[256], grpn[256];
+    SEXP *xtmp = rw0.cxtmp;
+    Rboolean failed = FALSE;
+    for (;;) {
+#pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(x, n, nth, hist, radix)
+	for (int t = 0; t < nth; t++) {
+	    memset(hist[t], 0, 256 * sizeof(unsigned int));
+	    for (int i = CHUNK(n, nth, t); i < CHUNK(n, nth, t + 1); i++)
+		hist[t][cradix_byte(x[i], radix)]++;
+	}
+	for (int i = 0; i < 256; i++) {
+	    grpn[i] = 0;
+	    for (int t = 0; t < nth; t++)
+		grpn[i] += hist[t][i];
+	}
+	if (grpn[cradix_byte(x[0], radix)] < n || radix == maxlen - 1)
+	    break;
+	radix++;
+    }
+    if (grpn[cradix_byte(x[0], radix)] == n) {
+	free(hist);
+	return;
+    }
+    for (int i = 0, pos = 0; i < 256; i++) {
+	start[i] = pos;
+	for (int t = 0; t < nth; t++) {
+	    unsigned int thisgrpn = hist[t][i];
+	    hist[t][i] = pos;
+	    pos += thisgrpn;
+	}
+    }
+#pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(x, n, nth, hist, radix, xtmp)
+    for (int t = 0; t < nth; t++)
+	for (int i = CHUNK(n, nth, t); i < CHUNK(n, nth, t + 1); i++)
+	    xtmp[hist[t][cradix_byte(x[i], radix)]++] = x[i];
+    memcpy(x, xtmp, n * sizeof(SEXP));
+    free(hist);
+    if (radix == maxlen - 1)
+	return;
+
+    radix_work *ws = calloc(nth, sizeof(radix_work));
+    if (ws == NULL)
+	Error("Failed to allocate working memory for %d threads", nth);
+    for (int t = 0; t < nth; t++)
+	ws[t].local = TRUE;
+#pragma omp parallel for num_threads(nth) schedule(dynamic) default(none) \
+    firstprivate(x, radix, ws) shared(start, grpn)
+    for (int i = 0; i < 256; i++) {
+	radix_work *w = ws + omp_get_thread_num();
+	if (grpn[i] < 2)
+	    continue;
+	if (cradix_alloc(w, grpn[i]))
+	    cradix_r(w, x + start[i], grpn[i], radix + 1);
+	else
+	    w->failed = TRUE;
+    }
+    for (int t = 0; t < nth; t++) {
+	if (ws[t].failed)
+	    failed = TRUE;
+	work_free(ws + t);
+    }
+    free(ws);
+    if (failed)
+	Error("Failed to allocate working memory for sorting groups in parallel");
+#endif
 }
 
 static SEXP *ustr = NULL;
@@ -1164,7 +1466,7 @@ static void csort(SEXP * x, int *o, int n)
         // else use o from caller directly (not 1st arg)
         for (int i = 0; i < n; i++)
             csort_otmp[i] = icheck(csort_otmp[i]);
-        iinsert(csort_otmp, o, n);
+        iinsert(&rw0, csort_otmp, o, n);
     } else {
 	setRange(csort_otmp, n);
 	if (range == NA_INTEGER)
@@ -1234,27 +1536,12 @@ static void csort_pre(SEXP * x, int n)
     // permanently held by data.table, we'll just need to make the
     // final loop to set -i-1 before returning here.  sort ustr.
 
-    // TODO: just sort new ones and merge them in.  These allocs are
-    // here, to save them being in the recursive cradix_r()
-    if (cradix_counts_alloc < maxlen) {
-	cradix_counts_alloc = maxlen + 10;   // +10 to save too many reallocs
-	cradix_counts = (int *)realloc(cradix_counts,
-				       cradix_counts_alloc * 256 * sizeof(int));
-	if (!cradix_counts)
-	    Error("Failed to alloc cradix_counts");
-	memset(cradix_counts, 0, cradix_counts_alloc * 256 * sizeof(int));
-    }
-    if (cradix_xtmp_alloc < ustr_n) {
-        cradix_xtmp = (SEXP *) realloc(cradix_xtmp,  ustr_n * sizeof(SEXP));
-        // TO DO: Reuse the one we have in do_radixsort.
-        // Does it need to be n length?
-        if (!cradix_xtmp)
-            Error("Failed to alloc cradix_tmp");
-        cradix_xtmp_alloc = ustr_n;
-    }
+    // TODO: just sort new ones and merge them in.
+    if (!cradix_alloc(&rw0, ustr_n))
+	Error("Failed to alloc cradix_counts or cradix_tmp");
     // sorts ustr in-place by reference save ordering in the
     // CHARSXP. negative so as to distinguish with R's own usage.
-    cradix_r(ustr, ustr_n, 0);
+    cradix(ustr, ustr_n);
     for (int i = 0; i < ustr_n; i++)
 	SET_TRLEN(ustr[i], -i - 1);
 }
@@ -1488,7 +1775,7 @@ static void isort(int *x, int *o, int n)
             // not be affected (ex: `setkey`)
             for (int i = 0; i < n; i++)
                 x[i] = icheck(x[i]);
-        iinsert(x, o, n);
+        iinsert(&rw0, x, o, n);
     } else {
         /* Tighter range (e.g. copes better with a few abormally large
            values in some groups), but also, when setRange was once at
@@ -1536,7 +1823,7 @@ static void dsort(double *x, int *o, int n)
 	    ((unsigned long long *)x)[i] = twiddle(x, i, order);
 	// have to twiddle here anyways, can't speed up default case
 	// like in isort
-	dinsert((unsigned long long *)x, o, n);
+	dinsert(&rw0, (unsigned long long *)x, o, n);
     } else {
 	dradix((unsigned char *) x, (o[0] != -1) ? newo : o, n);
     }
@@ -1905,16 +2192,10 @@ SEXP attribute_hidden do_radixsort(SEXP call, SEXP op, SEXP args, SEXP rho)
     }
     
     gsfree();
-    free(radix_xsub);          radix_xsub=NULL;    radix_xsuballoc=0;
+    work_free(&rw0);
     free(xsub); free(newo);    xsub=newo=NULL;
-    free(xtmp);                xtmp=NULL;          xtmp_alloc=0;
-    free(otmp);                otmp=NULL;          otmp_alloc=0;
     free(csort_otmp);          csort_otmp=NULL;    csort_otmp_alloc=0;
 
-    free(cradix_counts);       cradix_counts=NULL; cradix_counts_alloc=0;
-    free(cradix_xtmp);         cradix_xtmp=NULL;   cradix_xtmp_alloc=0;
-    // TO DO: use xtmp already got
-
     UNPROTECT(1);
     return ans;
 }
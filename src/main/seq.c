@@ -264,6 +264,11 @@ static SEXP rep2(SEXP s, SEXP ncopy)
 	error(_("invalid '%s' value"), "times");
     R_xlen_t na = (R_xlen_t) sna;
 
+    if ((a = R_compact_rep_times(s, t)) != NULL) {
+	UNPROTECT(1);
+	return a;
+    }
+
 /*    R_xlen_t ni = NINTERRUPT, ratio;
     if(nc > 0) {
 	ratio = na/nc; // average no of replications
@@ -286,6 +291,9 @@ static SEXP rep3(SEXP s, R_xlen_t ns, R_xlen_t na)
     R_xlen_t i, j;
     SEXP a;
 
+    if (ns == 1 && (a = R_compact_rep(s, na)) != NULL)
+	return a;
+
     PROTECT(a = allocVector(TYPEOF(s), na));
 
     switch (TYPEOF(s)) {
@@ -465,6 +473,15 @@ static SEXP rep4(SEXP x, SEXP times, R_xlen_t len, R_xlen_t each, R_xlen_t nt)
     // faster code for common special case
     if (each == 1 && nt == 1) return rep3(x, lx, len);
 
+    // run length encoded results for rep(x, each=) and rep(x, times=)
+    if (nt == 1 && len == lx * each)
+	a = R_compact_rep_each(x, each);
+    else if (each == 1)
+	a = R_compact_rep_times(x, times);
+    else
+	a = NULL;
+    if (a != NULL) return a;
+
     PROTECT(a = allocVector(TYPEOF(x), len));
 
 #define R4_SWITCH_LOOP(itimes)						\
@@ -93,6 +93,63 @@ static R_INLINE SEXP VECTOR_ELT_FIX_NAMED(SEXP y, R_xlen_t i) {
 	}					  \
     } while (0)
     
+/* A subset of a sorted vector by non-decreasing indices in range is
+   sorted the same way, and by non-increasing ones the other way.  For
+   results of at least SORTED_SUBSET_MIN elements this is recorded in a
+   wrapper, as for the values of sort(). */
+
+#define SORTED_SUBSET_MIN 100
+
+static int reversed_sortedness(int srt)
+{
+    switch (srt) {
+    case SORTED_INCR: return SORTED_DECR_NA_1ST;
+    case SORTED_INCR_NA_1ST: return SORTED_DECR;
+    case SORTED_DECR: return SORTED_INCR_NA_1ST;
+    case SORTED_DECR_NA_1ST: return SORTED_INCR;
+    default: return UNKNOWN_SORTEDNESS;
+    }
+}
+
+static SEXP SortedSubset(SEXP x, SEXP indx, SEXP result)
+{
+    int srt = TYPEOF(x) == INTSXP ? INTEGER_IS_SORTED(x) : REAL_IS_SORTED(x);
+    if (!KNOWN_SORTED(srt))
+	return result;
+
+    R_xlen_t i, n = XLENGTH(indx), nx = xlength(x);
+    int up = 0, down = 0;
+    if (TYPEOF(indx) == INTSXP) {
+	const int *pindx = INTEGER_RO(indx);
+	for (i = 0; i < n; i++) {
+	    if (pindx[i] <= 0 || pindx[i] > nx) /* NA or out of bounds */
+		return result;
+	    if (i > 0) {
+		if (pindx[i] > pindx[i - 1]) up = 1;
+		else if (pindx[i] < pindx[i - 1]) down = 1;
+	    }
+	}
+    }
+    else {
+	const double *pindx = REAL_RO(indx);
+	for (i = 0; i < n; i++) {
+	    double di = pindx[i];
+	    R_xlen_t ii = (R_xlen_t) (di - 1);
+	    if (!R_FINITE(di) || ii < 0 || ii >= nx)
+		return result;
+	    if (i > 0) {
+		if (di > pindx[i - 1]) up = 1;
+		else if (di < pindx[i - 1]) down = 1;
+	    }
+	}
+    }
+    if (up && down)
+	return result;
+
+    int no_na = TYPEOF(x) == INTSXP ? INTEGER_NO_NA(x) : REAL_NO_NA(x);
+    return R_wrap_meta(result, down ? reversed_sortedness(srt) : srt, no_na);
+}
+
 SEXP attribute_hidden ExtractSubset(SEXP x, SEXP indx, SEXP call)
 {
     if (x == R_NilValue)
@@ -154,6 +211,8 @@ SEXP attribute_hidden ExtractSubset(SEXP x, SEXP indx, SEXP call)
     default:
 	errorcall(call, R_MSG_ob_nonsub, type2char(mode));
     }
+    if ((mode == INTSXP || mode == REALSXP) && n >= SORTED_SUBSET_MIN)
+	result = SortedSubset(x, indx, result);
     UNPROTECT(1); /* result */
     return result;
 }
@@ -171,18 +171,18 @@ static Rboolean rsum(SEXP sx, double *value, Rboolean narm)
 
 static Rboolean csum(SEXP sx, Rcomplex *value, Rboolean narm)
 {
-    Rcomplex *x = COMPLEX(sx);
-    R_xlen_t n = XLENGTH(sx);
     LDOUBLE sr = 0.0, si = 0.0;
     Rboolean updated = FALSE;
 
-    for (R_xlen_t k = 0; k < n; k++) {
-	if (!narm || (!ISNAN(x[k].r) && !ISNAN(x[k].i))) {
-	    if(!updated) updated = TRUE;
-	    sr += x[k].r;
-	    si += x[k].i;
-	}
-    }
+    ITERATE_BY_REGION(sx, x, i, nbatch, Rcomplex, COMPLEX, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if (!narm || (!ISNAN(x[k].r) && !ISNAN(x[k].i))) {
+		    if(!updated) updated = TRUE;
+		    sr += x[k].r;
+		    si += x[k].i;
+		}
+	    }
+	});
     value->r = (double) sr;
     value->i = (double) si;
 
@@ -387,18 +387,19 @@ static Rboolean rprod(SEXP sx, double *value, Rboolean narm)
 
 static Rboolean cprod(SEXP sx, Rcomplex *value, Rboolean narm)
 {
-    Rcomplex *x = COMPLEX(sx);
-    R_xlen_t n = XLENGTH(sx);
     LDOUBLE sr = 1.0, si = 0.0;
     Rboolean updated = FALSE;
-    for (R_xlen_t k = 0; k < n; k++) {
-	if (!narm || (!ISNAN(x[k].r) && !ISNAN(x[k].i))) {
-	    if(!updated) updated = TRUE;
-	    LDOUBLE tr = sr, ti = si;
-	    sr = tr * x[k].r - ti * x[k].i;
-	    si = tr * x[k].i + ti * x[k].r;
-	}
-    }
+    ITERATE_BY_REGION(sx, x, i, nbatch, Rcomplex, COMPLEX, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if (!narm || (!ISNAN(x[k].r) && !ISNAN(x[k].i))) {
+		    if(!updated) updated = TRUE;
+		    LDOUBLE tr = sr;
+		    LDOUBLE ti = si;
+		    sr = tr * x[k].r - ti * x[k].i;
+		    si = tr * x[k].i + ti * x[k].r;
+		}
+	    }
+	});
     value->r = (double) sr;
     value->i = (double) si;
 
@@ -451,12 +452,13 @@ static R_INLINE SEXP logical_mean(SEXP x)
 {
     R_xlen_t n = XLENGTH(x);
     LDOUBLE s = 0.0;
-    for (R_xlen_t i = 0; i < n; i++) {
-	int xi = LOGICAL_ELT(x, i);
-	if(xi == NA_LOGICAL)
-	    return ScalarReal(R_NaReal);
-	s += xi;
-    }
+    ITERATE_BY_REGION(x, lx, i, nbatch, int, LOGICAL, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if(lx[k] == NA_LOGICAL)
+		    return ScalarReal(R_NaReal);
+		s += lx[k];
+	    }
+	});
     return ScalarReal((double) (s/n));
 }
 
@@ -464,12 +466,13 @@ static R_INLINE SEXP integer_mean(SEXP x)
 {
     R_xlen_t n = XLENGTH(x);
     LDOUBLE s = 0.0;
-    for (R_xlen_t i = 0; i < n; i++) {
-	int xi = INTEGER_ELT(x, i);
-	if(xi == NA_INTEGER)
-	    return ScalarReal(R_NaReal);
-	s += xi;
-    }
+    ITERATE_BY_REGION(x, ix, i, nbatch, int, INTEGER, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		if(ix[k] == NA_INTEGER)
+		    return ScalarReal(R_NaReal);
+		s += ix[k];
+	    }
+	});
     return ScalarReal((double) (s/n));
 }
 
@@ -497,20 +500,21 @@ static R_INLINE SEXP complex_mean(SEXP x)
 {
     R_xlen_t n = XLENGTH(x);
     LDOUBLE s = 0.0, si = 0.0;
-    Rcomplex *px = COMPLEX(x);
-    for (R_xlen_t i = 0; i < n; i++) {
-	Rcomplex xi = px[i];
-	s += xi.r;
-	si += xi.i;
-    }
+    ITERATE_BY_REGION(x, cx, i, nbatch, Rcomplex, COMPLEX, {
+	    for (R_xlen_t k = 0; k < nbatch; k++) {
+		s += cx[k].r;
+		si += cx[k].i;
+	    }
+	});
     s /= n; si /= n;
     if( R_FINITE((double)s) && R_FINITE((double)si) ) {
 	LDOUBLE t = 0.0, ti = 0.0;
-	for (R_xlen_t i = 0; i < n; i++) {
-	    Rcomplex xi = px[i];
-	    t += xi.r - s;
-	    ti += xi.i - si;
-	}
+	ITERATE_BY_REGION(x, cx, i, nbatch, Rcomplex, COMPLEX, {
+		for (R_xlen_t k = 0; k < nbatch; k++) {
+		    t += cx[k].r - s;
+		    ti += cx[k].i - si;
+		}
+	    });
 	s += t/n; si += ti/n;
     }
     Rcomplex val = { (double)s, (double)si };
@@ -27,6 +27,7 @@
 #define R_USE_SIGNALS 1
 #include <Defn.h>
 #include <Internal.h>
+#include <R_ext/Itermacros.h>
 
 #define NIL -1
 #define ARGUSED(x) LEVELS(x)
@@ -43,6 +44,7 @@ typedef struct _HashData HashData;
 struct _HashData {
     int K;
     hlen M;
+    hlen pmask;  /* M - 1, or the size of the partitions less one */
     R_xlen_t nmax;
 #ifdef LONG_VECTOR_SUPPORT
     Rboolean isLong;
@@ -54,6 +56,8 @@ struct _HashData {
     int nomatch;
     Rboolean useUTF8;
     Rboolean useCache;
+    Rboolean byAddress; /* strings are all cached, not "bytes" and
+			   not in a known encoding */
 };
 
 #define HTDATA_INT(d) (INTEGER0((d)->HashTable))
@@ -61,12 +65,14 @@ struct _HashData {
 
 
 /*
-   Integer keys are hashed via a random number generator
-   based on Knuth's recommendations.  The high order K bits
-   are used as the hash code.
+   Keys are hashed by multiplying them by 2^64 divided by the golden
+   ratio (Knuth's multiplicative hashing, 64-bit version).  The high
+   order K bits of the product are used as the hash code.  The upper
+   half of a key is folded into its lower half first, so that doubles
+   and pointers differing only in their upper bits are spread too.
 
    NB: lots of this code relies on M being a power of two and
-   on silent integer overflow mod 2^32.
+   on silent integer overflow mod 2^64.
 
    <FIXME> Integer keys are wasteful for logical and raw vectors, but
    the tables are small in that case.  It would be much easier to
@@ -80,9 +86,10 @@ struct _HashData {
     to NA_INTEGER.
 */
 
-static hlen scatter(unsigned int key, HashData *d)
+static R_INLINE hlen scatter(uint64_t key, HashData *d)
 {
-    return 3141592653U * key >> (32 - d->K);
+    key ^= key >> 32;
+    return (hlen) ((key * 11400714819323198485ULL) >> (64 - d->K));
 }
 
 static hlen lhash(SEXP x, R_xlen_t indx, HashData *d)
@@ -121,7 +128,7 @@ static R_INLINE hlen rhash(SEXP x, R_xlen_t indx, HashData *d)
     {
 	union foo tmpu;
 	tmpu.d = tmp;
-	return scatter(tmpu.u[0] + tmpu.u[1], d);
+	return scatter(((uint64_t) tmpu.u[1] << 32) | tmpu.u[0], d);
     }
 #else
     return scatter(*((unsigned int *) (&tmp)), d);
@@ -159,16 +166,10 @@ static hlen chash(SEXP x, R_xlen_t indx, HashData *d)
 #endif
 }
 
-/* Hash CHARSXP by address.  Hash values are int, For 64bit pointers,
- * we do (upper ^ lower) */
+/* Hash CHARSXP by address */
 static R_INLINE hlen cshash(SEXP x, R_xlen_t indx, HashData *d)
 {
-    intptr_t z = (intptr_t) STRING_ELT(x, indx);
-    unsigned int z1 = (unsigned int)(z & 0xffffffff), z2 = 0;
-#if SIZEOF_LONG == 8
-    z2 = (unsigned int)(z/0x100000000L);
-#endif
-    return scatter(z1 ^ z2, d);
+    return scatter((uintptr_t) STRING_ELT(x, indx), d);
 }
 
 static R_INLINE hlen shash(SEXP x, R_xlen_t indx, HashData *d)
@@ -357,6 +358,7 @@ static void MKsetup(R_xlen_t n, HashData *d, R_xlen_t nmax)
 	d->K++;
     }
     d->nmax = n;
+    d->pmask = d->M - 1;
 }
 
 #define IMAX 4294967296L
@@ -364,12 +366,14 @@ static void HashTableSetup(SEXP x, HashData *d, R_xlen_t nmax)
 {
     d->useUTF8 = FALSE;
     d->useCache = TRUE;
+    d->byAddress = FALSE;
     switch (TYPEOF(x)) {
     case LGLSXP:
 	d->hash = lhash;
 	d->equal = lequal;
 	d->nmax = d->M = 4;
 	d->K = 2; /* unused */
+	d->pmask = 3;
 	break;
     case INTSXP:
     {
@@ -404,6 +408,7 @@ static void HashTableSetup(SEXP x, HashData *d, R_xlen_t nmax)
 	d->equal = rawequal;
 	d->nmax = d->M = 256;
 	d->K = 8; /* unused */
+	d->pmask = 255;
 	break;
     case VECSXP:
 	d->hash = vhash;
@@ -430,6 +435,12 @@ static void HashTableSetup(SEXP x, HashData *d, R_xlen_t nmax)
 /* Collision resolution is by linear probing */
 /* The table is guaranteed large so this is sufficient */
 
+/* Probing wraps around at the end of the table, or at the end of the
+   partition of the table for tables built by several threads (see
+   HashParallel below); pmask is M - 1 or the size of a partition less
+   one. */
+#define NEXT_SLOT(i, d) (((i) & ~(d)->pmask) | (((i) + 1) & (d)->pmask))
+
 static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
 {
 #ifdef LONG_VECTOR_SUPPORT
@@ -439,7 +450,7 @@ static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
 	while (h[i] != NIL) {
 	    if (d->equal(x, (R_xlen_t) h[i], x, indx))
 		return h[i] >= 0 ? 1 : 0;
-	    i = (i + 1) % d->M;
+	    i = NEXT_SLOT(i, d);
 	}
 	if (d->nmax-- < 0) error("hash table is full");
 	h[i] = (double) indx;
@@ -451,7 +462,7 @@ static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
 	while (h[i] != NIL) {
 	    if (d->equal(x, h[i], x, indx))
 		return h[i] >= 0 ? 1 : 0;
-	    i = (i + 1) % d->M;
+	    i = NEXT_SLOT(i, d);
 	}
 	if (d->nmax-- < 0) error("hash table is full");
 	h[i] = (int) indx;
@@ -470,7 +481,7 @@ static void removeEntry(SEXP table, SEXP x, R_xlen_t indx, HashData *d)
 		h[i] = NA_INTEGER;  /* < 0, only index values are inserted */
 		return;
 	    }
-	    i = (i + 1) % d->M;
+	    i = NEXT_SLOT(i, d);
 	}
     } else
 #endif
@@ -482,11 +493,165 @@ static void removeEntry(SEXP table, SEXP x, R_xlen_t indx, HashData *d)
 		h[i] = NA_INTEGER;  /* < 0, only index values are inserted */
 		return;
 	    }
-	    i = (i + 1) % d->M;
+	    i = NEXT_SLOT(i, d);
 	}
     }
 }
 
+/* Long vectors are hashed by several threads when the number of math
+   threads is larger than one, if their elements can be hashed and
+   compared without dispatching on ALTREP classes or translating
+   strings.  First all hash codes are computed, then the table is split
+   into ranges of slots by the high order bits of the codes, and each
+   range is filled by one thread with probing wrapping around within
+   it.  A stable counting sort of the indices by range, with a count
+   and a scatter pass over blocks of the elements, lets each thread
+   visit only the elements of its range, still in order, so the results
+   and the first occurrences entered in the table are the same as with
+   one thread. */
+
+#define HASH_PARALLEL 100000
+
+static int hash_nthreads(SEXP x, R_xlen_t n, HashData *d)
+{
+#ifdef _OPENMP
+    if (n < HASH_PARALLEL || R_num_math_threads < 2 || ALTREP(x))
+	return 1;
+# ifdef LONG_VECTOR_SUPPORT
+    if (d->isLong) return 1;
+# endif
+    switch (TYPEOF(x)) {
+    case INTSXP:
+    case REALSXP:
+	return R_num_math_threads;
+    case STRSXP:
+	return d->byAddress ? R_num_math_threads : 1;
+    default:
+	return 1;
+    }
+#else
+    return 1;
+#endif
+}
+
+/* Enter the elements of x in the empty table of d by nth threads,
+   setting dup[i] as by isDuplicated() unless dup is NULL, visiting the
+   elements from the end for from_last.  If first is not NULL, threads
+   stop at their first duplicate and *first is set to its 1-based index
+   as by any_duplicated().  Returns FALSE, with the table emptied again
+   for the serial loops, if a partition of the table filled up. */
+static Rboolean
+HashParallel(SEXP x, HashData *d, int nth, int *dup, Rboolean from_last,
+	     R_xlen_t *first)
+{
+    R_xlen_t n = XLENGTH(x);
+    if (d->nmax < n) return FALSE; /* a smaller table for nmax */
+    const void *vmax = vmaxget();
+    unsigned int *hv = (unsigned int *) R_alloc(n, sizeof(unsigned int));
+    int pbits = 0;
+    while ((1 << pbits) < 4 * nth && pbits < d->K - 4) pbits++;
+    int np = 1 << pbits, shift = d->K - pbits;
+    hlen psize = d->M >> pbits;
+    R_xlen_t *pfirst = (R_xlen_t *) R_alloc(np, sizeof(R_xlen_t));
+    /* pstart[p] is where the indices of range p start in ord; cnt holds
+       the counts of block b of the elements at cnt[b * np + p], and
+       then the positions its indices go to */
+    R_xlen_t *pstart = (R_xlen_t *) R_alloc(np + 1, sizeof(R_xlen_t));
+    R_xlen_t *cnt = (R_xlen_t *) R_alloc((size_t) nth * np, sizeof(R_xlen_t));
+    int *ord = (int *) R_alloc(n, sizeof(int));
+    int *h = HTDATA_INT(d);
+    int failed = FALSE;
+
+    d->pmask = psize - 1;
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(x, d, n, hv)
+#endif
+    for (R_xlen_t i = 0; i < n; i++)
+	hv[i] = (unsigned int) d->hash(x, i, d);
+
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(n, nth, np, shift, hv, cnt)
+#endif
+    for (int b = 0; b < nth; b++) {
+	R_xlen_t *c = cnt + (size_t) b * np;
+	for (int p = 0; p < np; p++) c[p] = 0;
+	for (R_xlen_t i = n * b / nth; i < n * (b + 1) / nth; i++)
+	    c[hv[i] >> shift]++;
+    }
+    R_xlen_t pos = 0;
+    for (int p = 0; p < np; p++) {
+	pstart[p] = pos;
+	for (int b = 0; b < nth; b++) {
+	    R_xlen_t c = cnt[(size_t) b * np + p];
+	    cnt[(size_t) b * np + p] = pos;
+	    pos += c;
+	}
+    }
+    pstart[np] = n;
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(n, nth, np, shift, hv, cnt, ord)
+#endif
+    for (int b = 0; b < nth; b++) {
+	R_xlen_t *c = cnt + (size_t) b * np;
+	for (R_xlen_t i = n * b / nth; i < n * (b + 1) / nth; i++)
+	    ord[c[hv[i] >> shift]++] = (int) i;
+    }
+
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(nth) schedule(dynamic) default(none) \
+    firstprivate(x, d, hv, np, psize, pstart, ord, pfirst, h, dup, from_last, \
+		 first) reduction(||:failed)
+#endif
+    for (int p = 0; p < np; p++) {
+	hlen used = 0;
+	R_xlen_t lo = pstart[p], hi = pstart[p + 1];
+	pfirst[p] = 0;
+	for (R_xlen_t k = lo; k < hi; k++) {
+	    R_xlen_t i = ord[from_last ? hi - 1 - (k - lo) : k];
+	    if (used == psize) {
+		failed = TRUE;
+		break;
+	    }
+	    hlen j = hv[i];
+	    int isdup = 0;
+	    while (h[j] != NIL) {
+		if (d->equal(x, h[j], x, i)) {
+		    isdup = 1;
+		    break;
+		}
+		j = NEXT_SLOT(j, d);
+	    }
+	    if (!isdup) {
+		h[j] = (int) i;
+		used++;
+	    }
+	    if (dup) dup[i] = isdup;
+	    if (isdup && first) {
+		pfirst[p] = i + 1;
+		break;
+	    }
+	}
+    }
+
+    if (failed) {
+	for (hlen j = 0; j < d->M; j++) h[j] = NIL;
+	d->pmask = d->M - 1;
+    }
+    else if (first) {
+	*first = 0;
+	for (int p = 0; p < np; p++)
+	    if (pfirst[p] &&
+		(!*first || (from_last ? pfirst[p] > *first
+			     : pfirst[p] < *first)))
+		*first = pfirst[p];
+    }
+    vmaxset(vmax);
+    return !failed;
+}
+
 #define DUPLICATED_INIT						\
     HashData data;						\
     HashTableSetup(x, &data, nmax);				\
@@ -503,6 +668,7 @@ static void removeEntry(SEXP table, SEXP x, R_xlen_t indx, HashData *d)
 		data.useCache = FALSE; break;			\
 	    }							\
 	}							\
+	data.byAddress = i == n && !data.useUTF8;		\
     }
 
 /* used in scan() */
@@ -549,7 +715,10 @@ static SEXP Duplicated(SEXP x, Rboolean from_last, int nmax)
 
     v = LOGICAL(ans);
 
-    if(from_last)
+    int nth = hash_nthreads(x, n, &data);
+    if (nth > 1 && HashParallel(x, &data, nth, v, from_last, NULL))
+	;
+    else if(from_last)
 	for (i = n-1; i >= 0; i--) {
 //	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	    v[i] = isDuplicated(x, i, &data);
@@ -576,7 +745,10 @@ R_xlen_t any_duplicated(SEXP x, Rboolean from_last)
     DUPLICATED_INIT;
     PROTECT(data.HashTable);
 
-    if(from_last) {
+    int nth = hash_nthreads(x, n, &data);
+    if (nth > 1 && HashParallel(x, &data, nth, NULL, from_last, &result))
+	;
+    else if(from_last) {
 	for (i = n-1; i >= 0; i--) {
 	    if(isDuplicated(x, i, &data)) { result = ++i; break; }
 	}
@@ -674,6 +846,68 @@ R_xlen_t any_duplicated3(SEXP x, SEXP incomp, Rboolean from_last)
 #undef DUPLICATED_INIT
 
 
+static SEXP IndexedDuplicated(SEXP x, R_xlen_t *any);
+
+/* Sorted vectors without NAs, e.g. from sort(), have their equal
+   elements next to each other, so duplicated() compares neighbours.
+   any is as for IndexedDuplicated().  NULL if x is not known to be
+   sorted and free of NAs. */
+
+#define SORTED_DUPLICATED(ctype, CTYPE) do {				\
+	ctype prev = 0;							\
+	ITERATE_BY_REGION(x, px, idx, nb, ctype, CTYPE, {		\
+		for (R_xlen_t k = 0; k < nb; k++) {			\
+		    R_xlen_t j = idx + k;				\
+		    if (j > 0) {					\
+			int eq = px[k] == prev;				\
+			if (v) v[from_last ? j - 1 : j] = eq;		\
+			else if (eq) {					\
+			    last = j;					\
+			    if (!from_last) goto done;			\
+			}						\
+		    }							\
+		    prev = px[k];					\
+		}							\
+	    });								\
+    } while (0)
+
+static SEXP SortedDuplicated(SEXP x, Rboolean from_last, R_xlen_t *any)
+{
+    switch (TYPEOF(x)) {
+    case INTSXP:
+	if (!KNOWN_SORTED(INTEGER_IS_SORTED(x)) || !INTEGER_NO_NA(x))
+	    return NULL;
+	break;
+    case REALSXP:
+	if (!KNOWN_SORTED(REAL_IS_SORTED(x)) || !REAL_NO_NA(x))
+	    return NULL;
+	break;
+    default:
+	return NULL;
+    }
+
+    R_xlen_t n = XLENGTH(x), last = 0;
+    SEXP ans = R_NilValue;
+    int *v = NULL;
+    if (!any) {
+	PROTECT(ans = allocVector(LGLSXP, n));
+	v = LOGICAL0(ans);
+	v[from_last ? n - 1 : 0] = 0;
+    }
+    if (TYPEOF(x) == INTSXP)
+	SORTED_DUPLICATED(int, INTEGER);
+    else
+	SORTED_DUPLICATED(double, REAL);
+ done:
+    if (any)
+	/* the later one of the first equal pair, or the earlier one of
+	   the last equal pair */
+	*any = last == 0 ? 0 : (from_last ? last : last + 1);
+    else
+	UNPROTECT(1); /* ans */
+    return ans;
+}
+
 /* .Internal(duplicated(x))	  [op=0]
   .Internal(unique(x))		  [op=1]
    .Internal(anyDuplicated(x))	  [op=2]
@@ -725,10 +959,14 @@ SEXP attribute_hidden do_duplicated(SEXP call, SEXP op, SEXP args, SEXP env)
     }
     else {
 	if(PRIMVAL(op) == 2) {
-	    R_xlen_t ind  = any_duplicated(x, fL);
+	    R_xlen_t ind;
+	    if (SortedDuplicated(x, fL, &ind) == NULL &&
+		(fL || IndexedDuplicated(x, &ind) == NULL))
+		ind = any_duplicated(x, fL);
 	    if(ind > INT_MAX) return ScalarReal((double) ind);
 	    else return ScalarInteger((int)ind);
-	} else
+	} else if ((dup = SortedDuplicated(x, fL, NULL)) == NULL &&
+		   (fL || (dup = IndexedDuplicated(x, NULL)) == NULL))
 	    dup = Duplicated(x, fL, nmax);
     }
     if (PRIMVAL(op) == 0) /* "duplicated()" */
@@ -793,12 +1031,99 @@ SEXP attribute_hidden do_duplicated(SEXP call, SEXP op, SEXP args, SEXP env)
 static void DoHashing(SEXP table, HashData *d)
 {
     R_xlen_t i, n = XLENGTH(table);
+    int nth = hash_nthreads(table, n, d);
+    if (nth > 1 && HashParallel(table, d, nth, NULL, FALSE, NULL))
+	return;
     for (i = 0; i < n; i++) {
 //	if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	(void) isDuplicated(table, i, d);
     }
 }
 
+/* Vectors made by hashIndex() keep the hash table of their data until
+   it may be modified (see the wrapper classes in altrep.c).  match()
+   then only has to look up x in it, and duplicated() and unique()
+   look up each element.  The index is CONS(HashTable, c(K, enc, pbits))
+   with the number of partition bits of a table built by several
+   threads, and enc says how the strings of the data are hashed: as in match5
+   a "bytes" element gives hashing by address, and so does the
+   absence of elements in a known encoding. */
+
+#define ENC_BYTES  0
+#define ENC_NATIVE 1
+#define ENC_MARKED 2
+
+static int hashEncoding(SEXP x)
+{
+    int enc = ENC_NATIVE;
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+	SEXP s = STRING_ELT(x, i);
+	if (!IS_CACHED(s)) return -1;
+	if (IS_BYTES(s)) return ENC_BYTES;
+	if (ENC_KNOWN(s)) enc = ENC_MARKED;
+    }
+    return enc;
+}
+
+/* Set up d from the index of table, building it if there is none yet.
+   Returns the data of table, or NULL if it has no usable index. */
+static SEXP HashIndexSetup(SEXP table, HashData *d, int *enc)
+{
+    SEXP data = R_hash_indexed_data(table);
+    if (data == NULL || IS_LONG_VEC(data))
+	return NULL;
+
+    SEXP index = R_hash_index(table);
+    if (index == R_NilValue) {
+	*enc = TYPEOF(data) == STRSXP ? hashEncoding(data) : ENC_NATIVE;
+	if (*enc < 0) return NULL;
+	HashTableSetup(data, d, NA_INTEGER);
+	d->useUTF8 = *enc == ENC_MARKED;
+	d->byAddress = *enc == ENC_NATIVE;
+	PROTECT(d->HashTable);
+	DoHashing(data, d);
+	SEXP info = allocVector(INTSXP, 3);
+	INTEGER(info)[0] = d->K;
+	INTEGER(info)[1] = *enc;
+	INTEGER(info)[2] = 0;
+	while ((d->M >> INTEGER(info)[2]) - 1 > d->pmask)
+	    INTEGER(info)[2]++;
+	R_set_hash_index(table, CONS(d->HashTable, info));
+	UNPROTECT(1);
+	return data;
+    }
+
+    switch (TYPEOF(data)) {
+    case INTSXP:
+	d->hash = ihash;
+	d->equal = iequal;
+	break;
+    case REALSXP:
+	d->hash = rhash;
+	d->equal = requal;
+	break;
+    case STRSXP:
+	d->hash = shash;
+	d->equal = sequal;
+	break;
+    default:
+	return NULL;
+    }
+    d->HashTable = CAR(index);
+    d->M = XLENGTH(d->HashTable);
+    d->K = INTEGER(CDR(index))[0];
+    d->pmask = (d->M >> INTEGER(CDR(index))[2]) - 1;
+    d->nmax = 0;
+#ifdef LONG_VECTOR_SUPPORT
+    d->isLong = FALSE;
+#endif
+    *enc = INTEGER(CDR(index))[1];
+    d->useUTF8 = *enc == ENC_MARKED;
+    d->useCache = TRUE;
+    d->byAddress = *enc == ENC_NATIVE;
+    return data;
+}
+
 /* invalidate entries: normally few */
 static void UndoHashing(SEXP x, SEXP table, HashData *d)
 {
@@ -814,7 +1139,7 @@ static void UndoHashing(SEXP x, SEXP table, HashData *d)
 	while (h[i] != NIL) {					\
 	    if (EQLFUN(table, h[i], x, indx))			\
 		return h[i] >= 0 ? h[i] + 1 : d->nomatch;	\
-	    i = (i + 1) % d->M;					\
+	    i = NEXT_SLOT(i, d);				\
 	}							\
 	return d->nomatch;					\
     }
@@ -827,33 +1152,52 @@ DEFLOOKUP(sLookup, shash, sequal)
 /* definition for the general case */
 DEFLOOKUP(Lookup, d->hash, d->equal)
 
-/* Now do the table lookup */
-static SEXP HashLookup(SEXP table, SEXP x, HashData *d)
+static void LookupRange(SEXP table, SEXP x, HashData *d, int *pa,
+			R_xlen_t from, R_xlen_t to)
 {
-    SEXP ans;
-    R_xlen_t i, n;
-
-    n = XLENGTH(x);
-    PROTECT(ans = allocVector(INTSXP, n));
-    int *pa = INTEGER0(ans);
+    R_xlen_t i;
 
     switch (TYPEOF(x)) {
     case INTSXP:
-	for (i = 0; i < n; i++)
+	for (i = from; i < to; i++)
 	    pa[i] = iLookup(table, x, i, d);
 	break;
     case REALSXP:
-	for (i = 0; i < n; i++)
+	for (i = from; i < to; i++)
 	    pa[i] = rLookup(table, x, i, d);
 	break;
     case STRSXP:
-	for (i = 0; i < n; i++)
+	for (i = from; i < to; i++)
 	    pa[i] = sLookup(table, x, i, d);
 	break;
     default:
-	for (i = 0; i < n; i++)
+	for (i = from; i < to; i++)
 	    pa[i] = Lookup(table, x, i, d);
     }
+}
+
+/* Now do the table lookup */
+static SEXP HashLookup(SEXP table, SEXP x, HashData *d)
+{
+    SEXP ans;
+    R_xlen_t n;
+
+    n = XLENGTH(x);
+    PROTECT(ans = allocVector(INTSXP, n));
+    int *pa = INTEGER0(ans);
+
+    /* the lookups only read the table, so they can be split up */
+    int nth = ALTREP(table) ? 1 : hash_nthreads(x, n, d);
+    if (nth > 1) {
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(nth) default(none) \
+    firstprivate(table, x, d, pa, n, nth)
+#endif
+	for (int t = 0; t < nth; t++)
+	    LookupRange(table, x, d, pa, n * t / nth, n * (t + 1) / nth);
+    }
+    else
+	LookupRange(table, x, d, pa, 0, n);
 
     UNPROTECT(1);
     return ans;
@@ -876,6 +1220,184 @@ static SEXP match_transform(SEXP s, SEXP env)
     return duplicate(s);
 }
 
+/* duplicated(x) for x made by hashIndex(): an element is a duplicate
+   unless the index finds it at its own place.  If any is not NULL, it
+   is set to the (1-based) index of the first duplicate or 0 as by
+   any_duplicated().  NULL if x has no usable index. */
+static SEXP IndexedDuplicated(SEXP x, R_xlen_t *any)
+{
+    HashData data;
+    int enc;
+    SEXP table = HashIndexSetup(x, &data, &enc);
+    if (table == NULL)
+	return NULL;
+    PROTECT(data.HashTable);
+    data.nomatch = 0;
+    R_xlen_t i, n = XLENGTH(table);
+    SEXP ans = R_NilValue;
+    if (any) {
+	*any = 0;
+	for (i = 0; i < n; i++)
+	    if (Lookup(table, table, i, &data) != i + 1) {
+		*any = i + 1;
+		break;
+	    }
+    }
+    else {
+	ans = allocVector(LGLSXP, n);
+	int *v = LOGICAL0(ans);
+	for (i = 0; i < n; i++)
+	    v[i] = Lookup(table, table, i, &data) != i + 1;
+    }
+    UNPROTECT(1);
+    return ans;
+}
+
+/* The first position in [lo, hi) of the sorted vector t from which on
+   the elements are not before v in the order of t, or hi, found by
+   bisection.  pt is the data pointer of t if it has one.
+
+   The galloping version searches [lo, n) in steps of 1, 2, 4, ... from
+   lo before bisecting, so the cost grows with the log of the distance
+   moved rather than with the log of n: walking through a sorted x this
+   way costs about m * log(n / m) comparisons. */
+#define DEFSORTEDPOS(NAME, GALLOP, ctype, ELT)				\
+static R_INLINE R_xlen_t						\
+NAME(SEXP t, const ctype *pt, R_xlen_t lo, R_xlen_t hi, ctype v,	\
+     Rboolean incr)							\
+{									\
+    while (lo < hi) {							\
+	R_xlen_t mid = lo + (hi - lo) / 2;				\
+	ctype tm = pt ? pt[mid] : ELT(t, mid);				\
+	if (incr ? tm < v : tm > v) lo = mid + 1;			\
+	else hi = mid;							\
+    }									\
+    return lo;								\
+}									\
+									\
+static R_INLINE R_xlen_t						\
+GALLOP(SEXP t, const ctype *pt, R_xlen_t lo, R_xlen_t n, ctype v,	\
+       Rboolean incr)							\
+{									\
+    R_xlen_t hi = lo, step = 1;						\
+    while (hi < n) {							\
+	ctype th = pt ? pt[hi] : ELT(t, hi);				\
+	if (!(incr ? th < v : th > v)) break;				\
+	lo = hi + 1;							\
+	hi += step;							\
+	step *= 2;							\
+    }									\
+    return NAME(t, pt, lo, hi < n ? hi : n, v, incr);			\
+}
+
+DEFSORTEDPOS(iSortedPos, iGallopPos, int, INTEGER_ELT)
+DEFSORTEDPOS(rSortedPos, rGallopPos, double, REAL_ELT)
+
+/* match() for a table known to be sorted and free of NAs, e.g. from
+   sort(); NULL if that is not known.  When x is known to be sorted as
+   well, the elements of x are taken in the order of the table and
+   found by galloping on from the previous match, as in a merge join.
+   Otherwise each is found by bisection, when that takes fewer steps
+   than hashing the table.  Neither uses more memory than the result. */
+static SEXP SortedMatch(SEXP itable, SEXP x, int nmatch)
+{
+    SEXPTYPE type = TYPEOF(itable);
+    R_xlen_t n = XLENGTH(itable), m = XLENGTH(x);
+    int srt, xsrt;
+    switch (type) {
+    case INTSXP:
+	srt = INTEGER_IS_SORTED(itable);
+	if (!INTEGER_NO_NA(itable)) return NULL;
+	break;
+    case REALSXP:
+	srt = REAL_IS_SORTED(itable);
+	if (!REAL_NO_NA(itable)) return NULL;
+	break;
+    default:
+	return NULL;
+    }
+    /* factors are matched by their levels */
+    if (!KNOWN_SORTED(srt) || TYPEOF(x) > type ||
+	(OBJECT(itable) && inherits(itable, "factor")))
+	return NULL;
+    switch (TYPEOF(x)) {
+    case INTSXP: xsrt = INTEGER_IS_SORTED(x); break;
+    case REALSXP: xsrt = REAL_IS_SORTED(x); break;
+    default: xsrt = UNKNOWN_SORTEDNESS;
+    }
+    Rboolean merge = KNOWN_SORTED(xsrt);
+    if (!merge && (double) m * log2((double) n) >= (double) n)
+	return NULL;
+
+    Rboolean incr = KNOWN_INCR(srt);
+    /* walk x backwards if it is sorted the other way round */
+    Rboolean rev = merge && KNOWN_INCR(xsrt) != incr;
+    PROTECT(x = coerceVector(x, type));
+    SEXP ans = allocVector(INTSXP, m);
+    int *pa = INTEGER0(ans);
+    R_xlen_t i, k, j = 0;
+    /* equal elements are next to each other, so the first position not
+       before v holds the first match if there is one */
+    if (type == INTSXP) {
+	const int *pt = (const int *) DATAPTR_OR_NULL(itable);
+	for (k = 0; k < m; k++) {
+	    i = rev ? m - 1 - k : k;
+	    int v = INTEGER_ELT(x, i);
+	    if (v == NA_INTEGER) {
+		pa[i] = nmatch;
+		continue;
+	    }
+	    j = merge ? iGallopPos(itable, pt, j, n, v, incr) :
+		iSortedPos(itable, pt, 0, n, v, incr);
+	    pa[i] = j < n && INTEGER_ELT(itable, j) == v ? (int) j + 1 : nmatch;
+	}
+    }
+    else {
+	const double *pt = (const double *) DATAPTR_OR_NULL(itable);
+	for (k = 0; k < m; k++) {
+	    i = rev ? m - 1 - k : k;
+	    double v = REAL_ELT(x, i);
+	    if (ISNAN(v)) {
+		pa[i] = nmatch;
+		continue;
+	    }
+	    j = merge ? rGallopPos(itable, pt, j, n, v, incr) :
+		rSortedPos(itable, pt, 0, n, v, incr);
+	    pa[i] = j < n && REAL_ELT(itable, j) == v ? (int) j + 1 : nmatch;
+	}
+    }
+    UNPROTECT(1);
+    return ans;
+}
+
+/* match() for a table made by hashIndex() and x as from
+   match_transform(); NULL if the index cannot be used. */
+static SEXP IndexedMatch(SEXP itable, SEXP x, int nmatch)
+{
+    SEXPTYPE type = TYPEOF(itable);
+    if (type != STRSXP && (TYPEOF(x) >= STRSXP || TYPEOF(x) > type))
+	return NULL;
+
+    HashData data;
+    int enc;
+    SEXP table = HashIndexSetup(itable, &data, &enc);
+    if (table == NULL)
+	return NULL;
+    PROTECT(data.HashTable);
+    PROTECT(x = coerceVector(x, type));
+    /* match5 hashes the strings by their characters if only x has
+       some in a known encoding */
+    int xenc = type == STRSXP ? hashEncoding(x) : ENC_NATIVE;
+    SEXP ans = NULL;
+    if (xenc >= 0 && !(enc == ENC_NATIVE && xenc == ENC_MARKED)) {
+	data.nomatch = nmatch;
+	data.byAddress = enc == ENC_NATIVE && xenc == ENC_NATIVE;
+	ans = HashLookup(table, x, &data);
+    }
+    UNPROTECT(2);
+    return ans;
+}
+
 // workhorse of R's match() and hence also  " ix %in% itable "
 SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 {
@@ -896,6 +1418,12 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 
     int nprot = 0;
     PROTECT(x	  = match_transform(ix,	    env)); nprot++;
+    if (!incomp &&
+	((ans = SortedMatch(itable, x, nmatch)) != NULL ||
+	 (!OBJECT(itable) && (ans = IndexedMatch(itable, x, nmatch)) != NULL))) {
+	UNPROTECT(nprot);
+	return ans;
+    }
     PROTECT(table = match_transform(itable, env)); nprot++;
     /* or should we use PROTECT_WITH_INDEX and REPROTECT below ? */
 
@@ -1010,6 +1538,7 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 	    }
 	    data.useUTF8 = useUTF8;
 	    data.useCache = useCache;
+	    data.byAddress = !useBytes && !useUTF8 && useCache;
 	}
 	PROTECT(data.HashTable); nprot++;
 	DoHashing(table, &data);
@@ -1655,7 +2184,7 @@ static int isDuplicated2(SEXP x, int indx, HashData *d)
     while (h[i] != NIL) {
 	if (d->equal(x, h[i], x, indx))
 	    return h[i] + 1;
-	i = (i + 1) % d->M;
+	i = NEXT_SLOT(i, d);
     }
     h[i] = indx;
     return 0;
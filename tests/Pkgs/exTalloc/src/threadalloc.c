@@ -0,0 +1,57 @@
+#include <string.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+SEXP threadAlloc(SEXP snthreads, SEXP snalloc, SEXP ssize)
+{
+    int nthreads = asInteger(snthreads), nalloc = asInteger(snalloc),
+	size = asInteger(ssize), nused = 1;
+    int *pa = (int *) R_alloc(nthreads, sizeof(int));
+    for (int i = 0; i < nthreads; i++) pa[i] = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+    {
+#ifdef _OPENMP
+	int t = omp_get_thread_num();
+	if (t == 0) nused = omp_get_num_threads();
+#else
+	int t = 0;
+#endif
+	void *vmax = R_thread_vmaxget();
+	int ok = 0;
+	for (int k = 0; k < nalloc; k++) {
+	    char *p = R_thread_alloc(size, 1);
+	    if (p != NULL) {
+		memset(p, k, size);
+		ok++;
+	    }
+	}
+	pa[t] = ok;
+	/* keep the blocks until every thread has tried */
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+	R_thread_vmaxset(vmax);
+    }
+    /* one count for each thread actually used */
+    SEXP ans = allocVector(INTSXP, nused);
+    for (int i = 0; i < nused; i++) INTEGER(ans)[i] = pa[i];
+    return ans;
+}
+
+static const R_CallMethodDef CallEntries[] = {
+    {"C_threadAlloc", (DL_FUNC) &threadAlloc, 3},
+    {NULL, NULL, 0}
+};
+
+void R_init_exTalloc(DllInfo *dll)
+{
+    R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
+    R_useDynamicSymbols(dll, FALSE);
+}
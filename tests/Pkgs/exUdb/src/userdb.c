@@ -0,0 +1,94 @@
+#include <string.h>
+#include <stdlib.h>
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Callbacks.h>
+#include <R_ext/Rdynload.h>
+
+/* privateData is a list of the name and the getter function */
+
+static Rboolean udb_exists(const char * const name, Rboolean *canCache,
+			   R_ObjectTable *tb)
+{
+    SEXP data = (SEXP) tb->privateData;
+    if (canCache) *canCache = FALSE;
+    return strcmp(name, CHAR(STRING_ELT(VECTOR_ELT(data, 0), 0))) == 0;
+}
+
+static SEXP udb_get(const char * const name, Rboolean *canCache,
+		    R_ObjectTable *tb)
+{
+    SEXP data = (SEXP) tb->privateData;
+    if (!udb_exists(name, canCache, tb))
+	return R_UnboundValue;
+    SEXP call = PROTECT(lang1(VECTOR_ELT(data, 1)));
+    SEXP val = eval(call, R_GlobalEnv);
+    UNPROTECT(1);
+    return val;
+}
+
+static int udb_remove(const char * const name, R_ObjectTable *tb)
+{
+    error("cannot remove from this database");
+    return 0;
+}
+
+static SEXP udb_assign(const char * const name, SEXP value,
+		       R_ObjectTable *tb)
+{
+    error("cannot assign in this database");
+    return R_NilValue;
+}
+
+static SEXP udb_objects(R_ObjectTable *tb)
+{
+    return VECTOR_ELT((SEXP) tb->privateData, 0);
+}
+
+static Rboolean udb_canCache(const char * const name, R_ObjectTable *tb)
+{
+    return FALSE;
+}
+
+static void udb_finalize(SEXP eptr)
+{
+    free(R_ExternalPtrAddr(eptr));
+    R_ClearExternalPtr(eptr);
+}
+
+SEXP userDB(SEXP name, SEXP getter)
+{
+    if (!isString(name) || LENGTH(name) != 1 || !isFunction(getter))
+	error("invalid arguments");
+    R_ObjectTable *tb = (R_ObjectTable *) calloc(1, sizeof(R_ObjectTable));
+    if (tb == NULL)
+	error("cannot allocate the table");
+    SEXP data = PROTECT(allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(data, 0, name);
+    SET_VECTOR_ELT(data, 1, getter);
+    tb->active = TRUE;
+    tb->exists = udb_exists;
+    tb->get = udb_get;
+    tb->remove = udb_remove;
+    tb->assign = udb_assign;
+    tb->objects = udb_objects;
+    tb->canCache = udb_canCache;
+    tb->privateData = data;
+    /* the protected field keeps the name and the getter alive */
+    SEXP ans = PROTECT(R_MakeExternalPtr(tb, R_NilValue, data));
+    R_RegisterCFinalizer(ans, udb_finalize);
+    setAttrib(ans, R_ClassSymbol, mkString("UserDefinedDatabase"));
+    UNPROTECT(2);
+    return ans;
+}
+
+static const R_CallMethodDef CallEntries[] = {
+    {"C_userDB", (DL_FUNC) &userDB, 2},
+    {NULL, NULL, 0}
+};
+
+void R_init_exUdb(DllInfo *dll)
+{
+    R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
+    R_useDynamicSymbols(dll, FALSE);
+}